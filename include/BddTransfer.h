@@ -0,0 +1,76 @@
+/*
+ * BddTransfer.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef BDDTRANSFER_H_
+#define BDDTRANSFER_H_
+
+#include <glib.h>
+#include <sys/types.h>
+#include "Kure.h"
+
+/*!
+ * Transfer of BDDs between processes with the same variable indices (e.g.
+ * after a fork) through a POSIX shared memory object. The BDD is stored as a
+ * table of nodes in topological order (children first). Each entry consists
+ * of the variable index and references to the then and else child. This is
+ * much more compact than Dddmp's text format and can be rebuilt in a single
+ * pass.
+ */
+
+/*!
+ * Returns the name of the shared memory object used to transfer BDDs between
+ * the main process and the given worker process. Different purposes (e.g.
+ * "result" or "sync") get different objects. Use \ref g_free.
+ */
+gchar * 	bdd_transfer_shm_name (pid_t main_pid, pid_t worker_pid,
+				const gchar * purpose);
+
+/*!
+ * Stores the given BDD in the shared memory object with the given name. The
+ * object is created if necessary and resized to fit.
+ */
+gboolean 	bdd_transfer_store (DdManager * manager, DdNode * root,
+				const gchar * shm_name, GError ** perr);
+
+/*!
+ * Stores several BDDs at once. Shared nodes are stored only once.
+ */
+gboolean 	bdd_transfer_store_many (DdManager * manager, DdNode ** roots,
+				guint root_count, const gchar * shm_name, GError ** perr);
+
+/*!
+ * Rebuilds a BDD stored by \ref bdd_transfer_store in the given manager. The
+ * returned node is referenced (see \ref Cudd_Ref). Returns NULL on error.
+ */
+DdNode * 	bdd_transfer_load (DdManager * manager, const gchar * shm_name,
+				GError ** perr);
+
+/*!
+ * Rebuilds the BDDs stored by \ref bdd_transfer_store_many in the given
+ * manager. Returns an array of referenced nodes (see \ref Cudd_Ref) in the
+ * original order, or NULL on error. Free the array with \ref g_free.
+ */
+DdNode ** 	bdd_transfer_load_many (DdManager * manager, const gchar * shm_name,
+				guint * proot_count, GError ** perr);
+
+/*!
+ * Removes the shared memory object. Does nothing if it doesn't exist.
+ */
+void 		bdd_transfer_unlink (const gchar * shm_name);
+
+#endif /* BDDTRANSFER_H_ */
@@ -34,6 +34,8 @@ typedef struct _DomIterator DomIterator;
 
 typedef void (*DomManagerObserver_onDeleteFunc) (gpointer, DomManager*);
 typedef void (*DomManagerObserver_changedFunc) (gpointer, DomManager*);
+typedef void (*DomManagerObserver_entryChangedFunc) (gpointer, DomManager*,
+		const gchar*);
 
 /*interface*/ struct _DomManagerObserver
 {
@@ -48,6 +50,14 @@ typedef void (*DomManagerObserver_changedFunc) (gpointer, DomManager*);
 	 */
 	DomManagerObserver_changedFunc changed;
 
+	/*!
+	 * Will be called if a domain with the given name was inserted into or
+	 * removed from the manager. If the contents of a domain change (see \ref dom_move), it is
+	 * reported as well. Unlike changed, there is one call per
+	 * domain.
+	 */
+	DomManagerObserver_entryChangedFunc entryChanged;
+
 	gpointer object;
 };
 
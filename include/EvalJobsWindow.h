@@ -0,0 +1,38 @@
+/*
+ * EvalJobsWindow.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVALJOBSWINDOW_H_
+#define EVALJOBSWINDOW_H_
+
+#include <gtk/gtk.h>
+
+/*!
+ * Lists the queued and running evaluations (see \ref compute_term_async)
+ * and allows the user to cancel them. The window pops up by itself if an
+ * evaluation takes longer than a moment.
+ */
+typedef struct _EvalJobsWindow EvalJobsWindow;
+
+EvalJobsWindow * 	eval_jobs_window_get_instance ();
+void 				eval_jobs_window_destroy_instance ();
+
+GtkWidget * 		eval_jobs_window_get_widget (EvalJobsWindow * self);
+void 				eval_jobs_window_show (EvalJobsWindow * self);
+void 				eval_jobs_window_hide (EvalJobsWindow * self);
+
+#endif /* EVALJOBSWINDOW_H_ */
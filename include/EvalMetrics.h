@@ -0,0 +1,103 @@
+/*
+ * EvalMetrics.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVALMETRICS_H_
+#define EVALMETRICS_H_
+
+#include <glib.h>
+#include "Kure.h"
+
+/*!
+ * Metrics of the BDD manager during a single evaluation. Counters are
+ * relative to the start of the evaluation. See \ref EvalMetricsProbe.
+ */
+typedef struct _EvalMetrics
+{
+	gulong live_nodes; /*!< Currently, without dead nodes. */
+	gulong peak_nodes; /*!< Maximum of live_nodes during the evaluation.
+	                    * See Cudd_ReadPeakLiveNodeCount. */
+	guint gcs; /*!< Garbage collections. */
+	guint reorderings;
+	gdouble cache_hits;
+	gdouble cache_lookups;
+	gulong memory; /*!< Bytes in use by the manager. */
+} EvalMetrics;
+
+/*!
+ * Takes samples of the metrics of a manager. All functions only read a few
+ * fields of the manager (and update its peak node count) and can be called
+ * from a signal handler.
+ */
+typedef struct _EvalMetricsProbe
+{
+	DdManager * manager;
+	EvalMetrics base; /*!< Absolute values at the start. */
+	EvalMetrics cur;
+} EvalMetricsProbe;
+
+void 		eval_metrics_probe_start (EvalMetricsProbe * self,
+				DdManager * manager);
+
+/*!
+ * Takes a sample and returns the metrics since the start.
+ */
+const EvalMetrics * eval_metrics_probe_sample (EvalMetricsProbe * self);
+
+/*!
+ * Returns a single line like "NODES: 12345 (peak 23456); GC: 2; ..." Use
+ * \ref g_free.
+ */
+gchar * 	eval_metrics_format (const EvalMetrics * m);
+
+
+/*!
+ * A single metrics record in a POSIX shared memory object. A worker
+ * publishes its metrics periodically, the main process reads them
+ * whenever it wants to. Readers never block the writer.
+ */
+typedef struct _EvalMetricsChannel EvalMetricsChannel;
+
+/*!
+ * Opens the shared memory object with the given name. It is created if
+ * necessary. Either side may open the channel first.
+ */
+EvalMetricsChannel * eval_metrics_channel_open (const gchar * shm_name,
+				GError ** perr);
+void 		eval_metrics_channel_close (EvalMetricsChannel * self);
+
+/*!
+ * Publishes a new record. There must be only one writer. Can be called from
+ * a signal handler.
+ */
+void 		eval_metrics_channel_publish (EvalMetricsChannel * self,
+				const EvalMetrics * m);
+
+/*!
+ * Clears the record. \ref eval_metrics_channel_peek returns FALSE until the
+ * next record is published.
+ */
+void 		eval_metrics_channel_clear (EvalMetricsChannel * self);
+
+/*!
+ * Copies the latest record. Returns FALSE if nothing was published yet, or
+ * the writer was too busy to get a consistent copy.
+ */
+gboolean 	eval_metrics_channel_peek (EvalMetricsChannel * self,
+				EvalMetrics * m);
+
+#endif /* EVALMETRICS_H_ */
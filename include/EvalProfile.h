@@ -0,0 +1,80 @@
+/*
+ * EvalProfile.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVALPROFILE_H_
+#define EVALPROFILE_H_
+
+#include <glib.h>
+#include <lua.h>
+
+/*!
+ * Per-operation profile of an evaluation. While a profile is attached to a
+ * Lua state, each function of the Kure library (e.g. composition,
+ * transposition, closures, residuals and products) and each user-defined
+ * function or program is wrapped. The wrapper counts the calls and measures
+ * the time and the BDD sizes of the relational operands and the result.
+ *
+ * \note Profiling adds a stack level to each call. It can't be used together
+ *       with the debugger (see \ref DebugWindow).
+ */
+typedef struct _EvalProfile EvalProfile;
+
+typedef struct _EvalProfileEntry
+{
+	gchar * name; /*!< E.g. "kure.compat.trans" or the name of a program. */
+	gulong calls;
+	gdouble secs; /*!< Including nested calls. */
+	gdouble self_secs; /*!< Excluding nested calls. */
+	gdouble operand_nodes; /*!< Sum of the BDD sizes of all operands. */
+	gdouble result_nodes; /*!< Sum of the BDD sizes of all results. */
+	gulong max_result_nodes;
+} EvalProfileEntry;
+
+EvalProfile * 	eval_profile_new ();
+void 			eval_profile_destroy (EvalProfile * self);
+
+/*!
+ * Wraps the functions in the given Lua state. There must be only one
+ * profile attached at a time. Use \ref eval_profile_detach to restore the
+ * original functions before the state is used for something else.
+ */
+void 			eval_profile_attach (EvalProfile * self, lua_State * L);
+void 			eval_profile_detach (EvalProfile * self, lua_State * L);
+
+/*!
+ * Returns the entries with at least one call, sorted by descending self
+ * time. Free the list with \ref g_list_free. The entries are owned by the
+ * profile.
+ */
+GList/*<EvalProfileEntry*>*/ * eval_profile_get_entries (EvalProfile * self);
+
+/*!
+ * Converts the profile into a string, e.g. to transfer it to another
+ * process, and back. Use \ref g_free. Returns NULL if the string is
+ * malformed.
+ */
+gchar * 		eval_profile_serialize (EvalProfile * self);
+EvalProfile * 	eval_profile_deserialize (const gchar * str);
+
+/*!
+ * Formats the profile as a table with at most max_rows rows (0 for
+ * unlimited). Use \ref g_free.
+ */
+gchar * 		eval_profile_format (EvalProfile * self, guint max_rows);
+
+#endif /* EVALPROFILE_H_ */
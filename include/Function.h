@@ -32,6 +32,8 @@ typedef struct _FunIterator FunIterator;
 
 typedef void (*FunManagerObserver_onDeleteFunc) (gpointer, FunManager*);
 typedef void (*FunManagerObserver_changedFunc) (gpointer, FunManager*);
+typedef void (*FunManagerObserver_entryChangedFunc) (gpointer, FunManager*,
+		const gchar*);
 
 /*interface*/ struct _FunManagerObserver
 {
@@ -46,6 +48,13 @@ typedef void (*FunManagerObserver_changedFunc) (gpointer, FunManager*);
 	 */
 	FunManagerObserver_changedFunc changed;
 
+	/*!
+	 * Will be called if a function with the given name was inserted into or
+	 * removed from the manager. Unlike changed, there is one call per
+	 * function.
+	 */
+	FunManagerObserver_entryChangedFunc entryChanged;
+
 	gpointer object;
 };
 
@@ -129,6 +138,22 @@ void			fun_set_local (Fun * self, gboolean yesno);
 
 const gchar *   fun_get_luacode (const Fun * self, size_t * psize);
 
+/*!
+ * Returns the Lua code as bytecode, which can be loaded without the parser
+ * (see \ref rv_lang_compile). It's compiled on the first call and kept
+ * afterwards, because the definition of a function never changes. Returns
+ * the Lua code if it can't be compiled. Both can be passed to
+ * \ref luaL_loadbuffer.
+ */
+const gchar *   fun_get_luabin (Fun * self, size_t * psize);
+
+/*!
+ * Sets the bytecode of the Lua code, e.g. from a cache. The caller has to
+ * ensure that it was compiled from the same Lua code. If bin is NULL, the
+ * bytecode is compiled again on the next call of \ref fun_get_luabin.
+ */
+void 			fun_set_luabin (Fun * self, const gchar * bin, size_t size);
+
 void 			fun_dump (const Fun * self);
 
 //#include "funktion.h"
@@ -33,6 +33,8 @@ typedef struct _ProgIterator ProgIterator;
 
 typedef void (*ProgManagerObserver_onDeleteFunc) (gpointer, ProgManager*);
 typedef void (*ProgManagerObserver_changedFunc) (gpointer, ProgManager*);
+typedef void (*ProgManagerObserver_entryChangedFunc) (gpointer, ProgManager*,
+		const gchar*);
 
 /*interface*/ struct _ProgManagerObserver
 {
@@ -47,6 +49,13 @@ typedef void (*ProgManagerObserver_changedFunc) (gpointer, ProgManager*);
 	 */
 	ProgManagerObserver_changedFunc changed;
 
+	/*!
+	 * Will be called if a program with the given name was inserted into or
+	 * removed from the manager. Unlike changed, there is one call per
+	 * program.
+	 */
+	ProgManagerObserver_entryChangedFunc entryChanged;
+
 	gpointer object;
 };
 
@@ -123,6 +132,12 @@ gboolean 		prog_is_hidden (const Prog * self);
 
 const gchar *   prog_get_luacode (const Prog * self, size_t * psize);
 
+/*!
+ * Returns the Lua code as bytecode. See \ref fun_get_luabin.
+ */
+const gchar *   prog_get_luabin (Prog * self, size_t * psize);
+void 			prog_set_luabin (Prog * self, const gchar * bin, size_t size);
+
 void 			prog_dump (const Prog * self);
 
 #endif /* PROGRAM_H_ */
@@ -38,6 +38,9 @@ typedef struct _RelIterator RelIterator;
 
 typedef void (*RelManagerObserver_onDeleteFunc) (gpointer, RelManager*);
 typedef void (*RelManagerObserver_changedFunc) (gpointer, RelManager*);
+typedef void (*RelManagerObserver_relChangedFunc) (gpointer, RelManager*, Rel*);
+typedef void (*RelManagerObserver_entryChangedFunc) (gpointer, RelManager*,
+		const gchar*);
 
 /*interface*/ struct _RelManagerObserver
 {
@@ -52,6 +55,19 @@ typedef void (*RelManagerObserver_changedFunc) (gpointer, RelManager*);
 	 */
 	RelManagerObserver_changedFunc changed;
 
+	/*!
+	 * Will be called if the contents of a relation in the manager have
+	 * changed. See \ref rel_changed.
+	 */
+	RelManagerObserver_relChangedFunc relChanged;
+
+	/*!
+	 * Will be called if a relation with the given name was inserted into or
+	 * removed from the manager. A rename is reported for the old and for the
+	 * new name. Unlike changed, there is one call per relation.
+	 */
+	RelManagerObserver_entryChangedFunc entryChanged;
+
 	gpointer object;
 };
 
@@ -184,11 +200,100 @@ void			rel_get_cols (const Rel*, mpz_t cols);
 
 gboolean		rel_same_dim (const Rel * a, const Rel * b);
 
+/*!
+ * Starts an edit transaction. Entries changed by \ref rel_edit_set_bit are
+ * collected and applied at once by \ref rel_edit_commit, which emits
+ * 'changed' only once. Transactions can be nested. Only the outermost commit
+ * applies the edits. Until then, the relation's implementation doesn't
+ * reflect the pending edits.
+ */
+void			rel_edit_begin (Rel * self);
+
+/*!
+ * Sets (yesno is TRUE) or clears an entry at the end of the current
+ * transaction. A later edit of the same entry replaces an earlier one.
+ * Rows and columns are 0-indexed.
+ */
+void			rel_edit_set_bit (Rel * self, int row, int col, gboolean yesno);
+
+/*!
+ * Ends the current transaction. At the outermost level, the pending edits
+ * are applied with a single union and a single difference and 'changed' is
+ * emitted, unless there were no edits. Returns FALSE if the edits couldn't
+ * be applied, e.g. because the relation is too big.
+ */
+gboolean		rel_edit_commit (Rel * self);
+
+/*!
+ * Ends the current transaction. At the outermost level, the pending edits
+ * are dropped.
+ */
+void			rel_edit_rollback (Rel * self);
+
 /* If another relation with the target name exists, FALSE is returned. If the
  * relation already has that name, TRUE is returned. */
 gboolean		rel_rename (Rel * self, const gchar * new_name);
 
 
+/*!
+ * Fingerprint of the contents of a relation. Because BDDs are canonical, two
+ * relations in the same \ref KureContext have the same contents iff their
+ * BDD roots and their dimensions are equal. Dimensions with more than 63 bits
+ * are hashed.
+ *
+ * The serial changes whenever the contents of a \ref Rel change and is never
+ * reused. Use it to tell if a relation has changed since some point in time,
+ * e.g. for caches. A BDD node can be reused for a different BDD after it was
+ * freed, so the root alone isn't enough for that.
+ */
+typedef struct _RelFingerprint
+{
+	DdNode * root;
+	guint64 rows, cols;
+	guint64 serial; /*!< Zero for \ref rel_impl_get_fingerprint. */
+} RelFingerprint;
+
+/*!
+ * Returns the fingerprint of the relation's current contents. It is updated
+ * by \ref rel_changed, but also if the implementation was changed in place.
+ */
+void			rel_get_fingerprint (Rel * self, RelFingerprint * fp);
+
+/*!
+ * Returns the number of BDD nodes of the relation's contents. It's counted
+ * once for each fingerprint, so repeated calls are cheap as long as the
+ * contents don't change.
+ */
+guint			rel_get_node_count (Rel * self);
+
+/*!
+ * Fingerprint of a relation implementation without a serial. Only valid
+ * while the implementation exists and doesn't change.
+ */
+void			rel_impl_get_fingerprint (const KureRel * impl, RelFingerprint * fp);
+
+/*!
+ * Returns TRUE if the fingerprints belong to the same contents. See
+ * \ref rel_equal.
+ */
+gboolean		rel_fingerprint_same_contents (const RelFingerprint * a,
+					const RelFingerprint * b);
+
+/*!
+ * Returns TRUE if both fingerprints are the same, including their serials.
+ * Use this to check if a relation has changed.
+ */
+gboolean		rel_fingerprint_equal (const RelFingerprint * a,
+					const RelFingerprint * b);
+guint			rel_fingerprint_hash (const RelFingerprint * fp);
+
+/*!
+ * Returns TRUE if both relations have the same contents and dimension. Takes
+ * constant time. Both relations must belong to the same \ref KureContext.
+ */
+gboolean		rel_equal (const Rel * a, const Rel * b);
+
+
 typedef void (*relation_observer_renamed_func_t) (gpointer,Rel*,const char * old_name);
 typedef void (*relation_observer_changed_func_t) (gpointer,Rel*);
 typedef void (*relation_observer_on_delete_func_t) (gpointer,Rel*);
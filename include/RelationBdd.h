@@ -0,0 +1,117 @@
+/*
+ * RelationBdd.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef RELATIONBDD_H_
+#define RELATIONBDD_H_
+
+#include <glib.h>
+#include "Kure.h"
+
+/*!
+ * Operations on many entries of a relation at once which work directly on
+ * its BDD. Using \ref kure_set_bit_si or \ref kure_get_bit_fast_si for each
+ * entry costs a complete BDD operation per entry, which is prohibitive for
+ * relations with many entries.
+ *
+ * All functions only support relations whose size fits into an int (see
+ * \ref kure_rel_fits_si). Rows and columns are 0-indexed.
+ */
+
+typedef struct _RelBddPair
+{
+	gint row, col;
+} RelBddPair;
+
+/*!
+ * Sets (yesno is TRUE) or clears all the given entries of the relation. The
+ * BDD of the entries is built bottom-up in a single pass over the sorted
+ * pairs and is then combined with the relation. Duplicates and entries out of
+ * range are ignored. The array is not modified. Returns FALSE if the relation
+ * is too big or if there was not enough memory.
+ */
+gboolean 	rel_bdd_set_pairs (KureRel * impl, const RelBddPair * pairs,
+				gsize count, gboolean yesno);
+
+/*!
+ * Number of bytes of a packed block of bits. See \ref rel_bdd_get_block.
+ */
+#define REL_BDD_BLOCK_SIZE(width,height) \
+	(((gsize)(width) * (gsize)(height) + 7) / 8)
+
+/*!
+ * Returns the k-th bit of a packed block. The entry (i,j) of the block is
+ * bit i*width+j.
+ */
+#define REL_BDD_BLOCK_GET(bits,k) (((bits)[(k) >> 3] >> ((k) & 7)) & 1)
+
+/*!
+ * Sets the k-th bit of a packed block. See \ref REL_BDD_BLOCK_GET.
+ */
+#define REL_BDD_BLOCK_SET(bits,k) ((bits)[(k) >> 3] |= 1 << ((k) & 7))
+
+/*!
+ * Extracts the entries in the rows [row,row+height) and columns
+ * [col,col+width) into a packed block of bits (see \ref REL_BDD_BLOCK_GET).
+ * bits must have room for \ref REL_BDD_BLOCK_SIZE bytes. The BDD is walked
+ * only once. Subtrees with no entries inside the block are pruned and
+ * constant subtrees are filled at once. Entries outside the relation are
+ * cleared. Returns FALSE if the relation is too big. The block is empty
+ * in that case.
+ */
+gboolean 	rel_bdd_get_block (const KureRel * impl, int row, int col, int height,
+				int width, guint8 * bits);
+
+/*!
+ * Called for each entry of a relation. See \ref rel_bdd_foreach_entry.
+ */
+typedef void (*RelBddEntryFunc) (int row, int col, gpointer user_data);
+
+/*!
+ * Calls func for each entry of the relation in the rows [row,row+height)
+ * and columns [col,col+width). Only the paths of the BDD to the constant one
+ * are visited, so the costs are linear in the number of entries times the
+ * number of variables, not in the size of the block. The entries are not
+ * reported in row-major order. The relation must not change during the
+ * walk. Use \ref G_MAXINT for height and width to visit all entries.
+ * Returns the number of calls.
+ */
+gsize 		rel_bdd_foreach_entry (const KureRel * impl, int row, int col,
+				int height, int width, RelBddEntryFunc func,
+				gpointer user_data);
+
+/*!
+ * Number of aligned blocks of 2^shift numbers which cover n numbers. See
+ * \ref rel_bdd_count_blocks.
+ */
+#define REL_BDD_BLOCKS(n,shift) ((n) > 0 ? (((n) - 1) >> (shift)) + 1 : 0)
+
+/*!
+ * Counts the entries in the aligned blocks of 2^shift x 2^shift cells. The
+ * block (i,j) covers the rows [i*2^shift,(i+1)*2^shift) and the columns
+ * [j*2^shift,(j+1)*2^shift). counts receives the blocks in the block rows
+ * [row,row+height) and block columns [col,col+width) in row-major order and
+ * must have room for height*width values. An aligned block corresponds to a
+ * prefix of the variables of the row and column numbers. Hence, a block's
+ * count is the number of minterms below the prefix and no entries are
+ * enumerated. Blocks outside the relation are zero. Returns FALSE if the
+ * relation is too big.
+ */
+gboolean 	rel_bdd_count_blocks (const KureRel * impl, int shift, int row,
+				int col, int height, int width, double * counts);
+
+#endif /* RELATIONBDD_H_ */
@@ -18,6 +18,9 @@ typedef void (*relation_proxy_clear_bit_func_t)
   (RelationProxy*, int, int);
 typedef void (*relation_proxy_get_bits_rect_func_t)
   (RelationProxy*, int, int, int, int, gboolean*);
+/* Same as get_bits_rect, but the bits are packed. See rel_bdd_get_block. */
+typedef void (*relation_proxy_get_bits_packed_func_t)
+  (RelationProxy*, int, int, int, int, guint8*);
 
 typedef gboolean (*relation_proxy_mp_get_bit_func_t)
   (RelationProxy*, mpz_t, mpz_t);
@@ -50,6 +53,7 @@ typedef void (*relation_proxy_destroy_func_t) (RelationProxy*);
   relation_proxy_set_bit_func_t            setBit;
   relation_proxy_clear_bit_func_t          clearBit;
   relation_proxy_get_bits_rect_func_t      getBitsRect;
+  relation_proxy_get_bits_packed_func_t    getBitsPacked;
 
   /* Kure_MINT interface */
   relation_proxy_mp_get_bit_func_t         mp_getBit;
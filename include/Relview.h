@@ -282,7 +282,9 @@ gboolean rv_user_ask_label (Relview * rv, GString * /*input*/ labelName);
  * \ref kure_context_deref okay.
  *
  * \note Once the new state is returned, changes to objects inside RelView
- *       don't have any effect on the state.
+ *       don't have any effect on the state, except for relations. They are
+ *       copied from the \ref RelManager when they are used for the first
+ *       time. See also \ref rv_lang_unbind.
  *
  * \attention Remark that "$" is not a valid identifier in Lua. To overcome
  *            that, "$" is mapped to the special name KURE_DOLLAR_SUBST. Thus,
@@ -293,6 +295,76 @@ gboolean rv_user_ask_label (Relview * rv, GString * /*input*/ labelName);
  */
 lua_State * rv_lang_new_state (Relview * rv);
 
+/*!
+ * Returns the Lua state which is shared by the evaluations in the main
+ * process. It's created by \ref rv_lang_new_state on first use. Afterwards,
+ * only the objects which have changed since the last call are updated, see
+ * \ref WorkspaceSync. Returns NULL if the state couldn't be created. The
+ * state belongs to the \ref Relview object.
+ *
+ * Don't use the state directly for evaluations. Use \ref rv_lang_new_env
+ * instead, so the globals set by an evaluation don't stay in the state.
+ */
+lua_State * rv_lang_get_state (Relview * rv);
+
+/*!
+ * Removes the global object with the given name from a state created by
+ * \ref rv_lang_new_state. Unlike setting it to nil, a relation with that name
+ * isn't copied into the state later on. A new value can be assigned, though.
+ */
+void		rv_lang_unbind (lua_State * L, const gchar * name);
+
+/*!
+ * Creates a cheap child environment of the shared state (see
+ * \ref rv_lang_get_state). It's a Lua thread with a globals table of its
+ * own. Global objects are looked up in the shared state, but new globals are
+ * only visible in the environment. Release it with
+ * \ref rv_lang_env_destroy. Don't call \ref lua_close on it. Returns NULL if
+ * the shared state couldn't be created.
+ */
+lua_State * rv_lang_new_env (Relview * rv);
+void		rv_lang_env_destroy (Relview * rv, lua_State * env);
+
+/*!
+ * Checks out a complete state of its own, like \ref rv_lang_new_state, for
+ * a run which changes the state itself, e.g. by installing debug hooks. The
+ * state is taken from a small pool if possible. A pooled state is brought up
+ * to date if the workspace has changed since its last use. Return it with
+ * \ref rv_lang_state_return. Returns NULL if a new state couldn't be
+ * created.
+ */
+lua_State * rv_lang_state_checkout (Relview * rv);
+
+/*!
+ * Returns a state from \ref rv_lang_state_checkout. Its globals are reset
+ * to those at checkout time and the debug hook is removed. Don't use the
+ * state afterwards.
+ */
+void		rv_lang_state_return (Relview * rv, lua_State * L);
+
+
+/*!
+ * Compiles the given Lua chunk and returns the bytecode (see
+ * \ref lua_dump), which can be loaded by \ref luaL_loadbuffer without
+ * running the parser. The code itself is the chunk name, like in
+ * \ref rv_lang_new_state, so the debugger sees the source. Returns NULL if
+ * the code can't be compiled. Free the result using \ref g_free.
+ */
+gchar * 	rv_lang_compile (const gchar * code, size_t size,
+				size_t * /*out*/ pbinsize);
+
+
+/*!
+ * Creates the \ref KureDom for a domain with the given components (in Lua)
+ * using the objects in the given state. Doesn't interact with the user.
+ * Returns NULL on error. In this case, the error code is the number of the
+ * component (1 or 2) which failed. If the components are not homogeneous,
+ * a message is appended to warnings, if non-NULL.
+ */
+KureDom * rv_lang_resolve_dom (lua_State * L, const gchar * name,
+		DomainType type, const gchar * comp1_lua, const gchar * comp2_lua,
+		GString * warnings, GError ** perr);
+
 
 /*!
  * Evaluate the given expression an return the resulting relation. Returns NULL
@@ -301,15 +373,31 @@ lua_State * rv_lang_new_state (Relview * rv);
  * Expressions are, e.g., "x^", "[k,j]*-t", etc. Any global object can be used.
  * Evaluation of Lua code is not supported by this function.
  *
- * Because the function creates a new \ref lua_State with each call and
- * destroys it directly after use, it can be quiet slow depending on the number
- * of global objects.
+ * The expression is evaluated in a child environment of the shared state,
+ * see \ref rv_lang_new_env.
  *
- * \see rv_lang_new_state
+ * \see rv_lang_get_state
  */
 KureRel * rv_lang_eval (Relview * self, const char * expr, GError ** perr);
 
 
+/*!
+ * Returns TRUE if the given term in the RelView language mentions one of
+ * the names in the given table (keys) as an identifier. Only the syntax is
+ * considered, e.g. names in comments are found too.
+ */
+gboolean rv_lang_term_mentions (const gchar * term,
+		GHashTable/*<const gchar*,*>*/ * names);
+
+/*!
+ * Inserts the identifiers of the given term into the set. Keys and values
+ * are the same newly allocated strings. Create the set with
+ * g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL).
+ */
+void rv_lang_term_collect_identifiers (const gchar * term,
+		GHashTable/*<gchar*,gchar*>*/ * set);
+
+
 /*******************************************************************************
  *                                   Labels                                    *
  *                     (Labels for Relations and Graphs.)                      *
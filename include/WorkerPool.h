@@ -0,0 +1,133 @@
+/*
+ * WorkerPool.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include <glib.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef struct _WorkerPool WorkerPool;
+typedef struct _Worker Worker;
+
+/*!
+ * Called in the parent process right before a worker is forked. The returned
+ * state is inherited by the worker. Return NULL if the worker cannot be
+ * created.
+ */
+typedef gpointer (*WorkerPoolPrepareFunc) (gpointer user_data);
+
+/*!
+ * Main routine of a worker process. Reads requests from the first stream and
+ * writes the responses to the second one. The semaphore can be used to wake up
+ * the parent. The worker process terminates when the routine returns.
+ */
+typedef void (*WorkerPoolMainFunc) (gpointer state, FILE * requests,
+		FILE * results, int semId, gpointer user_data);
+
+/*!
+ * Called in the parent process after the worker was forked to release the
+ * state from \ref WorkerPoolPrepareFunc. The worker is NULL if it could not
+ * be created. Otherwise, this is the place to attach data to the worker. See
+ * \ref worker_set_data.
+ */
+typedef void (*WorkerPoolReleaseFunc) (Worker * worker, gpointer state,
+		gpointer user_data);
+
+/*!
+ * Called in the parent process after a worker process has terminated and was
+ * reaped. Can be used to release resources associated with the worker. May
+ * be NULL.
+ */
+typedef void (*WorkerPoolExitedFunc) (Worker * worker, gpointer user_data);
+
+typedef struct _WorkerPoolClass
+{
+	WorkerPoolPrepareFunc prepare;
+	WorkerPoolMainFunc main;
+	WorkerPoolReleaseFunc release;
+	WorkerPoolExitedFunc exited;
+} WorkerPoolClass;
+
+
+/*!
+ * Creates a pool of at most size long-lived worker processes. Workers are
+ * forked on demand and are refilled in the background once they were used,
+ * killed or became stale. See \ref worker_pool_invalidate.
+ */
+WorkerPool *	worker_pool_new (guint size, const WorkerPoolClass * c,
+						gpointer user_data);
+
+/*!
+ * Terminates all workers. Busy workers are killed.
+ */
+void 			worker_pool_destroy (WorkerPool * self);
+
+void 			worker_pool_set_size (WorkerPool * self, guint size);
+guint 			worker_pool_get_size (WorkerPool * self);
+
+/*!
+ * Returns an idle and up-to-date worker. If there is none, a new one is forked
+ * immediately. Returns NULL and sets the error, if the worker could not be
+ * created.
+ */
+Worker * 		worker_pool_acquire (WorkerPool * self, GError ** perr);
+
+/*!
+ * Gives back a worker after the current request was answered completely. The
+ * worker is reused later on, unless it has become stale in the meantime.
+ */
+void 			worker_pool_release (WorkerPool * self, Worker * worker);
+
+/*!
+ * Kills the given worker (SIGKILL) and reaps it. A replacement is forked in the
+ * background. Use this on cancelation or if the worker is in an unknown
+ * state.
+ */
+void 			worker_pool_kill (WorkerPool * self, Worker * worker);
+
+/*!
+ * Marks all workers as stale, e.g. because the workspace has changed. Busy
+ * workers finish their current request, but are not reused. Idle workers are
+ * replaced in the background after a short delay, so a sequence of changes
+ * triggers only a single refill.
+ */
+void 			worker_pool_invalidate (WorkerPool * self);
+
+pid_t 			worker_get_pid (Worker * self);
+int 			worker_get_sem_id (Worker * self);
+
+/*!
+ * Stream to write requests to the worker. Don't close it.
+ */
+FILE * 			worker_get_requests (Worker * self);
+
+/*!
+ * Stream to read the worker's responses from. Don't close it.
+ */
+FILE * 			worker_get_results (Worker * self);
+
+/*!
+ * Arbitrary data associated with the worker in the main process. Release it
+ * in the \ref WorkerPoolExitedFunc.
+ */
+gpointer 		worker_get_data (Worker * self);
+void 			worker_set_data (Worker * self, gpointer data);
+
+#endif /* WORKERPOOL_H_ */
@@ -0,0 +1,86 @@
+/*
+ * WorkspaceSync.h
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef WORKSPACESYNC_H_
+#define WORKSPACESYNC_H_
+
+#include <glib.h>
+#include "Relview.h"
+
+/*!
+ * Journal of changes to the global relations, functions, programs and
+ * domains. It is driven by the observers of the corresponding managers. Each
+ * change increases the generation. Someone who has a copy of the workspace
+ * at a given generation (e.g. an evaluation worker) can ask for the objects
+ * which have changed since then and has to update only those.
+ *
+ * There is only one entry per name, because all these objects share a
+ * single namespace (see \ref Namespace). The costs to enumerate the changes
+ * since some generation are linear in the number of changed objects.
+ */
+typedef struct _WorkspaceSync WorkspaceSync;
+
+typedef enum _WorkspaceSyncKind
+{
+	WORKSPACE_SYNC_RELATION = 0,
+	WORKSPACE_SYNC_FUNCTION,
+	WORKSPACE_SYNC_PROGRAM,
+	WORKSPACE_SYNC_DOMAIN,
+
+	WORKSPACE_SYNC_KIND_COUNT
+} WorkspaceSyncKind;
+
+/*!
+ * Called for each changed object. obj is the current \ref Rel, \ref Fun,
+ * \ref Prog or \ref Dom, depending on the kind. It is NULL if the object
+ * was deleted.
+ */
+typedef void (*WorkspaceSyncFunc) (const gchar * name, WorkspaceSyncKind kind,
+		gpointer obj, gpointer user_data);
+
+/*!
+ * Creates a new journal and registers it with the managers of the given
+ * \ref Relview object. The current objects are the base line at generation
+ * zero.
+ */
+WorkspaceSync * workspace_sync_new (Relview * rv);
+void 			workspace_sync_destroy (WorkspaceSync * self);
+
+/*!
+ * Returns the journal of the given \ref Relview object. It's created on
+ * first use and shared by all consumers, each of which keeps the generation
+ * it has seen last. The journal belongs to the \ref Relview object.
+ */
+WorkspaceSync * rv_get_workspace_sync (Relview * rv);
+
+/*!
+ * Returns the current generation. It only increases.
+ */
+gulong 			workspace_sync_get_generation (WorkspaceSync * self);
+
+/*!
+ * Calls func for each object which has changed after the given generation.
+ * Domains whose components mention a changed object are reported as well,
+ * because their size may have changed. Domains are always reported last, so
+ * the objects they depend on are already up to date. Returns the number of
+ * calls.
+ */
+guint 			workspace_sync_foreach_change (WorkspaceSync * self,
+					gulong since, WorkspaceSyncFunc func, gpointer user_data);
+
+#endif /* WORKSPACESYNC_H_ */
@@ -23,6 +23,7 @@
 #  define COMPUTE_H
 
 #include <gtk/gtk.h> /* GLib types */
+#include "EvalMetrics.h"
 
 typedef enum _RvComputeFlags RvComputeFlags;
 
@@ -30,10 +31,168 @@ enum _RvComputeFlags
 {
   RV_COMPUTE_FLAGS_CHECK_ASSERTIONS = 0x1,
   RV_COMPUTE_FLAGS_SEQUENTIAL = 0x2,
-  RV_COMPUTE_FLAGS_FORCE_OVERWRITE = 0x4
+  RV_COMPUTE_FLAGS_FORCE_OVERWRITE = 0x4,
+  RV_COMPUTE_FLAGS_PROFILE = 0x8 /*!< Print a per-operation profile after the
+                                  * evaluation. See EvalProfile.h. Ignored if
+                                  * assertions are checked. */
 };
 
+/*!
+ * Evaluates the term and stores the result in the given relation. Unless
+ * the evaluation is sequential (see \ref RvComputeFlags), the term is only
+ * queued and the function returns immediately. See \ref compute_term_async.
+ * If the queue is empty and the term was cheap before (see the
+ * "eval_inline_max_ms" setting), it's evaluated right away without a worker.
+ * The evaluation is profiled if the "eval_profile" setting is non-zero.
+ * The expensive operands of a wide intersection or union are evaluated in
+ * parallel by several workers (see the "eval_split_min_nodes" setting).
+ */
 void compute_term (const gchar *term, const gchar *relName,
                    RvComputeFlags flags);
 
+
+/*******************************************************************************
+ *                              Evaluation Queue                               *
+ ******************************************************************************/
+
+/*!
+ * A term which is evaluated in the background by a worker process. Jobs are
+ * started in the order they were queued, as long as there are free workers
+ * (see the "eval_workers" setting). A job which uses the result of an
+ * earlier, unfinished job waits for that job.
+ */
+typedef struct _EvalJob EvalJob;
+
+typedef enum _EvalJobState
+{
+  EVAL_JOB_QUEUED = 0,
+  EVAL_JOB_RUNNING,
+  EVAL_JOB_FINISHED, /*!< The result was stored. */
+  EVAL_JOB_FAILED,
+  EVAL_JOB_CANCELED
+} EvalJobState;
+
+/*!
+ * Called in the main loop after the job has finished, failed or was
+ * canceled. The job is destroyed afterwards.
+ */
+typedef void (*EvalJobDoneFunc) (EvalJob * job, gpointer user_data);
+
+/*!
+ * Queues the term for evaluation and returns the id of the job immediately.
+ * The result is stored in the given relation when the job has finished.
+ * Errors are reported to the user. done may be NULL.
+ *
+ * The job may already have completed and been destroyed when the function
+ * returns, e.g. if its result was cached. Use \ref eval_queue_lookup_job to
+ * get the job as long as it's queued or running.
+ */
+guint 			compute_term_async (const gchar * term, const gchar * relName,
+						RvComputeFlags flags, EvalJobDoneFunc done,
+						gpointer user_data);
+
+/*!
+ * Queues a single job which evaluates the terms in the given order in one
+ * worker. The result of each term is stored in the corresponding relation
+ * and is visible to the following terms of the batch, as if the terms were
+ * evaluated one after another. The workspace is transfered only once and
+ * all results come back at once. A failing term doesn't affect the others,
+ * but terms using its result fail too. The job only fails if all terms
+ * have failed. See \ref eval_job_get_item_error for the errors of the
+ * terms. count must be positive. Returns the id of the job, or 0 on error.
+ * Like for \ref compute_term_async, the job may be gone already.
+ */
+guint 			compute_terms_batch (const gchar * const * terms,
+						const gchar * const * relNames, guint count,
+						RvComputeFlags flags, EvalJobDoneFunc done,
+						gpointer user_data);
+
+/*!
+ * Cancels the job. A running job's worker is killed. Does nothing if the job
+ * has already finished.
+ */
+void 			eval_job_cancel (EvalJob * self);
+
+guint 			eval_job_get_id (EvalJob * self);
+const gchar * 	eval_job_get_term (EvalJob * self);
+const gchar * 	eval_job_get_rel_name (EvalJob * self);
+EvalJobState 	eval_job_get_state (EvalJob * self);
+
+/*!
+ * Returns the seconds since the job was started, or 0 if it is still
+ * queued.
+ */
+gdouble 		eval_job_get_elapsed (EvalJob * self);
+
+/*!
+ * Copies the latest metrics of the BDD manager of a running job's worker.
+ * They are updated a few times per second. Returns FALSE if there are none
+ * (yet).
+ */
+gboolean 		eval_job_get_metrics (EvalJob * self, EvalMetrics * m);
+
+/*!
+ * Returns the error message of a failed job, or NULL.
+ */
+const gchar * 	eval_job_get_error (EvalJob * self);
+
+/*!
+ * Returns the number of terms of the job. It's 1 unless the job was
+ * created by \ref compute_terms_batch.
+ */
+guint 			eval_job_get_size (EvalJob * self);
+
+/*!
+ * Returns the error message of the i-th term of a finished job, or NULL if
+ * the term was evaluated successfully.
+ */
+const gchar * 	eval_job_get_item_error (EvalJob * self, guint i);
+
+/*!
+ * Returns the queued and running jobs in the order they were queued. Don't
+ * modify the list.
+ */
+const GList/*<EvalJob*>*/ * eval_queue_get_jobs ();
+
+/*!
+ * Returns the queued or running job with the given id, or NULL if it has
+ * completed and is gone.
+ */
+EvalJob * 		eval_queue_lookup_job (guint id);
+
+typedef void (*EvalQueueObserver_jobChangedFunc) (gpointer, EvalJob*);
+
+/*!
+ * jobChanged is called whenever a job was queued or its state has changed.
+ * The job is destroyed after the last notification with a final state.
+ */
+typedef struct _EvalQueueObserver
+{
+	EvalQueueObserver_jobChangedFunc jobChanged;
+
+	gpointer object;
+} EvalQueueObserver;
+
+void 			eval_queue_register_observer (EvalQueueObserver * o);
+void 			eval_queue_unregister_observer (EvalQueueObserver * o);
+
+
+/*******************************************************************************
+ *                                Result Cache                                 *
+ ******************************************************************************/
+
+/*!
+ * Returns the number of cache hits and misses since the program was started
+ * and the number of BDD nodes in the cache. Each pointer may be NULL. Terms
+ * which use random numbers or are evaluated with assertions aren't cached
+ * and don't count.
+ */
+void 			eval_cache_get_stats (gulong * phits, gulong * pmisses,
+						gulong * pnodes);
+
+/*!
+ * Drops all cached results.
+ */
+void 			eval_cache_clear ();
+
 #endif /* compute.h */
@@ -27,4 +27,13 @@
 IOHandler * prog_get_handler ();
 IOHandler * label_get_handler ();
 
+/*!
+ * Enables or disables the cache for program files. If enabled, the Lua code
+ * and the bytecode of the functions and programs in a file are stored in
+ * the user's cache directory (e.g. $XDG_CACHE_HOME/relview) by the hash of
+ * the file. An unchanged file is loaded from the cache without the parser.
+ * Enabled by default.
+ */
+void prog_file_set_cache_enabled (gboolean yesno);
+
 #endif
@@ -0,0 +1,302 @@
+/*
+ * BddTransfer.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "BddTransfer.h"
+#include "Relview.h" /* rv_error_domain */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BDD_TRANSFER_MAGIC 0x52564254 /* "RVBT" */
+#define BDD_TRANSFER_VERSION 2
+
+/* References to nodes are indices into the node table shifted by one. The
+ * lowest bit is the complement bit. Index 0 is the constant one. */
+#define REF_INDEX(r) ((r) >> 1)
+#define REF_IS_COMPLEMENT(r) ((r) & 1)
+
+typedef struct _BddTransferHeader
+{
+	guint32 magic;
+	guint32 version;
+	guint32 node_count; /*!< Including the constant. */
+	guint32 root_count; /*!< Root references follow the header. */
+} BddTransferHeader;
+
+typedef struct _BddTransferNode
+{
+	guint32 index; /*!< Variable index. */
+	guint32 then_ref, else_ref;
+} BddTransferNode;
+
+
+gchar * bdd_transfer_shm_name (pid_t main_pid, pid_t worker_pid,
+		const gchar * purpose)
+{
+	return g_strdup_printf ("/relview-%d-%d-%s", (int)main_pid,
+			(int)worker_pid, purpose);
+}
+
+
+typedef struct _BddTransferWriter
+{
+	GHashTable/*<DdNode*,index>*/ * ids;
+	BddTransferNode * nodes;
+	guint32 count;
+} BddTransferWriter;
+
+/*!
+ * Appends the node and its children in post-order. Returns the reference for
+ * the given node.
+ */
+static guint32 _bdd_transfer_collect (BddTransferWriter * w, DdNode * n)
+{
+	DdNode * r = Cudd_Regular(n);
+	guint32 id;
+	gpointer value;
+
+	if (Cudd_IsConstant(r)) id = 0;
+	else if (g_hash_table_lookup_extended (w->ids, r, NULL, &value))
+		id = GPOINTER_TO_UINT(value);
+	else {
+		guint32 then_ref = _bdd_transfer_collect (w, Cudd_T(r));
+		guint32 else_ref = _bdd_transfer_collect (w, Cudd_E(r));
+
+		id = w->count ++;
+		w->nodes[id].index = Cudd_NodeReadIndex (r);
+		w->nodes[id].then_ref = then_ref;
+		w->nodes[id].else_ref = else_ref;
+		g_hash_table_insert (w->ids, r, GUINT_TO_POINTER(id));
+	}
+
+	return (id << 1) | (Cudd_IsComplement(n) ? 1 : 0);
+}
+
+
+gboolean bdd_transfer_store_many (DdManager * manager, DdNode ** roots,
+		guint root_count, const gchar * shm_name, GError ** perr)
+{
+	/* Cudd_SharingSize includes the constant node. It is at least 1, even
+	 * if there are no roots at all. */
+	guint32 count = (guint32) MAX(1, Cudd_SharingSize (roots, (int) root_count));
+	size_t size = sizeof(BddTransferHeader) + root_count * sizeof(guint32)
+			+ count * sizeof(BddTransferNode);
+	BddTransferHeader * header;
+	BddTransferWriter w;
+	guint32 * root_refs;
+	void * mem;
+	guint i;
+	int fd;
+
+	fd = shm_open (shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		g_set_error (perr, rv_error_domain(), 0, "shm_open: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	if (ftruncate (fd, size) != 0) {
+		g_set_error (perr, rv_error_domain(), 0, "ftruncate: %s", g_strerror(errno));
+		close (fd);
+		return FALSE;
+	}
+
+	mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (MAP_FAILED == mem) {
+		g_set_error (perr, rv_error_domain(), 0, "mmap: %s", g_strerror(errno));
+		return FALSE;
+	}
+
+	header = (BddTransferHeader*) mem;
+	root_refs = (guint32*) (header + 1);
+	w.nodes = (BddTransferNode*) (root_refs + root_count);
+	w.count = 1; /* the constant */
+	w.ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	memset (&w.nodes[0], 0, sizeof (BddTransferNode));
+	for (i = 0 ; i < root_count ; ++i)
+		root_refs[i] = _bdd_transfer_collect (&w, roots[i]);
+	header->root_count = root_count;
+	header->node_count = w.count;
+	header->version = BDD_TRANSFER_VERSION;
+	header->magic = BDD_TRANSFER_MAGIC;
+
+	g_assert (w.count == count);
+
+	g_hash_table_destroy (w.ids);
+	munmap (mem, size);
+	return TRUE;
+}
+
+
+gboolean bdd_transfer_store (DdManager * manager, DdNode * root,
+		const gchar * shm_name, GError ** perr)
+{
+	return bdd_transfer_store_many (manager, &root, 1, shm_name, perr);
+}
+
+
+static DdNode * _bdd_transfer_deref (DdNode ** built, guint32 ref)
+{
+	DdNode * n = built[REF_INDEX(ref)];
+	return REF_IS_COMPLEMENT(ref) ? Cudd_Not(n) : n;
+}
+
+
+DdNode ** bdd_transfer_load_many (DdManager * manager, const gchar * shm_name,
+		guint * proot_count, GError ** perr)
+{
+	BddTransferHeader * header;
+	BddTransferNode * nodes;
+	guint32 * root_refs;
+	DdNode ** built, **roots = NULL;
+	struct stat st;
+	void * mem;
+	guint32 i;
+	int fd;
+
+	fd = shm_open (shm_name, O_RDONLY, 0);
+	if (fd < 0) {
+		g_set_error (perr, rv_error_domain(), 0, "shm_open: %s", g_strerror(errno));
+		return NULL;
+	}
+
+	if (fstat (fd, &st) != 0 || st.st_size < sizeof(BddTransferHeader)) {
+		g_set_error_literal (perr, rv_error_domain(), 0,
+				"Shared memory object is too small.");
+		close (fd);
+		return NULL;
+	}
+
+	mem = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (MAP_FAILED == mem) {
+		g_set_error (perr, rv_error_domain(), 0, "mmap: %s", g_strerror(errno));
+		return NULL;
+	}
+
+	header = (BddTransferHeader*) mem;
+	root_refs = (guint32*) (header + 1);
+	nodes = (BddTransferNode*) (root_refs + header->root_count);
+
+	if (header->magic != BDD_TRANSFER_MAGIC
+			|| header->version != BDD_TRANSFER_VERSION
+			|| header->node_count < 1
+			|| sizeof(BddTransferHeader) + header->root_count * sizeof(guint32)
+				+ header->node_count * sizeof(BddTransferNode) > st.st_size) {
+		g_set_error_literal (perr, rv_error_domain(), 0,
+				"Invalid BDD node table in shared memory.");
+		munmap (mem, st.st_size);
+		return NULL;
+	}
+
+	for (i = 0 ; i < header->root_count ; ++i) {
+		if (REF_INDEX(root_refs[i]) >= header->node_count) {
+			g_set_error_literal (perr, rv_error_domain(), 0,
+					"Invalid BDD root in shared memory.");
+			munmap (mem, st.st_size);
+			return NULL;
+		}
+	}
+
+	/* The table is in topological order. Thus, the children of each node
+	 * were already built when we reach it. Every node is referenced until
+	 * the roots are complete, because garbage collection can take place in
+	 * every call to Cudd_bddIte. */
+	built = g_new (DdNode*, header->node_count);
+	built[0] = Cudd_ReadOne (manager);
+
+	for (i = 1 ; i < header->node_count ; ++i) {
+		BddTransferNode * e = &nodes[i];
+		DdNode * node;
+
+		if (REF_INDEX(e->then_ref) >= i || REF_INDEX(e->else_ref) >= i) {
+			g_set_error_literal (perr, rv_error_domain(), 0,
+					"BDD node table is not in topological order.");
+			break;
+		}
+
+		node = Cudd_bddIte (manager, Cudd_bddIthVar (manager, e->index),
+				_bdd_transfer_deref (built, e->then_ref),
+				_bdd_transfer_deref (built, e->else_ref));
+		if ( !node) {
+			g_set_error_literal (perr, rv_error_domain(), 0,
+					"Out of memory while rebuilding the BDD.");
+			break;
+		}
+
+		Cudd_Ref (node);
+		built[i] = node;
+	}
+
+	if (i == header->node_count) {
+		guint32 j;
+
+		roots = g_new (DdNode*, MAX(1, header->root_count));
+		for (j = 0 ; j < header->root_count ; ++j) {
+			roots[j] = _bdd_transfer_deref (built, root_refs[j]);
+			Cudd_Ref (roots[j]);
+		}
+		if (proot_count) *proot_count = header->root_count;
+	}
+
+	/* Release the intermediate references. Only those on nodes which are
+	 * part of a result will survive. */
+	while (--i > 0)
+		Cudd_RecursiveDeref (manager, built[i]);
+
+	g_free (built);
+	munmap (mem, st.st_size);
+	return roots;
+}
+
+
+DdNode * bdd_transfer_load (DdManager * manager, const gchar * shm_name,
+		GError ** perr)
+{
+	guint root_count = 0, i;
+	DdNode ** roots = bdd_transfer_load_many (manager, shm_name, &root_count, perr);
+	DdNode * root = NULL;
+
+	if ( !roots) return NULL;
+
+	if (root_count != 1)
+		g_set_error (perr, rv_error_domain(), 0,
+				"Expected a single BDD in shared memory, but got %u.", root_count);
+	else root = roots[0];
+
+	if ( !root)
+		for (i = 0 ; i < root_count ; ++i)
+			Cudd_RecursiveDeref (manager, roots[i]);
+
+	g_free (roots);
+	return root;
+}
+
+
+void bdd_transfer_unlink (const gchar * shm_name)
+{
+	if (shm_unlink (shm_name) != 0 && ENOENT != errno)
+		g_warning ("bdd_transfer_unlink: Unable to remove \"%s\". Reason: %s",
+				shm_name, g_strerror(errno));
+}
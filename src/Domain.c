@@ -121,6 +121,9 @@ DomManager * dom_manager_get_instance ()
 	return rv_get_dom_manager (rv_get_instance());
 }
 
+static void _dom_manager_entry_changed (DomManager * self, const gchar * name)
+{ DOM_MANAGER_OBSERVER_NOTIFY(self,entryChanged,_1(name)); }
+
 /*!
  * This is the GDestroyFunc for the manager's hash table. See
  * \ref dom_manager_new_with_namespace. Must not be called if
@@ -131,6 +134,7 @@ static void _dom_manager_destroy_dom (Dom * obj)
 	DomManager * self = dom_get_manager(obj);
 	namespace_remove_by_name(dom_manager_get_namespace(self), dom_get_name(obj));
 	obj->manager = NULL;
+	_dom_manager_entry_changed (self, dom_get_name(obj));
 	dom_destroy (obj);
 }
 
@@ -186,6 +190,7 @@ gboolean dom_manager_insert (DomManager * self, Dom * d)
 	else if (namespace_insert(self->ns, (gpointer)d, &_dom_named_profile)) {
 		g_hash_table_insert (self->doms, g_strdup(dom_get_name(d)), d);
 		d->manager = self;
+		_dom_manager_entry_changed (self, dom_get_name(d));
 		dom_manager_changed (self);
 		return TRUE;
 	}
@@ -213,6 +218,7 @@ void dom_manager_steal (DomManager * self, Dom * d)
 	else if (g_hash_table_steal (self->doms, dom_get_name(d))) {
 		namespace_remove_by_name(self->ns, dom_get_name(d));
 		d->manager = NULL;
+		_dom_manager_entry_changed (self, dom_get_name(d));
 		dom_manager_changed (self);
 	}
 }
@@ -381,13 +387,19 @@ Dom * dom_new (const gchar * name, DomainType type,
 
 Dom * dom_move (Dom * self, Dom * src)
 {
-	DomManager * manager = src->manager;
+	/* The object stays in its manager (if any). Only the contents change. */
+	DomManager * manager = self->manager;
 	self->manager = NULL;
 	_dom_dtor (self);
 	*self = *src;
 	self->manager = manager;
 
 	g_free (src);
+
+	if (manager) {
+		_dom_manager_entry_changed (manager, self->name);
+		dom_manager_changed (manager);
+	}
 	return self;
 }
 
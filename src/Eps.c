@@ -23,6 +23,7 @@
 #include "Relation.h"
 #include "Graph.h"
 #include "Kure.h"
+#include "RelationBdd.h"
 #include "label.h"
 #include "RelationWindow.h"
 
@@ -147,12 +148,16 @@ static gboolean _write_eps_to_file (const gchar * filename, KureRel * impl,
 	{
 	  gint i, j;
 	  GString * text = g_string_new ("");
+	  guint8 * bits = g_malloc (REL_BDD_BLOCK_SIZE(cols, rows));
 
-		/* Draw the bits set */
+		/* Draw the bits set. The entries are extracted all at once. The
+		 * caller has checked the size. Otherwise, no bits are drawn. */
+		if ( !rel_bdd_get_block (impl, 0, 0, rows, cols, bits))
+		  g_warning ("%s: The relation is too big.", G_STRFUNC);
 		cairo_set_source_rgb(cr, gray, gray, gray);
 		for (j = 0; j < cols; j ++) {
 		  for (i = 0; i < rows; i ++) {
-			if (kure_get_bit_si(impl, i,j,NULL)) {
+			if (REL_BDD_BLOCK_GET(bits, (gsize)i*cols + j)) {
 			  double x = xoff + j*(delta+line_width) + line_width/2.0,
 					  y = yoff + i*(delta+line_width) +line_width/2.0;
 
@@ -161,6 +166,7 @@ static gboolean _write_eps_to_file (const gchar * filename, KureRel * impl,
 		  }
 		}
 		cairo_fill(cr);
+		g_free (bits);
 
 		/* Draw the complete grid at once. */
 		cairo_set_source_rgb(cr, 0, 0, 0);
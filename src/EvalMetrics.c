@@ -0,0 +1,185 @@
+/*
+ * EvalMetrics.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "EvalMetrics.h"
+#include "Relview.h" /* rv_error_domain */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Number of attempts to get a consistent copy of the record. */
+#define EVAL_METRICS_PEEK_TRIES 10
+
+static void _eval_metrics_read (DdManager * manager, EvalMetrics * m)
+{
+	m->live_nodes = Cudd_ReadKeys (manager) - Cudd_ReadDead (manager);
+	/* The peak since the manager was created. CUDD records it before each
+	 * garbage collection, so it isn't limited to our samples. */
+	m->peak_nodes = (gulong) Cudd_ReadPeakLiveNodeCount (manager);
+	m->gcs = (guint) Cudd_ReadGarbageCollections (manager);
+	m->reorderings = (guint) Cudd_ReadReorderings (manager);
+	m->cache_hits = Cudd_ReadCacheHits (manager);
+	m->cache_lookups = Cudd_ReadCacheLookUps (manager);
+	m->memory = Cudd_ReadMemoryInUse (manager);
+}
+
+
+void eval_metrics_probe_start (EvalMetricsProbe * self, DdManager * manager)
+{
+	self->manager = manager;
+	_eval_metrics_read (manager, &self->base);
+	self->cur = self->base;
+	self->cur.peak_nodes = self->base.live_nodes;
+	self->cur.gcs = self->cur.reorderings = 0;
+	self->cur.cache_hits = self->cur.cache_lookups = 0.0;
+}
+
+
+const EvalMetrics * eval_metrics_probe_sample (EvalMetricsProbe * self)
+{
+	EvalMetrics now;
+
+	_eval_metrics_read (self->manager, &now);
+
+	/* CUDD's peak can't be reset. If it has grown since the start, it was
+	 * reached during the evaluation. Otherwise, the samples have to do. */
+	self->cur.live_nodes = now.live_nodes;
+	if (now.peak_nodes > self->base.peak_nodes)
+		self->cur.peak_nodes = now.peak_nodes;
+	else self->cur.peak_nodes = MAX(self->cur.peak_nodes, now.live_nodes);
+	self->cur.gcs = now.gcs - self->base.gcs;
+	self->cur.reorderings = now.reorderings - self->base.reorderings;
+	self->cur.cache_hits = now.cache_hits - self->base.cache_hits;
+	self->cur.cache_lookups = now.cache_lookups - self->base.cache_lookups;
+	self->cur.memory = now.memory;
+	return &self->cur;
+}
+
+
+gchar * eval_metrics_format (const EvalMetrics * m)
+{
+	gdouble hit_rate = (m->cache_lookups > 0.0)
+		? 100.0 * m->cache_hits / m->cache_lookups : 0.0;
+
+	return g_strdup_printf ("NODES: %lu (peak %lu); GC: %u; REORDER: %u; "
+			"CACHE: %.1f%% of %.0f; MEM: %.1f MB", m->live_nodes, m->peak_nodes,
+			m->gcs, m->reorderings, hit_rate, m->cache_lookups,
+			m->memory / (1024.0 * 1024.0));
+}
+
+
+/* The record is protected by a sequence counter. It is odd while the
+ * writer is busy. A reader retries if the counter has changed during the
+ * copy. */
+typedef struct _EvalMetricsRecord
+{
+	volatile gint seq;
+	gint valid;
+	EvalMetrics m;
+} EvalMetricsRecord;
+
+struct _EvalMetricsChannel
+{
+	EvalMetricsRecord * rec;
+};
+
+
+EvalMetricsChannel * eval_metrics_channel_open (const gchar * shm_name,
+		GError ** perr)
+{
+	EvalMetricsChannel * self;
+	void * mem;
+	int fd;
+
+	fd = shm_open (shm_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		g_set_error (perr, rv_error_domain(), 0, "shm_open: %s", g_strerror(errno));
+		return NULL;
+	}
+
+	/* The object is zero-filled when it's created. Otherwise, its size
+	 * doesn't change and neither does its contents. */
+	if (ftruncate (fd, sizeof (EvalMetricsRecord)) != 0) {
+		g_set_error (perr, rv_error_domain(), 0, "ftruncate: %s", g_strerror(errno));
+		close (fd);
+		return NULL;
+	}
+
+	mem = mmap (NULL, sizeof (EvalMetricsRecord), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close (fd);
+	if (MAP_FAILED == mem) {
+		g_set_error (perr, rv_error_domain(), 0, "mmap: %s", g_strerror(errno));
+		return NULL;
+	}
+
+	self = g_new0 (EvalMetricsChannel, 1);
+	self->rec = (EvalMetricsRecord*) mem;
+	return self;
+}
+
+
+void eval_metrics_channel_close (EvalMetricsChannel * self)
+{
+	munmap (self->rec, sizeof (EvalMetricsRecord));
+	g_free (self);
+}
+
+
+static void _eval_metrics_channel_write (EvalMetricsChannel * self,
+		const EvalMetrics * m, gboolean valid)
+{
+	gint seq = g_atomic_int_get (&self->rec->seq);
+
+	g_atomic_int_set (&self->rec->seq, seq + 1);
+	if (m) self->rec->m = *m;
+	self->rec->valid = valid;
+	g_atomic_int_set (&self->rec->seq, seq + 2);
+}
+
+void eval_metrics_channel_publish (EvalMetricsChannel * self,
+		const EvalMetrics * m)
+{ _eval_metrics_channel_write (self, m, TRUE); }
+
+void eval_metrics_channel_clear (EvalMetricsChannel * self)
+{ _eval_metrics_channel_write (self, NULL, FALSE); }
+
+
+gboolean eval_metrics_channel_peek (EvalMetricsChannel * self,
+		EvalMetrics * m)
+{
+	int i;
+
+	for (i = 0 ; i < EVAL_METRICS_PEEK_TRIES ; ++i) {
+		gint seq = g_atomic_int_get (&self->rec->seq);
+		gboolean valid;
+
+		if (seq & 1) continue; /* writer busy */
+
+		*m = self->rec->m;
+		valid = self->rec->valid;
+
+		if (g_atomic_int_get (&self->rec->seq) == seq)
+			return valid;
+	}
+	return FALSE;
+}
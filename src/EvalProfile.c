@@ -0,0 +1,336 @@
+/*
+ * EvalProfile.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "EvalProfile.h"
+#include "Kure.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <lua.h>
+
+/* Kure's functions are in nested tables, e.g. kure.compat. */
+#define EVAL_PROFILE_MAX_DEPTH 2
+
+struct _EvalProfile
+{
+	GHashTable/*<gchar*,EvalProfileEntry*>*/ * entries;
+	GTimer * timer;
+	gdouble child_secs; /*!< Time spent in nested calls of the current call. */
+};
+
+
+static void _eval_profile_entry_destroy (EvalProfileEntry * entry)
+{
+	g_free (entry->name);
+	g_free (entry);
+}
+
+EvalProfile * eval_profile_new ()
+{
+	EvalProfile * self = g_new0 (EvalProfile, 1);
+	self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify) _eval_profile_entry_destroy);
+	self->timer = g_timer_new ();
+	return self;
+}
+
+void eval_profile_destroy (EvalProfile * self)
+{
+	g_hash_table_destroy (self->entries);
+	g_timer_destroy (self->timer);
+	g_free (self);
+}
+
+
+static EvalProfileEntry * _eval_profile_get_entry (EvalProfile * self,
+		const gchar * name)
+{
+	EvalProfileEntry * entry = g_hash_table_lookup (self->entries, name);
+	if ( !entry) {
+		entry = g_new0 (EvalProfileEntry, 1);
+		entry->name = g_strdup (name);
+		g_hash_table_insert (self->entries, entry->name, entry);
+	}
+	return entry;
+}
+
+
+/*! Returns the number of BDD nodes of the relation at the given stack index,
+ * or 0 if it's not a relation. */
+static gulong _rel_nodes (lua_State * L, int index)
+{
+	if ( !kure_lua_isrel (L, index)) return 0;
+	else return (gulong) Cudd_DagSize (kure_rel_get_bdd (
+			kure_lua_torel (L, index, NULL)));
+}
+
+
+/*! Replaces a wrapped function. The upvalues are the profile, the entry
+ * and the original function. */
+static int _eval_profile_call (lua_State * L)
+{
+	EvalProfile * self = (EvalProfile*) lua_touserdata (L, lua_upvalueindex(1));
+	EvalProfileEntry * entry = (EvalProfileEntry*) lua_touserdata (L, lua_upvalueindex(2));
+	gdouble outer_child_secs = self->child_secs, start, elapsed;
+	gulong operand_nodes = 0;
+	int i, n = lua_gettop (L), nresults;
+
+	for (i = 1 ; i <= n ; ++i)
+		operand_nodes += _rel_nodes (L, i);
+
+	lua_pushvalue (L, lua_upvalueindex(3));
+	lua_insert (L, 1);
+
+	self->child_secs = 0.0;
+	start = g_timer_elapsed (self->timer, NULL);
+	lua_call (L, n, LUA_MULTRET); /* errors are passed through */
+	elapsed = g_timer_elapsed (self->timer, NULL) - start;
+	nresults = lua_gettop (L);
+
+	entry->calls ++;
+	entry->secs += elapsed;
+	entry->self_secs += elapsed - self->child_secs;
+	entry->operand_nodes += operand_nodes;
+	if (nresults > 0) {
+		gulong result_nodes = _rel_nodes (L, 1);
+		entry->result_nodes += result_nodes;
+		entry->max_result_nodes = MAX(entry->max_result_nodes, result_nodes);
+	}
+
+	self->child_secs = outer_child_secs + elapsed;
+	return nresults;
+}
+
+
+/*! Wraps the function at the top of the stack, whose key is below, and
+ * remembers the original in the list at list_index. The table is at
+ * table_index. */
+static void _eval_profile_wrap (EvalProfile * self, lua_State * L,
+		int table_index, int list_index, const gchar * name)
+{
+	int key = lua_gettop (L) - 1, value = lua_gettop (L);
+
+	/* list[#list+1] = { table, key, original } */
+	lua_createtable (L, 3, 0);
+	lua_pushvalue (L, table_index);
+	lua_rawseti (L, -2, 1);
+	lua_pushvalue (L, key);
+	lua_rawseti (L, -2, 2);
+	lua_pushvalue (L, value);
+	lua_rawseti (L, -2, 3);
+	lua_rawseti (L, list_index, lua_objlen (L, list_index) + 1);
+
+	/* table[key] = wrapper. Changing existing fields is allowed during
+	 * the traversal. */
+	lua_pushvalue (L, key);
+	lua_pushlightuserdata (L, self);
+	lua_pushlightuserdata (L, _eval_profile_get_entry (self, name));
+	lua_pushvalue (L, value);
+	lua_pushcclosure (L, _eval_profile_call, 3);
+	lua_rawset (L, table_index);
+}
+
+
+/*! Wraps the functions in the table at the given index. In the global
+ * table (prefix is NULL), only the user-defined functions are wrapped and
+ * the library table "kure". Everything in the library is wrapped. */
+static void _eval_profile_wrap_table (EvalProfile * self, lua_State * L,
+		int table_index, int list_index, const gchar * prefix, int depth)
+{
+	lua_pushnil (L);
+	while (lua_next (L, table_index)) {
+		if (LUA_TSTRING == lua_type (L, -2)) {
+			const gchar * key = lua_tostring (L, -2);
+			gchar * name = prefix ? g_strdup_printf ("%s.%s", prefix, key)
+					: g_strdup (key);
+
+			if (lua_isfunction (L, -1)) {
+				if (lua_tocfunction (L, -1) == _eval_profile_call)
+					; /* already wrapped */
+				else if (prefix || !lua_iscfunction (L, -1))
+					_eval_profile_wrap (self, L, table_index, list_index, name);
+			}
+			else if (lua_istable (L, -1) && depth < EVAL_PROFILE_MAX_DEPTH
+					&& (prefix || g_str_equal (key, "kure"))) {
+				_eval_profile_wrap_table (self, L, lua_gettop (L), list_index,
+						name, depth + 1);
+			}
+			g_free (name);
+		}
+		lua_pop (L, 1);
+	}
+}
+
+
+void eval_profile_attach (EvalProfile * self, lua_State * L)
+{
+	int list_index;
+
+	lua_pushvalue (L, LUA_GLOBALSINDEX);
+	lua_newtable (L);
+	list_index = lua_gettop (L);
+
+	self->child_secs = 0.0;
+	_eval_profile_wrap_table (self, L, list_index - 1, list_index, NULL, 0);
+
+	/* registry[self] = list */
+	lua_pushlightuserdata (L, self);
+	lua_pushvalue (L, list_index);
+	lua_rawset (L, LUA_REGISTRYINDEX);
+
+	lua_pop (L, 2);
+}
+
+
+void eval_profile_detach (EvalProfile * self, lua_State * L)
+{
+	int i, n;
+
+	lua_pushlightuserdata (L, self);
+	lua_rawget (L, LUA_REGISTRYINDEX);
+	if ( !lua_istable (L, -1)) {
+		lua_pop (L, 1);
+		return;
+	}
+
+	n = lua_objlen (L, -1);
+	for (i = 1 ; i <= n ; ++i) {
+		lua_rawgeti (L, -1, i);
+		lua_rawgeti (L, -1, 1); /* table */
+		lua_rawgeti (L, -2, 2); /* key */
+
+		/* Keep the function, if someone has replaced the wrapper. */
+		lua_pushvalue (L, -1);
+		lua_rawget (L, -3);
+		if (lua_tocfunction (L, -1) == _eval_profile_call) {
+			lua_pop (L, 1);
+			lua_rawgeti (L, -3, 3); /* original */
+			lua_rawset (L, -3);
+		}
+		else lua_pop (L, 2);
+		lua_pop (L, 2);
+	}
+	lua_pop (L, 1);
+
+	lua_pushlightuserdata (L, self);
+	lua_pushnil (L);
+	lua_rawset (L, LUA_REGISTRYINDEX);
+}
+
+
+static gint _compare_self_secs (gconstpointer a, gconstpointer b)
+{
+	gdouble x = ((EvalProfileEntry*) a)->self_secs,
+			y = ((EvalProfileEntry*) b)->self_secs;
+	return (x < y) ? 1 : (x > y) ? -1 : 0;
+}
+
+GList * eval_profile_get_entries (EvalProfile * self)
+{
+	GList * ret = NULL;
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, self->entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		if (((EvalProfileEntry*) value)->calls > 0)
+			ret = g_list_prepend (ret, value);
+	}
+	return g_list_sort (ret, _compare_self_secs);
+}
+
+
+/* One line per entry. The name comes last, because it's the only field
+ * which may contain spaces. */
+#define EVAL_PROFILE_LINE_FORMAT "%lu %lg %lg %lg %lg %lu %n"
+
+gchar * eval_profile_serialize (EvalProfile * self)
+{
+	GString * s = g_string_new ("");
+	GList * entries = eval_profile_get_entries (self), *iter;
+
+	for (iter = entries ; iter ; iter = iter->next) {
+		EvalProfileEntry * e = (EvalProfileEntry*) iter->data;
+		g_string_append_printf (s, "%lu %.9g %.9g %.9g %.9g %lu %s\n", e->calls,
+				e->secs, e->self_secs, e->operand_nodes, e->result_nodes,
+				e->max_result_nodes, e->name);
+	}
+	g_list_free (entries);
+	return g_string_free (s, FALSE);
+}
+
+EvalProfile * eval_profile_deserialize (const gchar * str)
+{
+	EvalProfile * self = eval_profile_new ();
+	gchar ** lines = g_strsplit (str, "\n", -1), **line;
+
+	for (line = lines ; *line ; ++line) {
+		EvalProfileEntry tmp = {0}, *entry;
+		int name_pos = -1;
+
+		if ('\0' == **line) continue;
+
+		if (6 != sscanf (*line, EVAL_PROFILE_LINE_FORMAT, &tmp.calls, &tmp.secs,
+				&tmp.self_secs, &tmp.operand_nodes, &tmp.result_nodes,
+				&tmp.max_result_nodes, &name_pos) || name_pos < 0) {
+			g_strfreev (lines);
+			eval_profile_destroy (self);
+			return NULL;
+		}
+
+		entry = _eval_profile_get_entry (self, *line + name_pos);
+		tmp.name = entry->name;
+		*entry = tmp;
+	}
+
+	g_strfreev (lines);
+	return self;
+}
+
+
+gchar * eval_profile_format (EvalProfile * self, guint max_rows)
+{
+	GString * s = g_string_new ("");
+	GList * entries = eval_profile_get_entries (self), *iter;
+	gdouble total = 0.0;
+	guint rows = 0;
+
+	for (iter = entries ; iter ; iter = iter->next)
+		total += ((EvalProfileEntry*) iter->data)->self_secs;
+
+	g_string_append_printf (s, "%10s %6s %10s %9s %12s %12s %12s  %s\n",
+			"SELF-SEC", "%", "TOTAL-SEC", "CALLS", "AVG-OPERAND",
+			"AVG-RESULT", "MAX-RESULT", "OPERATION");
+
+	for (iter = entries ; iter && (0 == max_rows || rows < max_rows)
+			; iter = iter->next, ++rows) {
+		EvalProfileEntry * e = (EvalProfileEntry*) iter->data;
+
+		g_string_append_printf (s, "%10.4f %5.1f%% %10.4f %9lu %12.0f %12.0f %12lu  %s\n",
+				e->self_secs, (total > 0.0) ? 100.0 * e->self_secs / total : 0.0,
+				e->secs, e->calls, e->operand_nodes / e->calls,
+				e->result_nodes / e->calls, e->max_result_nodes, e->name);
+	}
+
+	if (iter)
+		g_string_append_printf (s, "(%u more operations)\n",
+				g_list_length (iter));
+
+	g_list_free (entries);
+	return g_string_free (s, FALSE);
+}
@@ -53,6 +53,8 @@ struct _Function
 
 	gchar * luacode; /*!< The (maybe pre-compiled) Lua code. This is always a
 	                  * function of the same name. */
+	gchar * luabin; /*!< luacode as Lua bytecode. Created on demand. */
+	size_t luabin_size;
 
 	gboolean is_hidden;
 };
@@ -115,6 +117,9 @@ FunManager * fun_manager_get_instance ()
 	return rv_get_fun_manager(rv_get_instance());
 }
 
+static void _fun_manager_entry_changed (FunManager * self, const gchar * name)
+{ FUN_MANAGER_OBSERVER_NOTIFY(self,entryChanged,_1(name)); }
+
 /*!
  * This is the GDestroyFunc for the manager's hash table. See
  * \ref dom_manager_new_with_namespace. Must not be called if
@@ -125,6 +130,7 @@ static void _fun_manager_destroy_fun (Fun * obj)
 	FunManager * self = fun_get_manager(obj);
 	namespace_remove_by_name(fun_manager_get_namespace(self), fun_get_name(obj));
 	obj->manager = NULL;
+	_fun_manager_entry_changed (self, fun_get_name(obj));
 	fun_destroy (obj);
 }
 
@@ -177,6 +183,7 @@ gboolean fun_manager_insert (FunManager * self, Fun * d)
 	else if (namespace_insert(self->ns, (gpointer)d, &_fun_named_profile)) {
 		g_hash_table_insert (self->objs, g_strdup(fun_get_name(d)), d);
 		d->manager = self;
+		_fun_manager_entry_changed (self, fun_get_name(d));
 		fun_manager_changed (self);
 		return TRUE;
 	}
@@ -203,6 +210,7 @@ void fun_manager_steal (FunManager * self, Fun * d)
 	else if (g_hash_table_steal (self->objs, fun_get_name(d))) {
 		namespace_remove_by_name(self->ns, fun_get_name(d));
 		d->manager = NULL;
+		_fun_manager_entry_changed (self, fun_get_name(d));
 		fun_manager_changed (self);
 	}
 }
@@ -420,6 +428,7 @@ void _fun_dtor (Fun * self)
 	g_free (self->name);
 	g_free (self->expr);
 	g_free (self->luacode);
+	g_free (self->luabin);
 }
 
 void fun_destroy (Fun * self)
@@ -443,4 +452,26 @@ const gchar * fun_get_luacode (const Fun * self, size_t * psize)
 	return self->luacode;
 }
 
+void fun_set_luabin (Fun * self, const gchar * bin, size_t size)
+{
+	g_free (self->luabin);
+	self->luabin = g_memdup (bin, size);
+	self->luabin_size = size;
+}
+
+const gchar * fun_get_luabin (Fun * self, size_t * psize)
+{
+	if ( !self->luabin)
+		self->luabin = rv_lang_compile (self->luacode, strlen (self->luacode),
+				&self->luabin_size);
+
+	/* The Lua code can be loaded as well. */
+	if ( !self->luabin)
+		return fun_get_luacode (self, psize);
+	else {
+		if (psize) *psize = self->luabin_size;
+		return self->luabin;
+	}
+}
+
 
@@ -21,6 +21,7 @@
 #include <gtk/gtk.h>
 #include "Relation.h"
 #include "RelationProxyAdapter.h"
+#include "RelationBdd.h"
 #include "graph.h"
 #include "Observer.h"
 #include "prefs.h" // for rel_allow_display
@@ -961,6 +962,48 @@ void xgraph_reset_layout (XGraph * self)
 	xgraph_layout_changed(self);
 }
 
+/* Nodes by their 0-indexed number and the marking to apply. See
+ * xgraph_mark_edges_by_impl and xgraph_mark_nodes_by_impl. */
+typedef struct _XGraphMarkByImpl
+{
+	XGraph * self;
+	GPtrArray/*<XGraphNode*>*/ * nodes;
+	void (*mark_func) (gpointer,gboolean);
+} XGraphMarkByImpl;
+
+/* Returns the nodes indexed by their 0-indexed number. Unused numbers are
+ * NULL. */
+static GPtrArray * _xgraph_nodes_by_number (XGraph * self)
+{
+	GPtrArray * nodes = g_ptr_array_new ();
+
+	XGRAPH_FOREACH_NODE(self, node, iter, {
+		int i = atoi(xgraph_node_get_name(node)) - 1;
+		if (i >= 0) {
+			if ((guint) i >= nodes->len) g_ptr_array_set_size (nodes, i + 1);
+			g_ptr_array_index (nodes, i) = node;
+		}
+	});
+	return nodes;
+}
+
+static void _xgraph_mark_edge (int i, int j, XGraphMarkByImpl * d)
+{
+	XGraphNode *from = g_ptr_array_index (d->nodes, i);
+	XGraphNode *to   = g_ptr_array_index (d->nodes, j);
+
+	if (from && to) {
+		XGraphEdge * edge = xgraph_get_edge (d->self, from, to);
+		if (edge) d->mark_func (xgraph_edge_get_layout(edge), TRUE);
+	}
+}
+
+static void _xgraph_mark_node (int i, int j, XGraphMarkByImpl * d)
+{
+	XGraphNode * node = g_ptr_array_index (d->nodes, i);
+	if (node) d->mark_func (xgraph_node_get_layout(node), TRUE);
+}
+
 /**
  * Mark the given edges from a relation.
  */
@@ -971,6 +1014,7 @@ void xgraph_mark_edges_by_impl (XGraph * self, const KureRel * impl, gint level)
 	else {
 		int n = xgraph_get_node_count(self);
 		int rows, cols;
+		gboolean fits = kure_rel_fits_si(impl);
 		void (*mark_func) (gpointer,gboolean)
 				= ((level == 1) ? xgraph_edge_layout_set_marked_first
 				: xgraph_edge_layout_set_marked_second);
@@ -994,10 +1038,23 @@ void xgraph_mark_edges_by_impl (XGraph * self, const KureRel * impl, gint level)
 			int i = atoi(xgraph_node_get_name(from)) - 1;
 			int j = atoi(xgraph_node_get_name(to)) - 1;
 
+			/* Huge relations are probed for each edge. */
 			if (i < rows && j < cols)
-				mark_func (xgraph_edge_get_layout(edge), kure_get_bit_si(impl,i,j,NULL));
+				mark_func (xgraph_edge_get_layout(edge),
+						fits ? FALSE : kure_get_bit_si(impl,i,j,NULL));
 		});
 
+		/* Mark the edges of the relation's entries. Only the entries are
+		 * visited instead of probing each edge. */
+		if (fits) {
+			XGraphMarkByImpl d = { self, _xgraph_nodes_by_number (self), mark_func };
+			int len = (int) d.nodes->len;
+
+			rel_bdd_foreach_entry (impl, 0, 0, MIN(rows, len), MIN(cols, len),
+					(RelBddEntryFunc) _xgraph_mark_edge, &d);
+			g_ptr_array_free (d.nodes, TRUE);
+		}
+
 		xgraph_unblock_notify(self);
 		xgraph_layout_changed(self);
 	}
@@ -1027,6 +1084,7 @@ void xgraph_mark_nodes_by_impl (XGraph * self, const KureRel * impl, gint level)
 	else {
 		int n = xgraph_get_node_count(self);
 		int rows;
+		gboolean fits = kure_rel_fits_si(impl);
 		void (*mark_func) (XGraphNodeLayout*,gboolean)
 				= ((level == 1) ? xgraph_node_layout_set_marked_first
 				: xgraph_node_layout_set_marked_second);
@@ -1044,9 +1102,20 @@ void xgraph_mark_nodes_by_impl (XGraph * self, const KureRel * impl, gint level)
 			int i = atoi(xgraph_node_get_name(node)) - 1;
 
 			if (i < rows)
-				mark_func (xgraph_node_get_layout(node), kure_get_bit_si(impl,i,0,NULL));
+				mark_func (xgraph_node_get_layout(node),
+						fits ? FALSE : kure_get_bit_si(impl,i,0,NULL));
 		});
 
+		/* Mark the nodes of the entries in the first column. */
+		if (fits) {
+			XGraphMarkByImpl d = { self, _xgraph_nodes_by_number (self),
+					(void (*) (gpointer,gboolean)) mark_func };
+
+			rel_bdd_foreach_entry (impl, 0, 0, MIN(rows, (int) d.nodes->len), 1,
+					(RelBddEntryFunc) _xgraph_mark_node, &d);
+			g_ptr_array_free (d.nodes, TRUE);
+		}
+
 		xgraph_unblock_notify(self);
 		xgraph_layout_changed(self);
 	}
@@ -22,6 +22,7 @@
 #include "GraphImpl.h"
 #include "Relation.h"
 #include "RelationProxyAdapter.h"
+#include "RelationBdd.h"
 #include <math.h>
 
 /*!
@@ -205,6 +206,34 @@ void xgraph_flip_display_vert (XGraph * self)
 	xgraph_layout_changed (self);
 }
 
+typedef struct _XGraphUpdateFromRel
+{
+	XGraph * self, * copy;
+	GHashTable/*<XGraphNode*,XGraphNode*>*/ * map;
+	XGraphNode ** nodes;
+} XGraphUpdateFromRel;
+
+/* Creates the edge i->j and takes its layout from the old graph. See
+ * xgraph_update_from_rel. */
+static void _xgraph_update_from_rel_edge (int i, int j, XGraphUpdateFromRel * d)
+{
+	XGraphNode * fromRho = g_hash_table_lookup (d->map, d->nodes[i]);
+	XGraphNode * toRho = g_hash_table_lookup (d->map, d->nodes[j]);
+	XGraphEdge * edge;
+
+	if (! fromRho) return;
+
+	edge = xgraph_create_edge(d->self,d->nodes[i],d->nodes[j]);
+	g_warn_if_fail(edge != NULL);
+	if (toRho && edge) {
+		XGraphEdge * edgeRho = xgraph_get_edge (d->copy, fromRho, toRho);
+		if (edgeRho) {
+			/* Nodes must have same positions in both graphs. */
+			xgraph_edge_apply_layout (edge, xgraph_edge_get_layout(edgeRho));
+		}
+	}
+}
+
 /*!
  * Update the given graph with respect to the given relation. I.e. add/remove
  * new or unnecessary nodes and add/remove new and/or unnecessary edges. The
@@ -223,14 +252,14 @@ void xgraph_update_from_rel (XGraph * self, Rel * rel)
 		return;
 	}
 	else {
-		RelationProxy * proxy = relation_proxy_adapter_new(rel);
 		XGraph * copy = xgraph_copy(self, "tmp");
 		GHashTable/*<XGraphNode*,XGraphNode*>*/ * map;
 		gint n = (gint) kure_rel_get_rows_si(impl);
 		XGraphNode ** nodes = g_new (XGraphNode*,n);
 		GraphLayoutService * layouter
 			= default_graph_layout_service_new(self, DEFAULT_GRAPH_RADIUS);
-		gint i,j;
+		gint i;
+		XGraphUpdateFromRel data;
 
 		xgraph_block_notify(copy);
 		xgraph_block_notify(self);
@@ -256,36 +285,21 @@ void xgraph_update_from_rel (XGraph * self, Rel * rel)
 				xgraph_node_apply_layout (nodes[i], xgraph_node_get_layout (fromRho));
 		}
 
-		for (i = 0 ; i < n ; i ++) {
-			XGraphNode * fromRho = RHO(nodes[i]);
-			/* Layout the node */
-			if (! fromRho) continue;
-
-			for (j = 0 ; j < n ; j ++) {
-				XGraphNode * toRho = RHO(nodes[j]);
-
-				if (proxy->getBit (proxy,j,i)) {
-					XGraphEdge * edge = xgraph_create_edge(self,nodes[i],nodes[j]);
-					g_warn_if_fail(edge != NULL);
-					if (toRho && fromRho && edge) {
-						XGraphEdge * edgeRho = xgraph_get_edge (copy, fromRho, toRho);
-						if (edgeRho) {
-							/* Nodes must have same positions in both graphs. */
-							xgraph_edge_apply_layout (edge, xgraph_edge_get_layout(edgeRho));
-						}
-					}
-				}
-			}
-		}
-
 #undef RHO
 
+		/* Only the entries are visited, not all n^2 pairs. */
+		data.self = self;
+		data.copy = copy;
+		data.map = map;
+		data.nodes = nodes;
+		rel_bdd_foreach_entry (impl, 0, 0, n, n,
+				(RelBddEntryFunc) _xgraph_update_from_rel_edge, &data);
+
 		xgraph_unblock_notify(copy);
 		xgraph_unblock_notify(self);
 
 		g_hash_table_destroy (map);
 		layouter->destroy (layouter);
-		proxy->destroy (proxy);
 		xgraph_destroy(copy);
 
 		//xgraph_layout_changed (self);
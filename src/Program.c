@@ -49,6 +49,8 @@ struct _Prog
 	gint num_args;
 
 	gchar * luacode;
+	gchar * luabin; /*!< luacode as Lua bytecode. Created on demand. */
+	size_t luabin_size;
 
 	gboolean is_hidden;
 };
@@ -116,6 +118,9 @@ ProgManager * prog_manager_get_instance ()
 }
 
 
+static void _prog_manager_entry_changed (ProgManager * self, const gchar * name)
+{ PROG_MANAGER_OBSERVER_NOTIFY(self,entryChanged,_1(name)); }
+
 /*!
  * This is the GDestroyFunc for the manager's hash table. See
  * \ref prog_manager_new_with_namespace. Must not be called if
@@ -126,6 +131,7 @@ static void _prog_manager_destroy_prog (Prog * obj)
 	ProgManager * self = prog_get_manager(obj);
 	namespace_remove_by_name(prog_manager_get_namespace(self), prog_get_name(obj));
 	obj->manager = NULL;
+	_prog_manager_entry_changed (self, prog_get_name(obj));
 	prog_destroy (obj);
 }
 
@@ -172,6 +178,7 @@ gboolean prog_manager_insert (ProgManager * self, Prog * d)
 	else if (namespace_insert(self->ns, (gpointer)d, &_prog_named_profile)) {
 		g_hash_table_insert (self->objs, g_strdup(prog_get_name(d)), d);
 		d->manager = self;
+		_prog_manager_entry_changed (self, prog_get_name(d));
 		prog_manager_changed (self);
 		return TRUE;
 	}
@@ -197,6 +204,7 @@ void prog_manager_steal (ProgManager * self, Prog * d)
 	if (self != prog_get_manager(d)) return;
 	else if (g_hash_table_steal (self->objs, prog_get_name(d))) {
 		d->manager = NULL;
+		_prog_manager_entry_changed (self, prog_get_name(d));
 		prog_manager_changed (self);
 	}
 }
@@ -376,6 +384,7 @@ void _prog_dtor (Prog * self)
 	g_free (self->def);
 	g_free (self->sig);
 	g_free (self->luacode);
+	g_free (self->luabin);
 }
 
 void prog_destroy (Prog * self)
@@ -399,6 +408,27 @@ const gchar * prog_get_luacode (const Prog * self, size_t * psize)
 	return self->luacode;
 }
 
+void prog_set_luabin (Prog * self, const gchar * bin, size_t size)
+{
+	g_free (self->luabin);
+	self->luabin = g_memdup (bin, size);
+	self->luabin_size = size;
+}
+
+const gchar * prog_get_luabin (Prog * self, size_t * psize)
+{
+	if ( !self->luabin)
+		self->luabin = rv_lang_compile (self->luacode, strlen (self->luacode),
+				&self->luabin_size);
+
+	if ( !self->luabin)
+		return prog_get_luacode (self, psize);
+	else {
+		if (psize) *psize = self->luabin_size;
+		return self->luabin;
+	}
+}
+
 void prog_dump (const Prog * self)
 {
 	printf ("Program \"%s\":\n"
@@ -1,5 +1,6 @@
 #include "Relation.h"
 #include "RelationProxyAdapter.h"
+#include "RelationBdd.h"
 #include "Graph.h"
 #include "prefs.h" // for rel_allow_display
 
@@ -41,6 +42,19 @@ struct _Relation
 
     gboolean is_hidden;
 
+    /* The root in the fingerprint is referenced, so it can't be reused for
+     * a different BDD while the relation exists. See rel_get_fingerprint. */
+    RelFingerprint fp;
+
+    /* Number of BDD nodes of the contents with the serial nodes_serial. See
+     * rel_get_node_count. */
+    guint nodes;
+    guint64 nodes_serial;
+
+    /* Pending edits. See rel_edit_begin. */
+    gint edit_depth;
+    GHashTable/*<gint64*,yesno+1>*/ * edits;
+
     GSList/*<RelationObserver>*/ * observers;
 };
 
@@ -85,6 +99,9 @@ static NamedProfile _rel_named_profile = { (NamedProfile_getNameFunc)rel_get_nam
 #define REL_MANAGER_OBSERVER_NOTIFY(obj,func,...) \
         OBSERVER_NOTIFY(observers,GSList,RelManagerObserver,obj,func, __VA_ARGS__)
 
+static void _rel_manager_entry_changed (RelManager * self, const gchar * name)
+{ REL_MANAGER_OBSERVER_NOTIFY(self,entryChanged,_1(name)); }
+
 
 /*!
  * Not used as a callback for the observer. Instead, it is called directly by
@@ -123,6 +140,8 @@ static void _rel_manager_on_renamed (void * object, Rel * rel, const gchar * old
 
         namespace_name_changed(rel_manager_get_namespace(self), rel);
 
+        _rel_manager_entry_changed (self, old_name);
+        _rel_manager_entry_changed (self, new_name);
         rel_manager_changed(self);
     }
 }
@@ -157,6 +176,7 @@ static void _rel_manager_destroy_rel (Rel * rel)
     //rel_manager_steal(self, rel);
     namespace_remove_by_name(rel_manager_get_namespace(self), rel_get_name(rel));
     rel->manager = NULL;
+    _rel_manager_entry_changed (self, rel_get_name(rel));
     rel_destroy (rel);
 }
 
@@ -251,6 +271,7 @@ gboolean rel_manager_insert (RelManager * self, Rel * rel)
     else if (namespace_insert (self->ns, (gpointer)rel, &_rel_named_profile)) {
         g_hash_table_insert (self->objs, g_strdup(name), rel);
         rel->manager = self;
+        _rel_manager_entry_changed (self, name);
         rel_manager_changed (self);
 
         return TRUE;
@@ -279,6 +300,7 @@ void rel_manager_steal (RelManager * self, Rel * d)
     else if (g_hash_table_steal (self->objs, rel_get_name(d))) {
         namespace_remove_by_name(rel_manager_get_namespace(self), rel_get_name(d));
         d->manager = NULL;
+        _rel_manager_entry_changed (self, rel_get_name(d));
         rel_manager_changed (self);
     }
 }
@@ -410,6 +432,114 @@ void rel_iterator_destroy (RelIterator * self) { g_free (self); }
         OBSERVER_NOTIFY(observers,GSList,RelObserver,obj,func, __VA_ARGS__)
 
 
+/******************************************************************************
+ *                                Fingerprints                                *
+ ******************************************************************************/
+
+/* Source of the serials. Zero means "no fingerprint yet". */
+static guint64 _rel_fingerprint_serial = 0;
+
+/* Returns the number itself if it has at most 63 bits. Larger numbers are
+ * hashed and have the highest bit set. */
+static guint64 _rel_fingerprint_dim (mpz_t n)
+{
+    size_t bits = mpz_sizeinbase (n, 2);
+
+    if (bits <= 63) {
+        guint64 v = 0;
+        mpz_export (&v, NULL, -1, sizeof(v), 0, 0, n);
+        return v;
+    }
+    else return (G_GUINT64_CONSTANT(1) << 63) | ((guint64) bits << 32)
+            | (mpz_get_ui (n) & 0xffffffff);
+}
+
+void rel_impl_get_fingerprint (const KureRel * impl, RelFingerprint * fp)
+{
+    mpz_t n;
+
+    fp->root = kure_rel_get_bdd (impl);
+    mpz_init (n);
+    kure_rel_get_rows (impl, n);
+    fp->rows = _rel_fingerprint_dim (n);
+    kure_rel_get_cols (impl, n);
+    fp->cols = _rel_fingerprint_dim (n);
+    mpz_clear (n);
+    fp->serial = 0;
+}
+
+/* Updates the fingerprint if the contents have changed. */
+static void _rel_update_fingerprint (Rel * self)
+{
+    RelFingerprint cur;
+
+    rel_impl_get_fingerprint (self->impl, &cur);
+    if (self->fp.serial != 0 && rel_fingerprint_same_contents (&cur, &self->fp))
+        return;
+    else {
+        DdManager * manager = kure_context_get_manager (
+                kure_rel_get_context (self->impl));
+
+        Cudd_Ref (cur.root);
+        if (self->fp.root)
+            Cudd_RecursiveDeref (manager, self->fp.root);
+
+        cur.serial = ++ _rel_fingerprint_serial;
+        self->fp = cur;
+    }
+}
+
+void rel_get_fingerprint (Rel * self, RelFingerprint * fp)
+{
+    /* The implementation may have been changed in place without a call to
+     * rel_changed. */
+    _rel_update_fingerprint (self);
+    *fp = self->fp;
+}
+
+guint rel_get_node_count (Rel * self)
+{
+    _rel_update_fingerprint (self);
+    if (self->nodes_serial != self->fp.serial) {
+        self->nodes = (guint) Cudd_DagSize (self->fp.root);
+        self->nodes_serial = self->fp.serial;
+    }
+    return self->nodes;
+}
+
+gboolean rel_fingerprint_same_contents (const RelFingerprint * a,
+        const RelFingerprint * b)
+{
+    return a->root == b->root && a->rows == b->rows && a->cols == b->cols;
+}
+
+gboolean rel_fingerprint_equal (const RelFingerprint * a,
+        const RelFingerprint * b)
+{
+    return a->serial == b->serial && rel_fingerprint_same_contents (a, b);
+}
+
+guint rel_fingerprint_hash (const RelFingerprint * fp)
+{
+    guint64 h = (guint64) (gsize) fp->root;
+
+    h = h * 31 + fp->rows;
+    h = h * 31 + fp->cols;
+    h = h * 31 + fp->serial;
+    return (guint) (h ^ (h >> 32));
+}
+
+gboolean rel_equal (const Rel * a, const Rel * b)
+{
+    g_return_val_if_fail (kure_rel_get_context (a->impl)
+            == kure_rel_get_context (b->impl), FALSE);
+
+    /* BDDs are canonical in their manager. */
+    return kure_rel_get_bdd (a->impl) == kure_rel_get_bdd (b->impl)
+            && kure_rel_same_dim (a->impl, b->impl);
+}
+
+
 void _rel_dtor (Rel * self)
 {
     REL_OBSERVER_NOTIFY(self, onDelete);
@@ -418,6 +548,11 @@ void _rel_dtor (Rel * self)
         rel_manager_steal (self->manager, self);
 
     g_free (self->name);
+    if (self->edits)
+        g_hash_table_destroy (self->edits);
+    if (self->fp.root)
+        Cudd_RecursiveDeref (kure_context_get_manager (
+                kure_rel_get_context (self->impl)), self->fp.root);
     kure_rel_destroy(self->impl);
 
     g_slist_free (self->observers);
@@ -526,6 +661,7 @@ Rel * rel_new_from_impl (const gchar * name, KureRel * impl)
     self->name = g_strdup (name);
     self->impl = impl;
     self->is_hidden = FALSE;
+    _rel_update_fingerprint (self);
 
     return self;
 }
@@ -536,7 +672,104 @@ gboolean rel_has_name (const Rel * self, const gchar * name) {
     return g_str_equal(self->name, name);
 }
 
-void rel_changed (Rel * self) { REL_OBSERVER_NOTIFY(self,changed,_0()); }
+void rel_changed (Rel * self)
+{
+    _rel_update_fingerprint (self);
+    REL_OBSERVER_NOTIFY(self,changed,_0());
+
+    if (self->manager) {
+        RelManager * manager = self->manager;
+        REL_MANAGER_OBSERVER_NOTIFY(manager,relChanged,_1(self));
+    }
+}
+/******************************************************************************
+ *                             Edit Transactions                              *
+ ******************************************************************************/
+
+/* g_int64_hash requires GLib 2.22. */
+static guint _rel_edit_key_hash (gconstpointer key)
+{
+    gint64 k = *(const gint64*) key;
+    return (guint) (k ^ (k >> 32));
+}
+
+static gboolean _rel_edit_key_equal (gconstpointer a, gconstpointer b)
+{
+    return *(const gint64*) a == *(const gint64*) b;
+}
+
+void rel_edit_begin (Rel * self)
+{
+    if (0 == self->edit_depth ++) {
+        if ( !self->edits)
+            self->edits = g_hash_table_new_full (_rel_edit_key_hash, _rel_edit_key_equal,
+                    g_free, NULL);
+    }
+}
+
+void rel_edit_set_bit (Rel * self, int row, int col, gboolean yesno)
+{
+    gint64 * key;
+
+    g_return_if_fail (self->edit_depth > 0);
+
+    /* A later edit of the same entry replaces an earlier one. */
+    key = g_new (gint64, 1);
+    *key = ((gint64) row << 32) | (guint32) col;
+    g_hash_table_replace (self->edits, key, GINT_TO_POINTER(yesno ? 2 : 1));
+}
+
+typedef struct _RelEditSplit
+{
+    GArray/*<RelBddPair>*/ * set, * clear;
+} RelEditSplit;
+
+static void _rel_edit_split (gint64 * key, gpointer value, RelEditSplit * split)
+{
+    RelBddPair p;
+
+    p.row = (gint) (*key >> 32);
+    p.col = (gint) (guint32) *key;
+    g_array_append_val ((GPOINTER_TO_INT(value) == 2) ? split->set : split->clear, p);
+}
+
+gboolean rel_edit_commit (Rel * self)
+{
+    g_return_val_if_fail (self->edit_depth > 0, FALSE);
+
+    if (-- self->edit_depth > 0) return TRUE;
+    else if (0 == g_hash_table_size (self->edits)) return TRUE;
+    else {
+        RelEditSplit split;
+        gboolean ok;
+
+        split.set = g_array_new (FALSE, FALSE, sizeof(RelBddPair));
+        split.clear = g_array_new (FALSE, FALSE, sizeof(RelBddPair));
+        g_hash_table_foreach (self->edits, (GHFunc) _rel_edit_split, &split);
+        g_hash_table_remove_all (self->edits);
+
+        /* One union and one difference for all edits. */
+        ok = rel_bdd_set_pairs (self->impl, (RelBddPair*) split.set->data,
+                split.set->len, TRUE);
+        ok = rel_bdd_set_pairs (self->impl, (RelBddPair*) split.clear->data,
+                split.clear->len, FALSE) && ok;
+
+        g_array_free (split.set, TRUE);
+        g_array_free (split.clear, TRUE);
+
+        rel_changed (self);
+        return ok;
+    }
+}
+
+void rel_edit_rollback (Rel * self)
+{
+    g_return_if_fail (self->edit_depth > 0);
+
+    if (-- self->edit_depth == 0)
+        g_hash_table_remove_all (self->edits);
+}
+
 gboolean rel_is_hidden (const Rel * self) { return self->is_hidden; }
 void rel_set_hidden (Rel * self, gboolean yesno) { self->is_hidden = yesno; }
 
@@ -552,6 +785,7 @@ Rel * rel_assign (Rel * self, const Rel * src)
         else {
             kure_rel_destroy(self->impl);
             self->impl = impl_copy;
+            _rel_update_fingerprint (self);
         }
 
         return self;
@@ -582,17 +816,20 @@ Rel * rel_new_from_xgraph (KureContext * context, XGraph * gr)
             return NULL;
         }
         else {
-            RelationProxy * rp = relation_proxy_adapter_new (rel);
+            GArray/*<RelBddPair>*/ * pairs = g_array_new (FALSE, FALSE, sizeof(RelBddPair));
 
             XGRAPH_FOREACH_EDGE(gr,edge,iter,{
-                    gint from = atoi (xgraph_node_get_name(xgraph_edge_get_from_node(edge)));
-                    gint to   = atoi (xgraph_node_get_name(xgraph_edge_get_to_node(edge)));
+                    RelBddPair p;
 
                     /* Remark: FROM is the row, while TO is the column; both
                      *         are 1-indexed. */
-                    rp->setBit (rp, to - 1, from - 1);
+                    p.row = atoi (xgraph_node_get_name(xgraph_edge_get_from_node(edge))) - 1;
+                    p.col = atoi (xgraph_node_get_name(xgraph_edge_get_to_node(edge))) - 1;
+                    g_array_append_val (pairs, p);
             });
 
+            rel_bdd_set_pairs (impl, (RelBddPair*) pairs->data, pairs->len, TRUE);
+            g_array_free (pairs, TRUE);
             return rel;
         }
     }
@@ -0,0 +1,582 @@
+/*
+ * RelationBdd.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "RelationBdd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Kure interleaves the variables of rows and columns. The i-th most
+ * significant bit of the row number is variable 2i, the i-th most
+ * significant bit of the column number is variable 2i+1. */
+#define REL_BDD_MAX_VARS 64
+
+/*!
+ * The variables of a relation in the order in which they are met on a path
+ * from the root. This is the order of their levels in the manager, which
+ * may differ from the order of their indices after a reordering.
+ */
+typedef struct _RelBddLayout
+{
+	DdManager * manager;
+	int vars_rows, vars_cols;
+	int var_count;
+	int index [REL_BDD_MAX_VARS]; /*!< Variable index. */
+	gboolean is_row [REL_BDD_MAX_VARS];
+	int bit [REL_BDD_MAX_VARS]; /*!< Bit of the row or column number. 0 is
+								 * the least significant one. */
+} RelBddLayout;
+
+static void _rel_bdd_layout_init (RelBddLayout * l, const KureRel * impl)
+{
+	int vars_rows = kure_rel_get_vars_rows (impl);
+	int vars_cols = kure_rel_get_vars_cols (impl);
+	int i;
+
+	l->manager = kure_context_get_manager (kure_rel_get_context (impl));
+	l->vars_rows = vars_rows;
+	l->vars_cols = vars_cols;
+	l->var_count = 0;
+
+	for (i = 0 ; i < MAX(vars_rows, vars_cols) ; ++i) {
+		if (i < vars_rows) {
+			l->index[l->var_count] = 2*i;
+			l->is_row[l->var_count] = TRUE;
+			l->bit[l->var_count] = vars_rows - 1 - i;
+			l->var_count ++;
+		}
+		if (i < vars_cols) {
+			l->index[l->var_count] = 2*i + 1;
+			l->is_row[l->var_count] = FALSE;
+			l->bit[l->var_count] = vars_cols - 1 - i;
+			l->var_count ++;
+		}
+	}
+
+	/* Insertion sort by level. There are at most 62 variables. */
+	for (i = 1 ; i < l->var_count ; ++i) {
+		int index = l->index[i], bit = l->bit[i], j;
+		gboolean is_row = l->is_row[i];
+		int level = Cudd_ReadPerm (l->manager, index);
+
+		for (j = i ; j > 0 && Cudd_ReadPerm (l->manager, l->index[j-1]) > level ; --j) {
+			l->index[j] = l->index[j-1];
+			l->is_row[j] = l->is_row[j-1];
+			l->bit[j] = l->bit[j-1];
+		}
+		l->index[j] = index;
+		l->is_row[j] = is_row;
+		l->bit[j] = bit;
+	}
+}
+
+/*!
+ * Returns the bits of the entry in the order of the variables. The first
+ * variable is the most significant bit. Thus, sorting the keys sorts the
+ * entries by their paths in the BDD.
+ */
+static guint64 _rel_bdd_key (const RelBddLayout * l, gint row, gint col)
+{
+	guint64 key = 0;
+	int i;
+
+	for (i = 0 ; i < l->var_count ; ++i)
+		key = (key << 1) | (((l->is_row[i] ? row : col) >> l->bit[i]) & 1);
+	return key;
+}
+
+static int _rel_bdd_key_cmp (const void * a, const void * b)
+{
+	guint64 x = *(const guint64*)a, y = *(const guint64*)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+/*!
+ * Builds the BDD for the keys in [lo,hi) below the given level. The keys are
+ * sorted and unique, and they agree in all bits before the level. The
+ * returned node is referenced. Returns NULL if there was not enough memory.
+ */
+static DdNode * _rel_bdd_build (const RelBddLayout * l, const guint64 * keys,
+		gsize lo, gsize hi, int level)
+{
+	DdManager * manager = l->manager;
+	guint64 mask;
+	gsize split, upper;
+	DdNode *t, *e, *node;
+
+	if (lo == hi) node = Cudd_ReadLogicZero (manager);
+	else if (level == l->var_count) node = Cudd_ReadOne (manager);
+	else {
+		/* Binary search for the first key with the bit of this level set. */
+		mask = G_GUINT64_CONSTANT(1) << (l->var_count - 1 - level);
+		split = lo; upper = hi;
+		while (split < upper) {
+			gsize mid = split + (upper - split) / 2;
+			if (keys[mid] & mask) upper = mid;
+			else split = mid + 1;
+		}
+
+		e = _rel_bdd_build (l, keys, lo, split, level + 1);
+		if ( !e) return NULL;
+		t = _rel_bdd_build (l, keys, split, hi, level + 1);
+		if ( !t) {
+			Cudd_RecursiveDeref (manager, e);
+			return NULL;
+		}
+
+		if (t == e) {
+			Cudd_RecursiveDeref (manager, t);
+			return e;
+		}
+
+		node = Cudd_bddIte (manager, Cudd_bddIthVar (manager, l->index[level]),
+				t, e);
+		if (node) Cudd_Ref (node);
+		Cudd_RecursiveDeref (manager, t);
+		Cudd_RecursiveDeref (manager, e);
+		return node;
+	}
+
+	Cudd_Ref (node);
+	return node;
+}
+
+
+gboolean rel_bdd_set_pairs (KureRel * impl, const RelBddPair * pairs,
+		gsize count, gboolean yesno)
+{
+	RelBddLayout layout;
+	int rows, cols;
+	guint64 * keys;
+	gsize i, n = 0;
+	DdNode * bdd;
+	KureRel * entries;
+	Kure_success success;
+
+	if ( !kure_rel_fits_si (impl)) return FALSE;
+	else if (0 == count) return TRUE;
+
+	_rel_bdd_layout_init (&layout, impl);
+	rows = kure_rel_get_rows_si (impl);
+	cols = kure_rel_get_cols_si (impl);
+
+	keys = g_new (guint64, count);
+	for (i = 0 ; i < count ; ++i) {
+		const RelBddPair * p = &pairs[i];
+		if (p->row >= 0 && p->row < rows && p->col >= 0 && p->col < cols)
+			keys[n++] = _rel_bdd_key (&layout, p->row, p->col);
+	}
+
+	qsort (keys, n, sizeof(guint64), _rel_bdd_key_cmp);
+	if (n > 0) {
+		gsize k = 0;
+		for (i = 1 ; i < n ; ++i)
+			if (keys[i] != keys[k]) keys[++k] = keys[i];
+		n = k + 1;
+	}
+
+	bdd = _rel_bdd_build (&layout, keys, 0, n, 0);
+	g_free (keys);
+	if ( !bdd) return FALSE;
+
+	{
+		mpz_t r, c;
+		mpz_init_set_si (r, rows);
+		mpz_init_set_si (c, cols);
+		entries = kure_rel_new_from_bdd (kure_rel_get_context (impl), bdd, r, c);
+		mpz_clear (r);
+		mpz_clear (c);
+	}
+	Cudd_RecursiveDeref (layout.manager, bdd);
+	if ( !entries) return FALSE;
+
+	if (yesno) success = kure_or (impl, impl, entries);
+	else success = kure_complement (entries, entries)
+			&& kure_and (impl, impl, entries);
+
+	kure_rel_destroy (entries);
+	return success ? TRUE : FALSE;
+}
+
+
+typedef struct _RelBddWalk RelBddWalk;
+
+/*!
+ * Called for each path to the constant one. The entries of the path are
+ * those whose row and column number have the given fixed bits.
+ */
+typedef void (*RelBddCubeFunc) (RelBddWalk * w, int row_mask, int row_value,
+		int col_mask, int col_value);
+
+/*!
+ * State of a walk through the BDD of a relation. Only the entries in
+ * [row_lo,row_hi] x [col_lo,col_hi] are visited.
+ */
+struct _RelBddWalk
+{
+	const RelBddLayout * layout;
+	DdNode * one;
+	int row_lo, row_hi, col_lo, col_hi;
+	RelBddCubeFunc cube;
+
+	/* rel_bdd_get_block. The block starts at (row,col). */
+	int row, col, width;
+	guint8 * bits;
+
+	/* rel_bdd_foreach_entry */
+	RelBddEntryFunc func;
+	gpointer user_data;
+	gsize count;
+};
+
+/*!
+ * Clips [lo,hi] to the numbers whose bits in mask equal those in value.
+ * Returns FALSE if there is no such number. The result is exact if the fixed
+ * bits are the most significant ones, which is the case for Kure's variable
+ * order. Otherwise, it is a superset.
+ */
+static gboolean _rel_bdd_clip (int mask, int value, int * plo, int * phi)
+{
+	/* The free bits can be set to anything. */
+	int min = value, max = value | (~mask & G_MAXINT);
+
+	if (max < *plo || min > *phi) return FALSE;
+	*plo = MAX(*plo, min);
+	*phi = MIN(*phi, max);
+	return TRUE;
+}
+
+/*!
+ * Sets the bits of all entries inside the block which match the fixed bits.
+ * See \ref RelBddCubeFunc.
+ */
+static void _rel_bdd_block_fill (RelBddWalk * w, int row_mask,
+		int row_value, int col_mask, int col_value)
+{
+	int r_lo = w->row_lo, r_hi = w->row_hi, c_lo = w->col_lo, c_hi = w->col_hi;
+	int r, c;
+
+	if ( !_rel_bdd_clip (row_mask, row_value, &r_lo, &r_hi)
+		|| !_rel_bdd_clip (col_mask, col_value, &c_lo, &c_hi))
+		return;
+
+	for (r = r_lo ; r <= r_hi ; ++r) {
+		gsize base;
+
+		if ((r & row_mask) != row_value) continue;
+		base = (gsize)(r - w->row) * w->width;
+		for (c = c_lo ; c <= c_hi ; ++c) {
+			if ((c & col_mask) == col_value) {
+				gsize k = base + (c - w->col);
+				REL_BDD_BLOCK_SET(w->bits, k);
+			}
+		}
+	}
+}
+
+/*!
+ * Visits all paths to the constant one which have entries inside the bounds
+ * of the walk. The fixed bits are those of the path so far.
+ */
+static void _rel_bdd_walk (RelBddWalk * w, DdNode * node,
+		int level, int row_mask, int row_value, int col_mask, int col_value)
+{
+	const RelBddLayout * l = w->layout;
+	DdNode * reg = Cudd_Regular (node);
+	int r_lo = w->row_lo, r_hi = w->row_hi, c_lo = w->col_lo, c_hi = w->col_hi;
+	int bit_mask;
+	DdNode *t, *e;
+
+	if (node == Cudd_Not (w->one)) return;
+
+	/* Prune subtrees which have no entries inside the block. */
+	if ( !_rel_bdd_clip (row_mask, row_value, &r_lo, &r_hi)
+		|| !_rel_bdd_clip (col_mask, col_value, &c_lo, &c_hi))
+		return;
+
+	if (node == w->one) {
+		w->cube (w, row_mask, row_value, col_mask, col_value);
+		return;
+	}
+
+	g_assert (level < l->var_count);
+
+	/* The node doesn't depend on skipped variables. */
+	if (Cudd_NodeReadIndex (reg) == (unsigned int) l->index[level]) {
+		t = Cudd_NotCond (Cudd_T (reg), Cudd_IsComplement (node));
+		e = Cudd_NotCond (Cudd_E (reg), Cudd_IsComplement (node));
+	}
+	else t = e = node;
+
+	bit_mask = 1 << l->bit[level];
+	if (l->is_row[level]) {
+		_rel_bdd_walk (w, e, level + 1, row_mask | bit_mask, row_value,
+				col_mask, col_value);
+		_rel_bdd_walk (w, t, level + 1, row_mask | bit_mask,
+				row_value | bit_mask, col_mask, col_value);
+	}
+	else {
+		_rel_bdd_walk (w, e, level + 1, row_mask, row_value,
+				col_mask | bit_mask, col_value);
+		_rel_bdd_walk (w, t, level + 1, row_mask, row_value,
+				col_mask | bit_mask, col_value | bit_mask);
+	}
+}
+
+
+/*! Returns the mask of the bits above the given number of variables. */
+static int _rel_bdd_high_mask (int vars)
+{
+	return (int) (G_MAXINT & ~((G_GUINT64_CONSTANT(1) << vars) - 1));
+}
+
+/*!
+ * Walks through the entries of the relation in the given block. The block is
+ * clipped to the relation. The caller has to set the callback-specific
+ * fields of the walk.
+ */
+static void _rel_bdd_walk_block (RelBddWalk * w, const KureRel * impl, int row,
+		int col, int height, int width)
+{
+	RelBddLayout layout;
+
+	_rel_bdd_layout_init (&layout, impl);
+
+	w->layout = &layout;
+	w->one = Cudd_ReadOne (layout.manager);
+	w->row_lo = MAX(row, 0);
+	w->row_hi = (int) MIN((gint64) row + height, kure_rel_get_rows_si (impl)) - 1;
+	w->col_lo = MAX(col, 0);
+	w->col_hi = (int) MIN((gint64) col + width, kure_rel_get_cols_si (impl)) - 1;
+
+	/* Bits above those of the variables are always zero. */
+	if (w->row_lo <= w->row_hi && w->col_lo <= w->col_hi)
+		_rel_bdd_walk (w, kure_rel_get_bdd (impl), 0,
+				_rel_bdd_high_mask (layout.vars_rows), 0,
+				_rel_bdd_high_mask (layout.vars_cols), 0);
+	w->layout = NULL;
+}
+
+
+gboolean rel_bdd_get_block (const KureRel * impl, int row, int col, int height,
+		int width, guint8 * bits)
+{
+	RelBddWalk w;
+
+	if (width <= 0 || height <= 0) return TRUE;
+
+	/* Entries outside of the relation are left cleared. */
+	memset (bits, 0, REL_BDD_BLOCK_SIZE(width, height));
+	if ( !kure_rel_fits_si (impl)) return FALSE;
+
+	w.cube = _rel_bdd_block_fill;
+	w.row = row; w.col = col; w.width = width;
+	w.bits = bits;
+	_rel_bdd_walk_block (&w, impl, row, col, height, width);
+	return TRUE;
+}
+
+
+/*!
+ * Calls the user's function for all entries which match the fixed bits. See
+ * \ref RelBddCubeFunc.
+ */
+static void _rel_bdd_entries_visit (RelBddWalk * w, int row_mask,
+		int row_value, int col_mask, int col_value)
+{
+	int r_lo = w->row_lo, r_hi = w->row_hi, c_lo = w->col_lo, c_hi = w->col_hi;
+	int r, c;
+
+	if ( !_rel_bdd_clip (row_mask, row_value, &r_lo, &r_hi)
+		|| !_rel_bdd_clip (col_mask, col_value, &c_lo, &c_hi))
+		return;
+
+	for (r = r_lo ; r <= r_hi ; ++r) {
+		if ((r & row_mask) != row_value) continue;
+		for (c = c_lo ; c <= c_hi ; ++c) {
+			if ((c & col_mask) == col_value) {
+				w->func (r, c, w->user_data);
+				w->count ++;
+			}
+		}
+	}
+}
+
+
+gsize rel_bdd_foreach_entry (const KureRel * impl, int row, int col, int height,
+		int width, RelBddEntryFunc func, gpointer user_data)
+{
+	RelBddWalk w;
+
+	if (width <= 0 || height <= 0 || !kure_rel_fits_si (impl)) return 0;
+
+	w.cube = _rel_bdd_entries_visit;
+	w.func = func;
+	w.user_data = user_data;
+	w.count = 0;
+	_rel_bdd_walk_block (&w, impl, row, col, height, width);
+	return w.count;
+}
+
+
+/*!
+ * State of \ref rel_bdd_count_blocks. The masks and values of the walk are
+ * block numbers, i.e. the row and column numbers shifted right by shift.
+ */
+typedef struct _RelBddCount
+{
+	const RelBddLayout * layout;
+	DdNode * one;
+	int shift;
+	int last; /*!< Last level with a bit of a block number. -1 if none. */
+	int row_lo, row_hi, col_lo, col_hi;
+	int row, col, width; /*!< Origin and width of the counts. */
+	double * counts;
+	GHashTable/*<DdNode*,double*>*/ * memo;
+} RelBddCount;
+
+/*!
+ * Returns the fraction of the assignments which satisfy the node. This
+ * doesn't depend on the variables above the node, so it is computed only
+ * once for each node.
+ */
+static double _rel_bdd_fraction (RelBddCount * c, DdNode * node)
+{
+	DdNode * reg = Cudd_Regular (node);
+	double f, * p;
+
+	if (Cudd_IsConstant (reg)) f = 1.0;
+	else if ((p = (double*) g_hash_table_lookup (c->memo, reg))) f = *p;
+	else {
+		f = (_rel_bdd_fraction (c, Cudd_T (reg))
+				+ _rel_bdd_fraction (c, Cudd_E (reg))) / 2;
+		p = g_new (double, 1);
+		*p = f;
+		g_hash_table_insert (c->memo, reg, p);
+	}
+
+	return Cudd_IsComplement (node) ? 1.0 - f : f;
+}
+
+/*!
+ * Branches on the variables up to the last one of the block numbers. Each
+ * branch on a variable inside the blocks halves the weight. The weight
+ * starts with the number of cells of a block.
+ */
+static void _rel_bdd_count_walk (RelBddCount * c, DdNode * node, int level,
+		int row_mask, int row_value, int col_mask, int col_value, double weight)
+{
+	const RelBddLayout * l = c->layout;
+	DdNode * reg = Cudd_Regular (node);
+	int r_lo = c->row_lo, r_hi = c->row_hi, c_lo = c->col_lo, c_hi = c->col_hi;
+	DdNode *t, *e;
+
+	if (node == Cudd_Not (c->one)) return;
+
+	if ( !_rel_bdd_clip (row_mask, row_value, &r_lo, &r_hi)
+		|| !_rel_bdd_clip (col_mask, col_value, &c_lo, &c_hi))
+		return;
+
+	/* All bits of the block numbers are fixed. */
+	if (level > c->last) {
+		c->counts[(gsize)(row_value - c->row) * c->width + (col_value - c->col)]
+				  += weight * _rel_bdd_fraction (c, node);
+		return;
+	}
+
+	if ( !Cudd_IsConstant (reg)
+		&& Cudd_NodeReadIndex (reg) == (unsigned int) l->index[level]) {
+		t = Cudd_NotCond (Cudd_T (reg), Cudd_IsComplement (node));
+		e = Cudd_NotCond (Cudd_E (reg), Cudd_IsComplement (node));
+	}
+	else t = e = node;
+
+	if (l->bit[level] < c->shift) {
+		/* A bit inside the blocks. */
+		if (t == e)
+			_rel_bdd_count_walk (c, t, level + 1, row_mask, row_value,
+					col_mask, col_value, weight);
+		else {
+			_rel_bdd_count_walk (c, e, level + 1, row_mask, row_value,
+					col_mask, col_value, weight / 2);
+			_rel_bdd_count_walk (c, t, level + 1, row_mask, row_value,
+					col_mask, col_value, weight / 2);
+		}
+	}
+	else {
+		int bit_mask = 1 << (l->bit[level] - c->shift);
+
+		if (l->is_row[level]) {
+			_rel_bdd_count_walk (c, e, level + 1, row_mask | bit_mask,
+					row_value, col_mask, col_value, weight);
+			_rel_bdd_count_walk (c, t, level + 1, row_mask | bit_mask,
+					row_value | bit_mask, col_mask, col_value, weight);
+		}
+		else {
+			_rel_bdd_count_walk (c, e, level + 1, row_mask, row_value,
+					col_mask | bit_mask, col_value, weight);
+			_rel_bdd_count_walk (c, t, level + 1, row_mask, row_value,
+					col_mask | bit_mask, col_value | bit_mask, weight);
+		}
+	}
+}
+
+
+gboolean rel_bdd_count_blocks (const KureRel * impl, int shift, int row,
+		int col, int height, int width, double * counts)
+{
+	RelBddLayout layout;
+	RelBddCount c;
+	int i, inner = 0;
+
+	if (width <= 0 || height <= 0) return TRUE;
+
+	memset (counts, 0, sizeof(double) * (gsize) width * height);
+	if ( !kure_rel_fits_si (impl) || shift < 0 || shift > 30) return FALSE;
+
+	_rel_bdd_layout_init (&layout, impl);
+
+	c.layout = &layout;
+	c.one = Cudd_ReadOne (layout.manager);
+	c.shift = shift;
+	c.row = row; c.col = col; c.width = width;
+	c.counts = counts;
+	c.row_lo = MAX(row, 0);
+	c.row_hi = (int) MIN((gint64) row + height,
+			REL_BDD_BLOCKS(kure_rel_get_rows_si (impl), shift)) - 1;
+	c.col_lo = MAX(col, 0);
+	c.col_hi = (int) MIN((gint64) col + width,
+			REL_BDD_BLOCKS(kure_rel_get_cols_si (impl), shift)) - 1;
+
+	c.last = -1;
+	for (i = 0 ; i < layout.var_count ; ++i) {
+		if (layout.bit[i] >= shift) c.last = i;
+		else inner ++;
+	}
+
+	if (c.row_lo <= c.row_hi && c.col_lo <= c.col_hi) {
+		c.memo = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+				g_free);
+		_rel_bdd_count_walk (&c, kure_rel_get_bdd (impl), 0,
+				_rel_bdd_high_mask (MAX(0, layout.vars_rows - shift)), 0,
+				_rel_bdd_high_mask (MAX(0, layout.vars_cols - shift)), 0,
+				(double) (G_GUINT64_CONSTANT(1) << inner));
+		g_hash_table_destroy (c.memo);
+	}
+	return TRUE;
+}
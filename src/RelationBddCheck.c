@@ -0,0 +1,187 @@
+/*
+ * RelationBddCheck.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Checks the functions of RelationBdd.c against Kure. Run by "make check".
+ * It uses a manager of its own, because it reorders the variables. */
+
+/* The checks are assertions. */
+#undef G_DISABLE_ASSERT
+
+#include "RelationBdd.h"
+
+/* The entries of the relations in _rel_bdd_check_layout. */
+#define REL_BDD_CHECK_ENTRY(r,c) ((((r) * 7 + (c) * 3) % 5) < 2)
+
+static void _rel_bdd_check_visit (int row, int col, gpointer user_data)
+{
+	g_assert (REL_BDD_CHECK_ENTRY(row, col));
+}
+
+/*!
+ * Compares each entry of the relation with the pattern, using
+ * kure_get_bit_fast_si, rel_bdd_get_block, rel_bdd_foreach_entry and
+ * rel_bdd_count_blocks.
+ */
+static void _rel_bdd_check_entries (const KureRel * impl)
+{
+	int rows = kure_rel_get_rows_si (impl), cols = kure_rel_get_cols_si (impl);
+	int vars_rows = kure_rel_get_vars_rows (impl);
+	int vars_cols = kure_rel_get_vars_cols (impl);
+	int blocks_rows = REL_BDD_BLOCKS(rows, 1), blocks_cols = REL_BDD_BLOCKS(cols, 1);
+	guint8 * bits = g_malloc (REL_BDD_BLOCK_SIZE(cols, rows));
+	double * counts = g_new (double, blocks_rows * blocks_cols);
+	double total = 0.0;
+	gsize n = 0;
+	int r, c, i;
+
+	g_assert (rel_bdd_get_block (impl, 0, 0, rows, cols, bits));
+	for (r = 0 ; r < rows ; ++r) {
+		for (c = 0 ; c < cols ; ++c) {
+			gboolean expected = REL_BDD_CHECK_ENTRY(r, c);
+			gsize k = (gsize) r * cols + c;
+
+			g_assert ((kure_get_bit_fast_si (impl, r, c, vars_rows, vars_cols)
+					? TRUE : FALSE) == expected);
+			g_assert ((REL_BDD_BLOCK_GET(bits, k) ? TRUE : FALSE) == expected);
+			if (expected) n ++;
+		}
+	}
+
+	g_assert (rel_bdd_foreach_entry (impl, 0, 0, G_MAXINT, G_MAXINT,
+			_rel_bdd_check_visit, NULL) == n);
+
+	g_assert (rel_bdd_count_blocks (impl, 1, 0, 0, blocks_rows, blocks_cols,
+			counts));
+	for (i = 0 ; i < blocks_rows * blocks_cols ; ++i)
+		total += counts[i];
+	g_assert ((gsize) (total + 0.5) == n);
+
+	g_free (counts);
+	g_free (bits);
+}
+
+/*! Creates a relation with the pattern using kure_set_bit_si. */
+static KureRel * _rel_bdd_check_new (KureContext * context, int rows, int cols)
+{
+	KureRel * impl = kure_rel_new_with_size_si (context, rows, cols);
+	int r, c;
+
+	for (r = 0 ; r < rows ; ++r)
+		for (c = 0 ; c < cols ; ++c)
+			if (REL_BDD_CHECK_ENTRY(r, c))
+				g_assert (kure_set_bit_si (impl, TRUE, r, c));
+	return impl;
+}
+
+/*!
+ * Creates a relation with the pattern using kure_set_bit_si and another
+ * one using rel_bdd_set_pairs, and checks both.
+ */
+static void _rel_bdd_check_set (KureContext * context, int rows, int cols)
+{
+	KureRel * ref = _rel_bdd_check_new (context, rows, cols);
+	KureRel * bulk = kure_rel_new_with_size_si (context, rows, cols);
+	RelBddPair * pairs = g_new (RelBddPair, rows * cols);
+	gsize n = 0;
+	int r, c;
+
+	for (r = 0 ; r < rows ; ++r) {
+		for (c = 0 ; c < cols ; ++c) {
+			if (REL_BDD_CHECK_ENTRY(r, c)) {
+				pairs[n].row = r;
+				pairs[n].col = c;
+				n ++;
+			}
+		}
+	}
+
+	g_assert (rel_bdd_set_pairs (bulk, pairs, n, TRUE));
+	g_assert (kure_rel_get_bdd (ref) == kure_rel_get_bdd (bulk));
+	_rel_bdd_check_entries (ref);
+
+	g_free (pairs);
+	kure_rel_destroy (bulk);
+	kure_rel_destroy (ref);
+}
+
+/*!
+ * Checks the layout of the variables which is assumed by RelationBdd.c
+ * against kure_set_bit_si and kure_get_bit_fast_si. Uses relations which
+ * are neither square nor have a power of two as size, and repeats the checks
+ * after the variables were reordered by Cudd_ReduceHeap and reversed by
+ * Cudd_ShuffleHeap.
+ */
+static void _rel_bdd_check_layout (KureContext * context)
+{
+	/* Neither square nor powers of two, so that the number of variables of
+	 * rows and columns differ and there are unused numbers. */
+	static const int sizes [][2] = { {5,3}, {3,7}, {13,6}, {1,9}, {11,1} };
+	const int count = G_N_ELEMENTS(sizes);
+	DdManager * manager = kure_context_get_manager (context);
+	KureRel * rels [G_N_ELEMENTS(sizes)];
+	int * order, * reversed;
+	int i, size;
+
+	for (i = 0 ; i < count ; ++i) {
+		_rel_bdd_check_set (context, sizes[i][0], sizes[i][1]);
+
+		/* Kept to check them after the reorderings below. */
+		rels[i] = _rel_bdd_check_new (context, sizes[i][0], sizes[i][1]);
+	}
+
+	size = Cudd_ReadSize (manager);
+	order = g_new (int, size);
+	reversed = g_new (int, size);
+	for (i = 0 ; i < size ; ++i) {
+		order[i] = Cudd_ReadInvPerm (manager, i);
+		reversed[size - 1 - i] = order[i];
+	}
+
+	/* A forced reordering, which may or may not change the order, and a
+	 * reversed order, which is never the one Kure assumes. */
+	g_assert (Cudd_ReduceHeap (manager, CUDD_REORDER_RANDOM, 0));
+	for (i = 0 ; i < count ; ++i) {
+		_rel_bdd_check_entries (rels[i]);
+		_rel_bdd_check_set (context, sizes[i][0], sizes[i][1]);
+	}
+
+	g_assert (Cudd_ShuffleHeap (manager, reversed));
+	for (i = 0 ; i < count ; ++i) {
+		_rel_bdd_check_entries (rels[i]);
+		_rel_bdd_check_set (context, sizes[i][0], sizes[i][1]);
+	}
+
+	g_assert (Cudd_ShuffleHeap (manager, order));
+	for (i = 0 ; i < count ; ++i) {
+		_rel_bdd_check_entries (rels[i]);
+		kure_rel_destroy (rels[i]);
+	}
+
+	g_free (reversed);
+	g_free (order);
+}
+
+
+int main (int argc, char ** argv)
+{
+	KureContext * context = kure_context_new ();
+
+	_rel_bdd_check_layout (context);
+	kure_context_deref (context);
+	return 0;
+}
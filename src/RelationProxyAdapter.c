@@ -1,4 +1,5 @@
 #include "RelationProxyAdapter.h"
+#include "RelationBdd.h"
 
 #define _PUBLIC(name) relation_proxy_adapter_##name
 #define _PRIV(name) _relation_proxy_adapter_##name
@@ -29,22 +30,41 @@ static void _PRIV(clear_bit) (RelationProxy * proxy,
 }
 
 
+/* Extracts a block with rel_bdd_get_block. The proxy is only used for
+ * relations whose size fits into an int, so this doesn't fail. Otherwise,
+ * the block is left empty. */
+static void _PRIV(get_block) (RelationProxyAdapter * self, int col, int row,
+                              int width, int height, guint8 * /*out*/ bits)
+{
+  if ( !rel_bdd_get_block (rel_get_impl(self->rel), row, col, height, width,
+                           bits))
+    g_warning ("RelationProxyAdapter: Relation \"%s\" is too big.",
+               rel_get_name(self->rel));
+}
+
 static void _PRIV(get_bits_rect) (RelationProxy * proxy,
                                    int col, int row,
                                    int width, int height,
                                    gboolean * /*out*/ data)
 {
   RelationProxyAdapter * self = (RelationProxyAdapter*)proxy->object;
-  Rel * rel = ((RelationProxyAdapter*)proxy->object)->rel;
-  int i,j;
-  KureRel * impl = rel_get_impl(rel);
-
+  guint8 * bits = g_malloc (REL_BDD_BLOCK_SIZE(width, height));
+  gsize k, n = (gsize) width * height;
+
+  /* One walk through the BDD instead of one per entry. */
+  _PRIV(get_block) (self, col, row, width, height, bits);
+  for (k = 0 ; k < n ; k ++)
+    data[k] = REL_BDD_BLOCK_GET(bits, k);
+  g_free (bits);
+}
 
-  for (i = 0 ; i < height ; i ++)
-    for (j = 0 ; j < width ; j ++) {
-      data[i*width+j]
-           = kure_get_bit_fast_si(impl, i+row, j+col, self->varsRow, self->varsCol);
-    }
+static void _PRIV(get_bits_packed) (RelationProxy * proxy,
+                                     int col, int row,
+                                     int width, int height,
+                                     guint8 * /*out*/ bits)
+{
+  _PRIV(get_block) ((RelationProxyAdapter*)proxy->object, col, row,
+                    width, height, bits);
 }
 
 
@@ -166,6 +186,7 @@ RelationProxy * _PUBLIC(new) (Rel * rel)
   proxy->setBit         = _PRIV(set_bit);
   proxy->clearBit       = _PRIV(clear_bit);
   proxy->getBitsRect    = _PRIV(get_bits_rect);
+  proxy->getBitsPacked  = _PRIV(get_bits_packed);
 
   proxy->mp_getBit      = _PRIV(mp_get_bit);
   proxy->mp_setBit      = _PRIV(mp_set_bit);
@@ -30,6 +30,7 @@
 #include "Program.h"
 #include "Domain.h"
 #include "Kure.h"
+#include "WorkspaceSync.h"
 #include "Eps.h"
 #include "version.h"
 #include <lauxlib.h> // luaL_*
@@ -104,6 +105,23 @@ struct _Relview
 
 	GHashTable/*<gchar*,LabelWrapper*>*/ * labels;
 	GHashTable/*<LabelAssoc*,LabelAssoc*>*/ * label_assocs;
+
+	/* Journal of the changes to the global objects. Created on demand. See
+	 * rv_get_workspace_sync. */
+	WorkspaceSync * sync;
+
+	/* The shared Lua state is created on demand and kept up to date using
+	 * the journal. See rv_lang_get_state. */
+	lua_State * L;
+	gulong L_generation;
+
+	/* Idle states for rv_lang_state_checkout. */
+	GQueue/*<lua_State*>*/ * L_pool;
+
+	/* Resolved domains by name. An entry is dropped when one of the objects
+	 * the domain depends on has changed. See _dom_to_kure_dom. */
+	GHashTable/*<gchar*,DomCacheEntry*>*/ * dom_cache;
+	gulong dom_generation;
 };
 
 static Relview * _rv_new ();
@@ -225,6 +243,14 @@ void rv_destroy (Relview * rv)
 {
 	VERBOSE(VERBOSE_DEBUG, printf ("___rv_destroy (CLEANUP)________________________________\n");)
 
+	if (rv->L) kure_lua_destroy (rv->L);
+	if (rv->L_pool) {
+		g_queue_foreach (rv->L_pool, (GFunc) kure_lua_destroy, NULL);
+		g_queue_free (rv->L_pool);
+	}
+	if (rv->dom_cache) g_hash_table_destroy (rv->dom_cache);
+	if (rv->sync) workspace_sync_destroy (rv->sync);
+
 	g_hash_table_destroy (rv->labels);
 
 	workspace_destroy (rv_get_workspace(rv));
@@ -585,32 +611,25 @@ const gchar * rv_get_object_type_name (RvObjectType type)
  *                              Tue, 13 Apr 2010                               *
  ******************************************************************************/
 
-static KureDom * _dom_to_kure_dom (Relview * rv, lua_State * L, Dom * dom)
+KureDom * rv_lang_resolve_dom (lua_State * L, const gchar * name,
+		DomainType type, const gchar * comp1_lua, const gchar * comp2_lua,
+		GString * warnings, GError ** perr)
 {
 	KureDom * kdom;
 	KureError * kerr = NULL;
 	KureRel * R, *S;
 	mpz_t a,b, x,y;
-	const char * error_title = "Invalid or incomplete domain";
 
-	R = kure_lua_exec(L, dom_get_first_comp_lua(dom), &kerr);
+	R = kure_lua_exec(L, comp1_lua, &kerr);
 	if ( !R) {
-		rv_user_error_with_descr (error_title, kerr->message,
-				"Unable to load the first component of domain \"%s\". We "
-				"ignore it and try without, but this could trigger some "
-				"other errors.",
-				dom_get_name(dom));
+		g_set_error_literal (perr, rv_error_domain(), 1, kerr->message);
 		kure_error_destroy(kerr);
 		return NULL;
 	}
 
-	S = kure_lua_exec(L, dom_get_second_comp_lua(dom), &kerr);
+	S = kure_lua_exec(L, comp2_lua, &kerr);
 	if ( !S) {
-		rv_user_error_with_descr (error_title, kerr->message,
-				"Unable to load the second component of domain \"%s\". We "
-				"ignore it and try without, but this could trigger some "
-				"other errors.",
-				dom_get_name(dom));
+		g_set_error_literal (perr, rv_error_domain(), 2, kerr->message);
 		kure_error_destroy(kerr);
 		kure_rel_destroy(R);
 		return NULL;
@@ -623,23 +642,21 @@ static KureDom * _dom_to_kure_dom (Relview * rv, lua_State * L, Dom * dom)
 	kure_rel_get_cols(S, b);
 	kure_rel_get_rows(S, y);
 
-	if (mpz_cmp(a,x) != 0) {
-		rv_user_error (error_title,
+	if (mpz_cmp(a,x) != 0 && warnings) {
+		g_string_append_printf (warnings,
 				"Number of rows/cols of the first component of domain "
-				"\"%s\" differ. We ignore this and use the rows!",
-				dom_get_name(dom));
+				"\"%s\" differ. We ignore this and use the rows!\n", name);
 	}
-	if (mpz_cmp(b,y) != 0) {
-		rv_user_error (error_title,
+	if (mpz_cmp(b,y) != 0 && warnings) {
+		g_string_append_printf (warnings,
 				"Number of rows/cols of the second component of domain "
-				"\"%s\" differ. We ignore this and use the cols!",
-				dom_get_name(dom));
+				"\"%s\" differ. We ignore this and use the cols!\n", name);
 	}
 
 	kure_rel_destroy(R);
 	kure_rel_destroy(S);
 
-	switch (dom_get_type(dom)) {
+	switch (type) {
 	case DIRECT_PRODUCT: kdom = kure_direct_product_new(a,b); break;
 	case DIRECT_SUM: kdom = kure_direct_sum_new(a,b); break;
 	default:
@@ -647,26 +664,347 @@ static KureDom * _dom_to_kure_dom (Relview * rv, lua_State * L, Dom * dom)
 		abort();
 	}
 
-	mpz_clear(a); mpz_clear(b);
+	mpz_clear(a); mpz_clear(b); mpz_clear(x); mpz_clear(y);
+	return kdom;
+}
+
+static KureDom * _dom_resolve (Relview * rv, lua_State * L, Dom * dom)
+{
+	const char * error_title = "Invalid or incomplete domain";
+	GString * warnings = g_string_new ("");
+	GError * err = NULL;
+	KureDom * kdom = rv_lang_resolve_dom (L, dom_get_name(dom),
+			dom_get_type(dom), dom_get_first_comp_lua(dom),
+			dom_get_second_comp_lua(dom), warnings, &err);
+
+	if ( !kdom) {
+		rv_user_error_with_descr (error_title, err->message,
+				"Unable to load the %s component of domain \"%s\". We "
+				"ignore it and try without, but this could trigger some "
+				"other errors.", (1 == err->code) ? "first" : "second",
+				dom_get_name(dom));
+		g_error_free (err);
+	}
+	else if (warnings->len > 0) {
+		g_string_truncate (warnings, warnings->len - 1); /* trailing \n */
+		rv_user_error (error_title, "%s", warnings->str);
+	}
+
+	g_string_free (warnings, TRUE);
 	return kdom;
 }
 
+/*! Returns the journal of changes to the global objects. See
+ * WorkspaceSync.h. */
+WorkspaceSync * rv_get_workspace_sync (Relview * rv)
+{
+	if ( !rv->sync) rv->sync = workspace_sync_new (rv);
+	return rv->sync;
+}
+
+/* A resolved domain and the names it depends on. */
+typedef struct _DomCacheEntry
+{
+	KureDom * kdom; /*!< NULL if the domain is invalid. */
+	GHashTable/*<gchar*,gchar*>*/ * deps;
+} DomCacheEntry;
+
+static void _dom_cache_entry_destroy (DomCacheEntry * entry)
+{
+	if (entry->kdom) kure_dom_destroy (entry->kdom);
+	g_hash_table_destroy (entry->deps);
+	g_free (entry);
+}
+
+/*! Collects the names the components of the domain use, transitively
+ * through functions, programs and other domains. Unknown names are kept
+ * too, because an object with that name may appear later on. */
+static GHashTable * _dom_collect_deps (Relview * rv, Dom * dom)
+{
+	GHashTable * deps = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, NULL);
+	GQueue * todo = g_queue_new ();
+	GHashTableIter iter;
+	gpointer name;
+
+	rv_lang_term_collect_identifiers (dom_get_first_comp (dom), deps);
+	rv_lang_term_collect_identifiers (dom_get_second_comp (dom), deps);
+	g_hash_table_iter_init (&iter, deps);
+	while (g_hash_table_iter_next (&iter, &name, NULL))
+		g_queue_push_tail (todo, g_strdup ((gchar*) name));
+
+	while ( !g_queue_is_empty (todo)) {
+		gchar * cur = (gchar*) g_queue_pop_head (todo);
+		GHashTable * idents = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, NULL);
+		Fun * fun;
+		Prog * prog;
+		Dom * other;
+
+		if ((fun = fun_manager_get_by_name (rv_get_fun_manager(rv), cur)))
+			rv_lang_term_collect_identifiers (fun_get_def (fun), idents);
+		else if ((prog = prog_manager_get_by_name (rv_get_prog_manager(rv), cur)))
+			rv_lang_term_collect_identifiers (prog_get_term (prog), idents);
+		else if ((other = dom_manager_get_by_name (rv_get_dom_manager(rv), cur))) {
+			rv_lang_term_collect_identifiers (dom_get_first_comp (other), idents);
+			rv_lang_term_collect_identifiers (dom_get_second_comp (other), idents);
+		}
+
+		g_hash_table_iter_init (&iter, idents);
+		while (g_hash_table_iter_next (&iter, &name, NULL)) {
+			if ( !g_hash_table_lookup (deps, name)) {
+				gchar * key = g_strdup ((gchar*) name);
+				g_hash_table_insert (deps, key, key);
+				g_queue_push_tail (todo, g_strdup (key));
+			}
+		}
+
+		g_hash_table_destroy (idents);
+		g_free (cur);
+	}
+
+	g_queue_free (todo);
+	return deps;
+}
+
+static gboolean _dom_cache_entry_depends_on (const gchar * dom_name,
+		DomCacheEntry * entry, GHashTable * changed)
+{
+	GHashTableIter iter;
+	gpointer name;
+
+	if (g_hash_table_lookup (changed, dom_name)) return TRUE;
+
+	g_hash_table_iter_init (&iter, changed);
+	while (g_hash_table_iter_next (&iter, &name, NULL))
+		if (g_hash_table_lookup (entry->deps, name)) return TRUE;
+	return FALSE;
+}
+
+/*! Collects the names of the changed objects. See \ref WorkspaceSyncFunc. */
+static void _dom_cache_collect_change (const gchar * name, WorkspaceSyncKind kind,
+		gpointer obj, GHashTable * changed)
+{
+	gchar * key = g_strdup (name);
+	g_hash_table_insert (changed, key, key);
+}
+
+/*! Returns the resolved domain, or NULL if it's invalid. The result belongs
+ * to the cache. A domain is resolved again only if an object it depends on
+ * has changed since. Errors are shown only when the domain is resolved.
+ */
+static const KureDom * _dom_to_kure_dom (Relview * rv, lua_State * L, Dom * dom)
+{
+	WorkspaceSync * sync = rv_get_workspace_sync (rv);
+	gulong gen = workspace_sync_get_generation (sync);
+	DomCacheEntry * entry;
+
+	if ( !rv->dom_cache) {
+		rv->dom_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify) _dom_cache_entry_destroy);
+		rv->dom_generation = gen;
+	}
+	else if (gen != rv->dom_generation) {
+		/* The journal is shared with the evaluation code. Read everything
+		 * since our last visit and drop the affected domains in one go. */
+		GHashTable * changed = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, NULL);
+
+		workspace_sync_foreach_change (sync, rv->dom_generation,
+				(WorkspaceSyncFunc) _dom_cache_collect_change, changed);
+		g_hash_table_foreach_remove (rv->dom_cache,
+				(GHRFunc) _dom_cache_entry_depends_on, changed);
+		g_hash_table_destroy (changed);
+		rv->dom_generation = gen;
+	}
+
+	entry = (DomCacheEntry*) g_hash_table_lookup (rv->dom_cache, dom_get_name(dom));
+	if ( !entry) {
+		entry = g_new0 (DomCacheEntry, 1);
+		entry->kdom = _dom_resolve (rv, L, dom);
+		entry->deps = _dom_collect_deps (rv, dom);
+		g_hash_table_insert (rv->dom_cache, g_strdup (dom_get_name(dom)), entry);
+	}
+
+	return entry->kdom;
+}
+
+static int _rv_lang_dump_writer (lua_State * L, const void * p, size_t size,
+		GString * buf)
+{
+	g_string_append_len (buf, (const gchar*) p, size);
+	return 0;
+}
+
+gchar * rv_lang_compile (const gchar * code, size_t size, size_t * pbinsize)
+{
+	/* Compiling doesn't need any libraries or globals. */
+	static lua_State * compiler = NULL;
+	GString * buf;
+
+	if ( !compiler) compiler = luaL_newstate ();
+
+	if (luaL_loadbuffer (compiler, code, size, code)) {
+		lua_pop (compiler, 1);
+		return NULL;
+	}
+
+	buf = g_string_new ("");
+	lua_dump (compiler, (lua_Writer) _rv_lang_dump_writer, buf);
+	lua_pop (compiler, 1);
+
+	if (pbinsize) *pbinsize = buf->len;
+	return g_string_free (buf, FALSE);
+}
+
+/*! __index metamethod of the globals table of a state created by
+ * rv_lang_new_state. Copies a relation from the \ref RelManager into the
+ * globals table on the first access. Upvalues are the \ref Relview object
+ * and a table with names which must not be resolved, see rv_lang_unbind.
+ */
+static int _rv_lang_lazy_index (lua_State * L)
+{
+	Relview * rv = (Relview*) lua_touserdata (L, lua_upvalueindex(1));
+	const gchar * key;
+	Rel * rel;
+
+	if (lua_type (L, 2) != LUA_TSTRING) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	lua_pushvalue (L, 2);
+	lua_rawget (L, lua_upvalueindex(2));
+	if ( !lua_isnil (L, -1)) {
+		lua_pushnil (L);
+		return 1;
+	}
+	lua_pop (L, 1);
+
+	key = lua_tostring (L, 2);
+	rel = rel_manager_get_by_name (rv_get_rel_manager(rv),
+			g_str_equal (key, KURE_DOLLAR_SUBST) ? "$" : key);
+	if ( !rel) {
+		lua_pushnil (L);
+		return 1;
+	}
+
+	VERBOSE(VERBOSE_PROGRESS, printf ("Loading relation \"%s\" into state.\n", rel_get_name(rel));)
+
+	/* L may be a child environment (see rv_lang_new_env). The relation has
+	 * to be stored in the table which was indexed, under the key which was
+	 * looked up (i.e. KURE_DOLLAR_SUBST for "$"). */
+	lua_pushvalue (L, LUA_GLOBALSINDEX);
+	lua_pushvalue (L, 1);
+	lua_replace (L, LUA_GLOBALSINDEX);
+	kure_lua_set_rel_copy (L, key, rel_get_impl(rel));
+	lua_replace (L, LUA_GLOBALSINDEX);
+
+	lua_pushvalue (L, 2);
+	lua_rawget (L, 1);
+	return 1;
+}
+
+void rv_lang_unbind (lua_State * L, const gchar * name)
+{
+	const gchar * lua_name = g_str_equal (name, "$") ? KURE_DOLLAR_SUBST : name;
+
+	lua_pushnil (L);
+	lua_setglobal (L, lua_name);
+
+	if (lua_getmetatable (L, LUA_GLOBALSINDEX)) {
+		lua_getfield (L, -1, "__index");
+		if (lua_getupvalue (L, -1, 2)) {
+			lua_pushboolean (L, TRUE);
+			lua_setfield (L, -2, lua_name);
+			lua_pop (L, 1);
+		}
+		lua_pop (L, 2);
+	}
+}
+
+/*! relview.equals(A,B) in Lua. Compares the contents of both relations in
+ * constant time. See rel_equal. */
+static int _rv_lang_equals (lua_State * L)
+{
+	RelFingerprint a, b;
+
+	if ( !kure_lua_isrel (L, 1) || !kure_lua_isrel (L, 2))
+		return luaL_error (L, "relview.equals: Two relations expected.");
+
+	rel_impl_get_fingerprint (kure_lua_torel (L, 1, NULL), &a);
+	rel_impl_get_fingerprint (kure_lua_torel (L, 2, NULL), &b);
+	lua_pushboolean (L, rel_fingerprint_same_contents (&a, &b));
+	return 1;
+}
+
+/*! relview.fingerprint(R) in Lua. Returns a string which is equal for two
+ * relations iff they have the same contents. It is only valid as long as
+ * the relation exists. */
+static int _rv_lang_fingerprint (lua_State * L)
+{
+	RelFingerprint fp;
+	gchar * str;
+
+	if ( !kure_lua_isrel (L, 1))
+		return luaL_error (L, "relview.fingerprint: Relation expected.");
+
+	rel_impl_get_fingerprint (kure_lua_torel (L, 1, NULL), &fp);
+	str = g_strdup_printf ("%p:%" G_GINT64_MODIFIER "x:%" G_GINT64_MODIFIER "x",
+			(void*) fp.root, fp.rows, fp.cols);
+	lua_pushstring (L, str);
+	g_free (str);
+	return 1;
+}
+
+/*! Loads the code of a function or program into the given state, but
+ * doesn't run it. If Lua rejects the bytecode, e.g. because it came from a
+ * cache written by another build, it's dropped and the Lua code is loaded
+ * instead. Returns the result of luaL_loadbuffer.
+ */
+static int _rv_lang_load_code (lua_State * L, WorkspaceSyncKind kind, gpointer obj)
+{
+	gboolean is_fun = (WORKSPACE_SYNC_FUNCTION == kind);
+	size_t size, code_size;
+	const gchar * code = is_fun ? fun_get_luacode ((Fun*) obj, &code_size)
+			: prog_get_luacode ((Prog*) obj, &code_size);
+	const gchar * bin = is_fun ? fun_get_luabin ((Fun*) obj, &size)
+			: prog_get_luabin ((Prog*) obj, &size);
+	/* Note: It is necessary to pass the plain source code as the last
+	 *       argument here. The last argument is the data which is used
+	 *       in Lua's lua_Debug->source field! The bytecode contains
+	 *       the source code as its chunk name. See rv_lang_compile. */
+	int error = luaL_loadbuffer (L, bin, size, code);
+
+	if (error && bin != code) {
+		lua_pop (L, 1);
+		if (is_fun) fun_set_luabin ((Fun*) obj, NULL, 0);
+		else prog_set_luabin ((Prog*) obj, NULL, 0);
+		error = luaL_loadbuffer (L, code, code_size, code);
+	}
+	return error;
+}
+
 lua_State * rv_lang_new_state (Relview * rv)
 {
 	lua_State * L = kure_lua_new (rv->context);
 
 	FunManager * fm = fun_manager_get_instance();
 	ProgManager * pm = prog_manager_get_instance();
-	RelManager * rm = rv_get_rel_manager(rv);
 	DomManager * dm = rv_get_dom_manager(rv);
 
 #warning TODO: The error message dumps the Lua code. This conflicts with pre-compiled code!
 
+	lua_newtable (L);
+	lua_pushcfunction (L, _rv_lang_equals);
+	lua_setfield (L, -2, "equals");
+	lua_pushcfunction (L, _rv_lang_fingerprint);
+	lua_setfield (L, -2, "fingerprint");
+	lua_setglobal (L, "relview");
+
 	FOREACH_FUN(fm, cur, iter, {
-		size_t size;
-		const gchar * buf = fun_get_luacode (cur, &size);
-		/* Note: Same as for programs below! */
-		int error = luaL_loadbuffer (L, buf, size, buf);
+		const gchar * buf = fun_get_luacode (cur, NULL);
+		int error = _rv_lang_load_code (L, WORKSPACE_SYNC_FUNCTION, cur);
 		VERBOSE(VERBOSE_PROGRESS, printf ("Loading function \"%s\" into state.\n", fun_get_name (cur));)
 		error = error || lua_pcall (L, 0, 0, 0);
 		if (error) {
@@ -680,13 +1018,9 @@ lua_State * rv_lang_new_state (Relview * rv)
 	});
 
 	FOREACH_PROG(pm, cur, iter, {
-		size_t size;
 		const gchar * name = prog_get_name (cur);
-		const gchar * buf = prog_get_luacode (cur, &size);
-		/* Note: It is necessary to pass the plain source code as the last
-		 *       argument here. The last argument is the data which is used
-		 *       in Lua's lua_Debug->source field! */
-		int error = luaL_loadbuffer (L, buf, size, buf);
+		const gchar * buf = prog_get_luacode (cur, NULL);
+		int error = _rv_lang_load_code (L, WORKSPACE_SYNC_PROGRAM, cur);
 		VERBOSE(VERBOSE_PROGRESS, printf ("Loading program \"%s\" into state.\n", name);)
 		error = error || lua_pcall (L, 0, 0, 0);
 		if (error) {
@@ -699,44 +1033,371 @@ lua_State * rv_lang_new_state (Relview * rv)
 		}
 	});
 
-	FOREACH_REL(rm, cur, iter, {
-			VERBOSE(VERBOSE_PROGRESS, printf ("Loading relation \"%s\" into state.\n", rel_get_name(cur));)
-		kure_lua_set_rel_copy(L, rel_get_name(cur), rel_get_impl(cur));
-	});
+	/* Relations are copied into the state on first use. The state may
+	 * outlive relations, because the copy is taken. */
+	lua_newtable (L);
+	lua_pushlightuserdata (L, (void*) rv);
+	lua_newtable (L);
+	lua_pushcclosure (L, _rv_lang_lazy_index, 2);
+	lua_setfield (L, -2, "__index");
+	lua_setmetatable (L, LUA_GLOBALSINDEX);
 
 	FOREACH_DOM(dm, cur, iter, {
-		KureDom * kdom;
+		const KureDom * kdom;
 		VERBOSE(VERBOSE_PROGRESS, printf ("Loading domain \"%s\" into state.\n", dom_get_name(cur));)
 		kdom = _dom_to_kure_dom(rv,L,cur);
 		if (!kdom) {
 			/* We ignore it. */
 		}
-		else {
-			kure_lua_set_dom_copy(L, dom_get_name(cur), kdom);
-			kure_dom_destroy(kdom);
-		}
+		else kure_lua_set_dom_copy(L, dom_get_name(cur), kdom);
 	});
 
 	return L;
 }
 
-KureRel * rv_lang_eval (Relview * self, const char * expr, GError ** perr)
+/* A state which is brought up to date. See _rv_lang_sync. */
+typedef struct _RvLangSyncTarget
+{
+	Relview * rv;
+	lua_State * L;
+} RvLangSyncTarget;
+
+/*! Applies a single change of a global object to a Lua state. An object
+ * which can't be loaded is removed from the state, like in
+ * rv_lang_new_state. See \ref WorkspaceSyncFunc.
+ */
+static void _rv_lang_apply_change (const gchar * name, WorkspaceSyncKind kind,
+		gpointer obj, RvLangSyncTarget * target)
+{
+	Relview * rv = target->rv;
+	lua_State * L = target->L;
+	const gchar * lua_name = g_str_equal (name, "$") ? KURE_DOLLAR_SUBST : name;
+
+	VERBOSE(VERBOSE_PROGRESS, printf ("Updating \"%s\" in the state.\n", name);)
+
+	/* A relation is loaded again on its next use. */
+	if ( !obj || WORKSPACE_SYNC_RELATION == kind) {
+		lua_pushnil (L);
+		lua_setglobal (L, lua_name);
+	}
+	else if (WORKSPACE_SYNC_FUNCTION == kind || WORKSPACE_SYNC_PROGRAM == kind) {
+		const gchar * buf = (WORKSPACE_SYNC_FUNCTION == kind)
+				? fun_get_luacode ((Fun*) obj, NULL)
+				: prog_get_luacode ((Prog*) obj, NULL);
+
+		if (_rv_lang_load_code (L, kind, obj) || lua_pcall (L, 0, 0, 0)) {
+			rv_user_error("Unable to update Lua state",
+					"Unable to load \"%s\" into Lua. Reason: %s Code was \"%s\"",
+					name, lua_tostring (L,-1), buf);
+			lua_pop (L, 1);
+			lua_pushnil (L);
+			lua_setglobal (L, lua_name);
+		}
+	}
+	else if (WORKSPACE_SYNC_DOMAIN == kind) {
+		const KureDom * kdom = _dom_to_kure_dom (rv, L, (Dom*) obj);
+		if (kdom)
+			kure_lua_set_dom_copy (L, name, kdom);
+		else {
+			lua_pushnil (L);
+			lua_setglobal (L, lua_name);
+		}
+	}
+}
+
+/*! Applies the changes since the given generation to a state created by
+ * rv_lang_new_state. */
+static void _rv_lang_sync (Relview * rv, lua_State * L, gulong since)
+{
+	RvLangSyncTarget target = { rv, L };
+	workspace_sync_foreach_change (rv_get_workspace_sync (rv), since,
+			(WorkspaceSyncFunc) _rv_lang_apply_change, &target);
+}
+
+lua_State * rv_lang_get_state (Relview * rv)
+{
+	if ( !rv->L) {
+		rv->L = rv_lang_new_state (rv);
+		if ( !rv->L) return NULL;
+
+		/* The state is complete at the current generation. */
+		rv->L_generation = workspace_sync_get_generation (rv_get_workspace_sync (rv));
+	}
+	else {
+		gulong gen = workspace_sync_get_generation (rv->sync);
+
+		if (gen != rv->L_generation) {
+			_rv_lang_sync (rv, rv->L, rv->L_generation);
+			rv->L_generation = gen;
+		}
+	}
+
+	return rv->L;
+}
+
+lua_State * rv_lang_new_env (Relview * rv)
+{
+	lua_State * L = rv_lang_get_state (rv);
+	lua_State * env;
+
+	if ( !L) return NULL;
+
+	/* The thread is anchored in the registry until it's released. Its
+	 * globals are a table of its own, which falls back to the globals of
+	 * the shared state. */
+	env = lua_newthread (L);
+	lua_pushlightuserdata (L, (void*) env);
+	lua_insert (L, -2);
+	lua_settable (L, LUA_REGISTRYINDEX);
+
+	lua_newtable (env);
+	lua_newtable (env);
+	lua_pushvalue (env, LUA_GLOBALSINDEX);
+	lua_setfield (env, -2, "__index");
+	lua_setmetatable (env, -2);
+	lua_replace (env, LUA_GLOBALSINDEX);
+
+	return env;
+}
+
+void rv_lang_env_destroy (Relview * rv, lua_State * env)
+{
+	lua_State * L = rv->L;
+
+	g_return_if_fail (L != NULL);
+
+	lua_settop (env, 0);
+	lua_pushlightuserdata (L, (void*) env);
+	lua_pushnil (L);
+	lua_settable (L, LUA_REGISTRYINDEX);
+}
+
+/* Number of idle states kept by rv_lang_state_checkout. */
+#define RV_LANG_POOL_SIZE 2
+
+/* Registry keys of a pooled state. */
+static char _rv_lang_snapshot_key;
+static char _rv_lang_snapshot_meta_key;
+static char _rv_lang_generation_key;
+
+/*! Records the current globals of the state and the metatable of the
+ * globals table (i.e. the lazy binder of rv_lang_new_state) together with
+ * its __index field. See _rv_lang_restore. */
+static void _rv_lang_snapshot (lua_State * L)
+{
+	lua_pushlightuserdata (L, &_rv_lang_snapshot_key);
+	lua_newtable (L);
+	lua_pushnil (L);
+	while (lua_next (L, LUA_GLOBALSINDEX)) {
+		lua_pushvalue (L, -2);
+		lua_insert (L, -2);
+		lua_rawset (L, -4);
+	}
+	lua_rawset (L, LUA_REGISTRYINDEX);
+
+	lua_pushlightuserdata (L, &_rv_lang_snapshot_meta_key);
+	if (lua_getmetatable (L, LUA_GLOBALSINDEX)) {
+		lua_newtable (L);
+		lua_pushvalue (L, -2);
+		lua_rawseti (L, -2, 1);
+		lua_getfield (L, -2, "__index");
+		lua_rawseti (L, -2, 2);
+		lua_replace (L, -2);
+	}
+	else lua_pushnil (L);
+	lua_rawset (L, LUA_REGISTRYINDEX);
+}
+
+/*! Resets the globals of the state to the last snapshot. Globals which
+ * were added since are removed. The stack, the debug hook (e.g. of the
+ * profiler) and the metatable of the globals table are reset too. */
+static void _rv_lang_restore (lua_State * L)
+{
+	lua_settop (L, 0);
+	lua_sethook (L, NULL, 0, 0);
+
+	lua_pushlightuserdata (L, &_rv_lang_snapshot_meta_key);
+	lua_rawget (L, LUA_REGISTRYINDEX);
+	if (lua_istable (L, 1)) {
+		lua_rawgeti (L, 1, 1);
+		lua_rawgeti (L, 1, 2);
+		lua_setfield (L, -2, "__index");
+		lua_setmetatable (L, LUA_GLOBALSINDEX);
+	}
+	else {
+		lua_pushnil (L);
+		lua_setmetatable (L, LUA_GLOBALSINDEX);
+	}
+	lua_settop (L, 0);
+
+	lua_pushlightuserdata (L, &_rv_lang_snapshot_key);
+	lua_rawget (L, LUA_REGISTRYINDEX);
+
+	/* Clearing existing fields during the traversal is allowed. */
+	lua_pushnil (L);
+	while (lua_next (L, LUA_GLOBALSINDEX)) {
+		lua_pop (L, 1);
+		lua_pushvalue (L, -1);
+		lua_rawget (L, 1);
+		if (lua_isnil (L, -1)) {
+			lua_pushvalue (L, -2);
+			lua_pushnil (L);
+			lua_rawset (L, LUA_GLOBALSINDEX);
+		}
+		lua_pop (L, 1);
+	}
+
+	lua_pushnil (L);
+	while (lua_next (L, 1)) {
+		lua_pushvalue (L, -2);
+		lua_insert (L, -2);
+		lua_rawset (L, LUA_GLOBALSINDEX);
+	}
+	lua_pop (L, 1);
+}
+
+static void _rv_lang_set_generation (lua_State * L, gulong gen)
 {
-	static const char * var_name = "__var";
+	lua_pushlightuserdata (L, &_rv_lang_generation_key);
+	lua_pushnumber (L, (lua_Number) gen);
+	lua_rawset (L, LUA_REGISTRYINDEX);
+}
+
+static gulong _rv_lang_get_generation (lua_State * L)
+{
+	gulong gen;
+
+	lua_pushlightuserdata (L, &_rv_lang_generation_key);
+	lua_rawget (L, LUA_REGISTRYINDEX);
+	gen = (gulong) lua_tonumber (L, -1);
+	lua_pop (L, 1);
+	return gen;
+}
+
+lua_State * rv_lang_state_checkout (Relview * rv)
+{
+	WorkspaceSync * sync = rv_get_workspace_sync (rv);
+	gulong gen = workspace_sync_get_generation (sync);
+	lua_State * L;
 
-	lua_State * L = rv_lang_new_state (self);
+	if ( !rv->L_pool) rv->L_pool = g_queue_new ();
+
+	L = (lua_State*) g_queue_pop_head (rv->L_pool);
 	if ( !L) {
+		L = rv_lang_new_state (rv);
+		if ( !L) return NULL;
+		_rv_lang_snapshot (L);
+	}
+	else if (_rv_lang_get_generation (L) != gen) {
+		_rv_lang_sync (rv, L, _rv_lang_get_generation (L));
+		_rv_lang_snapshot (L);
+	}
+
+	_rv_lang_set_generation (L, gen);
+	return L;
+}
+
+void rv_lang_state_return (Relview * rv, lua_State * L)
+{
+	if ( !rv->L_pool || g_queue_get_length (rv->L_pool) >= RV_LANG_POOL_SIZE)
+		kure_lua_destroy (L);
+	else {
+		_rv_lang_restore (L);
+		g_queue_push_head (rv->L_pool, L);
+	}
+}
+
+/*!
+ * Returns the end of the identifier which starts at p, or p if there is none.
+ * The names of the global \ref Namespace (see _filter_func) are identifiers.
+ * Like in Kure's parser, an identifier may contain hyphens between its other
+ * characters too, e.g. the built-ins part-f and tot-f.
+ */
+static const gchar * _scan_identifier (const gchar * p)
+{
+	const gchar * q = p;
+
+	if ( !g_ascii_isalpha ((guchar) *q) && '_' != *q)
+		return p;
+
+	for (q ++ ; ; q ++) {
+		if ('-' == *q && (g_ascii_isalnum ((guchar) q[1]) || '_' == q[1]))
+			q ++;
+		else if ( !g_ascii_isalnum ((guchar) *q) && '_' != *q)
+			return q;
+	}
+}
+
+/*!
+ * Calls func for each identifier in the term until it returns TRUE. See
+ * _scan_identifier. Returns TRUE if func has returned TRUE.
+ */
+static gboolean _term_foreach_identifier (const gchar * term,
+		gboolean (*func) (const gchar * ident, gpointer user_data),
+		gpointer user_data)
+{
+	const gchar * p = term;
+
+	while (*p) {
+		const gchar * end = _scan_identifier (p);
+
+		if ('$' == *p) {
+			if (func ("$", user_data)) return TRUE;
+			p ++;
+		}
+		else if (end != p) {
+			gchar * ident = g_strndup (p, end - p);
+			gboolean stop = func (ident, user_data);
+
+			g_free (ident);
+			if (stop) return TRUE;
+			p = end;
+		}
+		else p ++;
+	}
+	return FALSE;
+}
+
+static gboolean _is_in_table (const gchar * ident, GHashTable * names)
+{ return g_hash_table_lookup (names, ident) != NULL; }
+
+gboolean rv_lang_term_mentions (const gchar * term, GHashTable * names)
+{
+	return _term_foreach_identifier (term, (gboolean(*)(const gchar*,gpointer))
+			_is_in_table, names);
+}
+
+static gboolean _add_to_set (const gchar * ident, GHashTable * set)
+{
+	if ( !g_hash_table_lookup (set, ident)) {
+		gchar * key = g_strdup (ident);
+		g_hash_table_insert (set, key, key);
+	}
+	return FALSE;
+}
+
+void rv_lang_term_collect_identifiers (const gchar * term, GHashTable * set)
+{
+	_term_foreach_identifier (term, (gboolean(*)(const gchar*,gpointer))
+			_add_to_set, set);
+}
+
+
+KureRel * rv_lang_eval (Relview * self, const char * expr, GError ** perr)
+{
+	lua_State * env = rv_lang_new_env (self);
+	if ( !env) {
 		g_set_error(perr, rv_error_domain(), 0, "Unable to create Lua state.");
 		return NULL;
 	}
 	else {
 		KureError * kerr = NULL;
-		KureRel * impl = kure_lang_exec(L, expr, &kerr);
+		KureRel * impl = kure_lang_exec(env, expr, &kerr);
 		if (!impl) {
 			g_set_error_literal (perr, rv_error_domain(), 0, kerr->message);
 			kure_error_destroy (kerr);
 		}
-		else kure_lua_destroy(L);
+		rv_lang_env_destroy (self, env);
 
 		return impl;
 	}
@@ -0,0 +1,155 @@
+/*
+ * TimeProgLoad.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Compares the ways to load program files and to get their functions and
+ * programs into Lua. It isn't installed. Build it with
+ * "make time-prog-load" and run it as
+ *
+ *     ./time-prog-load <dir>
+ *
+ * e.g. on data/programs. */
+
+#include "Relview.h"
+#include "Function.h"
+#include "Program.h"
+#include "file_ops.h"
+#include "FileLoader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+#include <lauxlib.h> // luaL_loadbuffer
+
+
+#define TIME_PROG_LOAD_ROUNDS 20
+
+/*!
+ * Loads each function and program into a fresh Lua state, once from the
+ * Lua code and once from the bytecode (see rv_lang_compile). Returns the
+ * time in seconds.
+ */
+static gdouble _time_lua_load (Relview * rv, gboolean use_bytecode)
+{
+	lua_State * L = luaL_newstate ();
+	GTimer * timer = g_timer_new ();
+	gdouble secs;
+	int round;
+
+	for (round = 0 ; round < TIME_PROG_LOAD_ROUNDS ; ++round) {
+		FOREACH_FUN(rv_get_fun_manager(rv), cur, iter, {
+			size_t size;
+			const gchar * code = fun_get_luacode (cur, &size);
+			const gchar * bin = use_bytecode ? fun_get_luabin (cur, &size) : code;
+			if ( !luaL_loadbuffer (L, bin, size, code)) lua_pop (L, 1);
+		});
+		FOREACH_PROG(rv_get_prog_manager(rv), cur, iter, {
+			size_t size;
+			const gchar * code = prog_get_luacode (cur, &size);
+			const gchar * bin = use_bytecode ? prog_get_luabin (cur, &size) : code;
+			if ( !luaL_loadbuffer (L, bin, size, code)) lua_pop (L, 1);
+		});
+	}
+
+	secs = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+	lua_close (L);
+	return secs;
+}
+
+
+/*!
+ * Timing driver for the program files in the given directory (e.g.
+ * data/programs). Prints the time to load the files with the program cache
+ * disabled and enabled, and the time to load the resulting objects into
+ * Lua from the Lua code and from the bytecode. The bytecode is compiled
+ * before it's timed.
+ */
+static void _time_prog_load (Relview * rv, FileLoader * loader, const gchar * dirname)
+{
+	GError * err = NULL;
+	GDir * dir = g_dir_open (dirname, 0, &err);
+	GSList * paths = NULL, * iter;
+	const gchar * name;
+	int pass;
+
+	if ( !dir) {
+		fprintf (stderr, "Unable to open \"%s\". Reason: %s\n", dirname, err->message);
+		g_error_free (err);
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir)))
+		if (g_str_has_suffix (name, ".prog"))
+			paths = g_slist_prepend (paths, g_build_filename (dirname, name, NULL));
+	g_dir_close (dir);
+
+	/* The first pass with the cache enabled writes the cache files, the
+	 * second one reads them. */
+	for (pass = 0 ; pass < 3 ; ++pass) {
+		gboolean cache = (pass > 0);
+		GTimer * timer = g_timer_new ();
+
+		prog_file_set_cache_enabled (cache);
+		for (iter = paths ; iter ; iter = iter->next) {
+			if ( !file_loader_load_file (loader, (gchar*) iter->data, &err)) {
+				fprintf (stderr, "Error loading \"%s\". Reason: %s\n",
+						(gchar*) iter->data, err->message);
+				g_clear_error (&err);
+			}
+		}
+		printf ("files: %u, program cache %s%s: %.3fs\n", g_slist_length (paths),
+				cache ? "enabled" : "disabled", 2 == pass ? " (warm)" : "",
+				g_timer_elapsed (timer, NULL));
+		g_timer_destroy (timer);
+	}
+
+	/* Compile everything before the bytecode is timed. */
+	_time_lua_load (rv, TRUE);
+	printf ("functions: %d, programs: %d, rounds: %d\n",
+			fun_manager_size (rv_get_fun_manager(rv)),
+			prog_manager_size (rv_get_prog_manager(rv)), TIME_PROG_LOAD_ROUNDS);
+	printf ("lua code: %.3fs\n", _time_lua_load (rv, FALSE));
+	printf ("bytecode: %.3fs\n", _time_lua_load (rv, TRUE));
+
+	g_slist_foreach (paths, (GFunc) g_free, NULL);
+	g_slist_free (paths);
+}
+
+
+int main (int argc, char ** argv)
+{
+  FileLoader * loader;
+
+  if (argc != 2) {
+	  fprintf (stderr, "Usage: %s <dir>\n", argv[0]);
+	  return 1;
+  }
+
+  /* The same setup as in main.c. */
+  g_thread_init (NULL);
+  gdk_threads_init();
+  gtk_init (& argc, & argv);
+  rv_init (argc, argv);
+
+  loader = file_loader_new (rv_get_instance());
+  file_loader_set_replace_policy (loader, RV_REPLACE_POLICY_REPLACE_ALL);
+
+  _time_prog_load (rv_get_instance(), loader, argv[1]);
+  file_loader_destroy (loader);
+  return 0;
+}
@@ -0,0 +1,354 @@
+/*
+ * WorkerPool.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "WorkerPool.h"
+#include "Semaphore.h"
+#include "Relview.h" /* rv_error_domain, VERBOSE */
+
+#include <gdk/gdk.h> /* gdk_threads_add_timeout */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+/* Delay in ms before stale or missing workers are replaced. Changes to the
+ * workspace often come in bursts (e.g. loading a file). */
+#define WORKER_POOL_REFILL_DELAY 500
+
+struct _Worker
+{
+	pid_t pid;
+	int semId;
+	FILE * requests; /*!< Parent -> worker */
+	FILE * results; /*!< Worker -> parent */
+	gulong generation; /*!< Pool generation at fork time. */
+	gpointer data; /*!< See worker_set_data */
+};
+
+struct _WorkerPool
+{
+	const WorkerPoolClass * c;
+	gpointer user_data;
+
+	guint size;
+	gulong generation;
+
+	GList/*<Worker*>*/ * idle;
+	GList/*<Worker*>*/ * busy;
+
+	guint refill_source; /*!< 0 if no refill is pending. */
+};
+
+static gboolean _worker_pool_refill (gpointer data);
+
+
+pid_t worker_get_pid (Worker * self) { return self->pid; }
+int worker_get_sem_id (Worker * self) { return self->semId; }
+FILE * worker_get_requests (Worker * self) { return self->requests; }
+FILE * worker_get_results (Worker * self) { return self->results; }
+gpointer worker_get_data (Worker * self) { return self->data; }
+void worker_set_data (Worker * self, gpointer data) { self->data = data; }
+
+
+/*!
+ * Closes the streams to the worker, kills it (if not already dead) and waits
+ * for it to prevent a zombie.
+ */
+static void _worker_destroy (Worker * self, WorkerPool * pool)
+{
+	int ret, status;
+
+	VERBOSE(VERBOSE_DEBUG, printf ("Terminating evaluation worker (pid: %d).\n", self->pid);)
+
+	kill (self->pid, SIGKILL);
+	fclose (self->requests);
+	fclose (self->results);
+
+	do {
+		ret = waitpid (self->pid, &status, 0);
+	} while (ret < 0 && EINTR == errno);
+	if (ret < 0)
+		perror ("waitpid [_worker_destroy]");
+
+	Semaphore_destroy (self->semId);
+
+	if (pool->c->exited)
+		pool->c->exited (self, pool->user_data);
+	g_free (self);
+}
+
+
+/*!
+ * Returns TRUE if the worker process has already terminated, e.g. because
+ * it crashed while it was idle. The process is reaped in this case.
+ */
+static gboolean _worker_is_dead (Worker * self)
+{
+	int status;
+	return waitpid (self->pid, &status, WNOHANG) == self->pid;
+}
+
+
+/*!
+ * Closes all descriptors in the (child) process which belong to other
+ * workers. Otherwise, a worker would never see EOF on a sibling's pipes.
+ */
+static void _worker_pool_close_inherited (WorkerPool * self)
+{
+	GList * lists[] = { self->idle, self->busy }, *iter;
+	int i;
+
+	for (i = 0 ; i < 2 ; ++i) {
+		for (iter = lists[i] ; iter ; iter = iter->next) {
+			Worker * w = (Worker*) iter->data;
+			close (fileno (w->requests));
+			close (fileno (w->results));
+		}
+	}
+}
+
+
+/*!
+ * Forks a new worker process. The returned worker is neither idle nor busy.
+ */
+static Worker * _worker_pool_spawn (WorkerPool * self, GError ** perr)
+{
+	gpointer state;
+	int req[2], res[2];
+	int semId;
+	pid_t pid;
+
+	state = self->c->prepare (self->user_data);
+	if ( !state) {
+		g_set_error_literal (perr, rv_error_domain(), 0,
+				"Unable to prepare the state for a worker process.");
+		return NULL;
+	}
+
+	if (pipe (req) != 0) {
+		g_set_error_literal (perr, rv_error_domain(), 0, g_strerror(errno));
+		self->c->release (NULL, state, self->user_data);
+		return NULL;
+	}
+	if (pipe (res) != 0) {
+		g_set_error_literal (perr, rv_error_domain(), 0, g_strerror(errno));
+		close (req[0]); close (req[1]);
+		self->c->release (NULL, state, self->user_data);
+		return NULL;
+	}
+
+	semId = Semaphore_new_private (S_IWUSR | S_IRUSR, 0 /* initial value */);
+
+	pid = fork ();
+	if (-1 == pid) {
+		g_set_error_literal (perr, rv_error_domain(), 0, g_strerror(errno));
+		close (req[0]); close (req[1]);
+		close (res[0]); close (res[1]);
+		Semaphore_destroy (semId);
+		self->c->release (NULL, state, self->user_data);
+		return NULL;
+	}
+	else if (0 == pid) /* worker */ {
+		FILE * requests, * results;
+
+		close (req[1]);
+		close (res[0]);
+		_worker_pool_close_inherited (self);
+
+		requests = fdopen (req[0], "r");
+		results = fdopen (res[1], "w");
+
+		self->c->main (state, requests, results, semId, self->user_data);
+
+		fclose (requests);
+		fclose (results);
+		exit (0);
+	}
+	else /* parent */ {
+		Worker * w = g_new0 (Worker, 1);
+
+		close (req[0]);
+		close (res[1]);
+
+		w->pid = pid;
+		w->semId = semId;
+		w->requests = fdopen (req[1], "w");
+		w->results = fdopen (res[0], "r");
+		w->generation = self->generation;
+
+		self->c->release (w, state, self->user_data);
+
+		VERBOSE(VERBOSE_DEBUG, printf ("Started evaluation worker (pid: %d).\n", pid);)
+		return w;
+	}
+}
+
+
+static void _worker_pool_schedule_refill (WorkerPool * self)
+{
+	if (self->refill_source)
+		g_source_remove (self->refill_source);
+
+	self->refill_source = gdk_threads_add_timeout (WORKER_POOL_REFILL_DELAY,
+			_worker_pool_refill, self);
+}
+
+
+/*!
+ * Replaces stale idle workers and forks new ones until the pool is full.
+ */
+static gboolean _worker_pool_refill (gpointer data)
+{
+	WorkerPool * self = (WorkerPool*) data;
+	GList * iter = self->idle;
+
+	self->refill_source = 0;
+
+	while (iter) {
+		GList * next = iter->next;
+		Worker * w = (Worker*) iter->data;
+
+		if (w->generation != self->generation || _worker_is_dead(w)) {
+			self->idle = g_list_delete_link (self->idle, iter);
+			_worker_destroy (w, self);
+		}
+		iter = next;
+	}
+
+	while (g_list_length (self->idle) + g_list_length (self->busy) < self->size) {
+		GError * err = NULL;
+		Worker * w = _worker_pool_spawn (self, &err);
+		if ( !w) {
+			/* Try again on the next request or change. */
+			g_warning ("Unable to start evaluation worker. Reason: %s", err->message);
+			g_error_free (err);
+			break;
+		}
+		else self->idle = g_list_prepend (self->idle, w);
+	}
+
+	return FALSE;
+}
+
+
+WorkerPool * worker_pool_new (guint size, const WorkerPoolClass * c,
+		gpointer user_data)
+{
+	WorkerPool * self = g_new0 (WorkerPool, 1);
+	self->c = c;
+	self->user_data = user_data;
+	self->size = MAX(1, size);
+
+	/* Writing to a worker which has died otherwise terminates us. */
+	signal (SIGPIPE, SIG_IGN);
+
+	_worker_pool_schedule_refill (self);
+	return self;
+}
+
+
+void worker_pool_destroy (WorkerPool * self)
+{
+	if (self->refill_source)
+		g_source_remove (self->refill_source);
+
+	g_list_foreach (self->idle, (GFunc) _worker_destroy, self);
+	g_list_foreach (self->busy, (GFunc) _worker_destroy, self);
+	g_list_free (self->idle);
+	g_list_free (self->busy);
+	g_free (self);
+}
+
+
+void worker_pool_set_size (WorkerPool * self, guint size)
+{
+	self->size = MAX(1, size);
+
+	while (self->idle && g_list_length (self->idle)
+			+ g_list_length (self->busy) > self->size) {
+		_worker_destroy ((Worker*) self->idle->data, self);
+		self->idle = g_list_delete_link (self->idle, self->idle);
+	}
+
+	_worker_pool_schedule_refill (self);
+}
+
+guint worker_pool_get_size (WorkerPool * self) { return self->size; }
+
+
+Worker * worker_pool_acquire (WorkerPool * self, GError ** perr)
+{
+	Worker * w = NULL;
+
+	while (self->idle && !w) {
+		Worker * cur = (Worker*) self->idle->data;
+		self->idle = g_list_delete_link (self->idle, self->idle);
+
+		if (cur->generation != self->generation || _worker_is_dead(cur))
+			_worker_destroy (cur, self);
+		else w = cur;
+	}
+
+	if ( !w) {
+		w = _worker_pool_spawn (self, perr);
+		if ( !w) return NULL;
+	}
+
+	self->busy = g_list_prepend (self->busy, w);
+
+	/* Keep the pool warm for the next request. */
+	_worker_pool_schedule_refill (self);
+
+	return w;
+}
+
+
+void worker_pool_release (WorkerPool * self, Worker * worker)
+{
+	self->busy = g_list_remove (self->busy, worker);
+
+	if (worker->generation != self->generation
+			|| g_list_length (self->idle) + g_list_length (self->busy) >= self->size) {
+		_worker_destroy (worker, self);
+		_worker_pool_schedule_refill (self);
+	}
+	else self->idle = g_list_prepend (self->idle, worker);
+}
+
+
+void worker_pool_kill (WorkerPool * self, Worker * worker)
+{
+	VERBOSE(VERBOSE_DEBUG, printf ("Killing evaluation worker (pid: %d).\n", worker->pid);)
+
+	self->busy = g_list_remove (self->busy, worker);
+	self->idle = g_list_remove (self->idle, worker);
+	_worker_destroy (worker, self);
+
+	_worker_pool_schedule_refill (self);
+}
+
+
+void worker_pool_invalidate (WorkerPool * self)
+{
+	self->generation ++;
+	_worker_pool_schedule_refill (self);
+}
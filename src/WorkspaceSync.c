@@ -0,0 +1,314 @@
+/*
+ * WorkspaceSync.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "WorkspaceSync.h"
+#include "Relation.h"
+#include "Function.h"
+#include "Program.h"
+#include "Domain.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _WorkspaceSyncEntry
+{
+	gchar * name;
+	WorkspaceSyncKind kind; /*!< Kind of the last change. */
+	gulong generation; /*!< Generation of the last change. */
+} WorkspaceSyncEntry;
+
+struct _WorkspaceSync
+{
+	Relview * rv;
+	gulong generation;
+
+	GHashTable/*<gchar*,WorkspaceSyncEntry*>*/ * entries;
+
+	/* Entries in the order of their last change. The most recent change
+	 * is at the tail. */
+	GQueue/*<WorkspaceSyncEntry*>*/ * order;
+	GHashTable/*<WorkspaceSyncEntry*,GList*>*/ * links;
+
+	/* The identifiers mentioned by the components of each domain and the
+	 * other way round. Updated only for the domains which change. */
+	GHashTable/*<gchar*,GHashTable<gchar*,gchar*>*>*/ * dom_mentions;
+	GHashTable/*<gchar*,GHashTable<gchar*,gchar*>*>*/ * dom_users;
+
+	RelManagerObserver rel_observer;
+	FunManagerObserver fun_observer;
+	ProgManagerObserver prog_observer;
+	DomManagerObserver dom_observer;
+};
+
+
+static void _workspace_sync_entry_destroy (WorkspaceSyncEntry * self)
+{
+	g_free (self->name);
+	g_free (self);
+}
+
+/* A set of strings. Each key is its own value. */
+static GHashTable * _string_set_new ()
+{ return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL); }
+
+
+/*!
+ * Returns the current object with the given name and kind, or NULL.
+ */
+static gpointer _workspace_sync_lookup (WorkspaceSync * self,
+		WorkspaceSyncKind kind, const gchar * name)
+{
+	switch (kind) {
+	case WORKSPACE_SYNC_RELATION:
+		return rel_manager_get_by_name (rv_get_rel_manager(self->rv), name);
+	case WORKSPACE_SYNC_FUNCTION:
+		return fun_manager_get_by_name (fun_manager_get_instance(), name);
+	case WORKSPACE_SYNC_PROGRAM:
+		return prog_manager_get_by_name (prog_manager_get_instance(), name);
+	case WORKSPACE_SYNC_DOMAIN:
+		return dom_manager_get_by_name (rv_get_dom_manager(self->rv), name);
+	default: return NULL;
+	}
+}
+
+
+/*!
+ * Records a change of the object with the given name.
+ */
+static void _workspace_sync_touch (WorkspaceSync * self, const gchar * name,
+		WorkspaceSyncKind kind)
+{
+	WorkspaceSyncEntry * e = g_hash_table_lookup (self->entries, name);
+
+	if ( !e) {
+		e = g_new0 (WorkspaceSyncEntry, 1);
+		e->name = g_strdup (name);
+		g_hash_table_insert (self->entries, e->name, e);
+	}
+	else {
+		GList * link = g_hash_table_lookup (self->links, e);
+		g_queue_delete_link (self->order, link);
+	}
+
+	e->kind = kind;
+	e->generation = ++ self->generation;
+	g_queue_push_tail (self->order, e);
+	g_hash_table_insert (self->links, e, g_queue_peek_tail_link (self->order));
+}
+
+
+/*!
+ * Updates the identifiers the given domain mentions. The domain is gone
+ * if it doesn't belong to the manager anymore.
+ */
+static void _workspace_sync_update_dom (WorkspaceSync * self,
+		const gchar * name)
+{
+	GHashTable * mentions = g_hash_table_lookup (self->dom_mentions, name);
+	Dom * dom = dom_manager_get_by_name (rv_get_dom_manager(self->rv), name);
+	GHashTableIter iter;
+	gpointer ident;
+
+	if (mentions) {
+		g_hash_table_iter_init (&iter, mentions);
+		while (g_hash_table_iter_next (&iter, &ident, NULL)) {
+			GHashTable * users = g_hash_table_lookup (self->dom_users, ident);
+			if (users) {
+				g_hash_table_remove (users, name);
+				if (g_hash_table_size (users) == 0)
+					g_hash_table_remove (self->dom_users, ident);
+			}
+		}
+		g_hash_table_remove (self->dom_mentions, name);
+	}
+
+	if (dom && dom_get_manager (dom)) {
+		mentions = _string_set_new ();
+		rv_lang_term_collect_identifiers (dom_get_first_comp(dom), mentions);
+		rv_lang_term_collect_identifiers (dom_get_second_comp(dom), mentions);
+		g_hash_table_insert (self->dom_mentions, g_strdup (name), mentions);
+
+		g_hash_table_iter_init (&iter, mentions);
+		while (g_hash_table_iter_next (&iter, &ident, NULL)) {
+			GHashTable * users = g_hash_table_lookup (self->dom_users, ident);
+			if ( !users) {
+				users = _string_set_new ();
+				g_hash_table_insert (self->dom_users, g_strdup (ident), users);
+			}
+			if ( !g_hash_table_lookup (users, name)) {
+				gchar * key = g_strdup (name);
+				g_hash_table_insert (users, key, key);
+			}
+		}
+	}
+}
+
+
+static void _workspace_sync_rel_entry_changed (WorkspaceSync * self,
+		RelManager * manager, const gchar * name)
+{ _workspace_sync_touch (self, name, WORKSPACE_SYNC_RELATION); }
+
+static void _workspace_sync_rel_changed (WorkspaceSync * self,
+		RelManager * manager, Rel * rel)
+{ _workspace_sync_touch (self, rel_get_name (rel), WORKSPACE_SYNC_RELATION); }
+
+static void _workspace_sync_fun_entry_changed (WorkspaceSync * self,
+		FunManager * manager, const gchar * name)
+{ _workspace_sync_touch (self, name, WORKSPACE_SYNC_FUNCTION); }
+
+static void _workspace_sync_prog_entry_changed (WorkspaceSync * self,
+		ProgManager * manager, const gchar * name)
+{ _workspace_sync_touch (self, name, WORKSPACE_SYNC_PROGRAM); }
+
+static void _workspace_sync_dom_entry_changed (WorkspaceSync * self,
+		DomManager * manager, const gchar * name)
+{
+	_workspace_sync_touch (self, name, WORKSPACE_SYNC_DOMAIN);
+	_workspace_sync_update_dom (self, name);
+}
+
+
+WorkspaceSync * workspace_sync_new (Relview * rv)
+{
+	WorkspaceSync * self = g_new0 (WorkspaceSync, 1);
+
+	self->rv = rv;
+	self->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+			(GDestroyNotify) _workspace_sync_entry_destroy);
+	self->order = g_queue_new ();
+	self->links = g_hash_table_new (g_direct_hash, g_direct_equal);
+	self->dom_mentions = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify) g_hash_table_destroy);
+	self->dom_users = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify) g_hash_table_destroy);
+
+	FOREACH_DOM(rv_get_dom_manager(rv), cur, iter, {
+		_workspace_sync_update_dom (self, dom_get_name(cur));
+	});
+
+	self->rel_observer.relChanged
+		= (RelManagerObserver_relChangedFunc) _workspace_sync_rel_changed;
+	self->rel_observer.entryChanged
+		= (RelManagerObserver_entryChangedFunc) _workspace_sync_rel_entry_changed;
+	self->rel_observer.object = self;
+	rel_manager_register_observer (rv_get_rel_manager(rv), &self->rel_observer);
+
+	self->fun_observer.entryChanged
+		= (FunManagerObserver_entryChangedFunc) _workspace_sync_fun_entry_changed;
+	self->fun_observer.object = self;
+	fun_manager_register_observer (fun_manager_get_instance(), &self->fun_observer);
+
+	self->prog_observer.entryChanged
+		= (ProgManagerObserver_entryChangedFunc) _workspace_sync_prog_entry_changed;
+	self->prog_observer.object = self;
+	prog_manager_register_observer (prog_manager_get_instance(), &self->prog_observer);
+
+	self->dom_observer.entryChanged
+		= (DomManagerObserver_entryChangedFunc) _workspace_sync_dom_entry_changed;
+	self->dom_observer.object = self;
+	dom_manager_register_observer (rv_get_dom_manager(rv), &self->dom_observer);
+
+	return self;
+}
+
+
+void workspace_sync_destroy (WorkspaceSync * self)
+{
+	rel_manager_unregister_observer (rv_get_rel_manager(self->rv), &self->rel_observer);
+	fun_manager_unregister_observer (fun_manager_get_instance(), &self->fun_observer);
+	prog_manager_unregister_observer (prog_manager_get_instance(), &self->prog_observer);
+	dom_manager_unregister_observer (rv_get_dom_manager(self->rv), &self->dom_observer);
+
+	g_hash_table_destroy (self->dom_users);
+	g_hash_table_destroy (self->dom_mentions);
+	g_hash_table_destroy (self->links);
+	g_queue_free (self->order);
+	g_hash_table_destroy (self->entries);
+	g_free (self);
+}
+
+
+gulong workspace_sync_get_generation (WorkspaceSync * self)
+{ return self->generation; }
+
+
+guint workspace_sync_foreach_change (WorkspaceSync * self, gulong since,
+		WorkspaceSyncFunc func, gpointer user_data)
+{
+	GHashTable/*<const gchar*,WorkspaceSyncEntry*>*/ * changed
+		= g_hash_table_new (g_str_hash, g_str_equal);
+	GList * iter, *changes = NULL;
+	guint count = 0;
+
+	/* The entries after the given generation are at the tail of the queue.
+	 * Collect them in their original order. */
+	for (iter = g_queue_peek_tail_link (self->order) ; iter ; iter = iter->prev) {
+		WorkspaceSyncEntry * e = (WorkspaceSyncEntry*) iter->data;
+		if (e->generation <= since) break;
+		changes = g_list_prepend (changes, e);
+		g_hash_table_insert (changed, e->name, e);
+	}
+
+	if ( !changes) {
+		g_hash_table_destroy (changed);
+		return 0;
+	}
+
+	for (iter = changes ; iter ; iter = iter->next) {
+		WorkspaceSyncEntry * e = (WorkspaceSyncEntry*) iter->data;
+		if (e->kind != WORKSPACE_SYNC_DOMAIN) {
+			func (e->name, e->kind, _workspace_sync_lookup (self, e->kind, e->name),
+					user_data);
+			count ++;
+		}
+	}
+
+	for (iter = changes ; iter ; iter = iter->next) {
+		WorkspaceSyncEntry * e = (WorkspaceSyncEntry*) iter->data;
+		if (e->kind == WORKSPACE_SYNC_DOMAIN) {
+			func (e->name, e->kind, _workspace_sync_lookup (self, e->kind, e->name),
+					user_data);
+			count ++;
+		}
+	}
+
+	/* A domain's size depends on its components. Only the domains which
+	 * mention a changed name are visited. */
+	for (iter = changes ; iter ; iter = iter->next) {
+		WorkspaceSyncEntry * e = (WorkspaceSyncEntry*) iter->data;
+		GHashTable * users = g_hash_table_lookup (self->dom_users, e->name);
+		GHashTableIter userIter;
+		gpointer dom_name;
+
+		if ( !users) continue;
+
+		g_hash_table_iter_init (&userIter, users);
+		while (g_hash_table_iter_next (&userIter, &dom_name, NULL)) {
+			if ( !g_hash_table_lookup (changed, dom_name)) {
+				func (dom_name, WORKSPACE_SYNC_DOMAIN, _workspace_sync_lookup
+						(self, WORKSPACE_SYNC_DOMAIN, dom_name), user_data);
+				g_hash_table_insert (changed, dom_name, dom_name);
+				count ++;
+			}
+		}
+	}
+
+	g_list_free (changes);
+	g_hash_table_destroy (changed);
+	return count;
+}
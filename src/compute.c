@@ -25,6 +25,16 @@
 #include "Relation.h"
 #include "RelationWindow.h"
 #include "Semaphore.h"
+#include "WorkerPool.h"
+#include "BddTransfer.h"
+#include "WorkspaceSync.h"
+#include "EvalMetrics.h"
+#include "EvalProfile.h"
+#include "Function.h"
+#include "Program.h"
+#include "Domain.h"
+#include "prefs.h"
+#include "Observer.h"
 #include "DebugWindow.h" /* debug_window_assert_failed_func */
 #include "Relview.h" /* rv_ask_rel_name, rv_get_gtk_builder */
 
@@ -42,6 +52,7 @@
 #include <sys/stat.h>
 #include <gtk/gtk.h>
 #include <setjmp.h>
+#include <lauxlib.h> // luaL_loadbuffer
 
 /* Linux' POSIX sempahore implementation doesn't support process
  * level semaphores.  */
@@ -82,7 +93,9 @@ static double _timer_user_secs_elapsed (Timer * t)
 //{ return (t->tms2.tms_stime - t->tms1.tms_stime) / (double) sysconf(_SC_CLK_TCK); }
 
 
-static gchar * _format_timings (Timer * timer)
+/*! Formats the timings for the "EVAL-TIME" output. The metrics of the
+ * BDD manager are appended, if given. */
+static gchar * _format_timings (Timer * timer, const EvalMetrics * metrics)
 {
 	double secs = _timer_secs_elapsed(timer);
 	double user_secs = _timer_user_secs_elapsed(timer);
@@ -111,11 +124,31 @@ static gchar * _format_timings (Timer * timer)
 	else ret = g_strdup_printf ("EVAL-TIME: %s sec.", s);
 
 	g_free (s);
+
+	if (metrics) {
+		gchar * mstr = eval_metrics_format (metrics);
+		s = ret;
+		ret = g_strdup_printf ("%s; %s", s, mstr);
+		g_free (s);
+		g_free (mstr);
+	}
 	return ret;
 }
 
 
 
+/* Number of operations shown in the "PROFILE" output. */
+#define EVAL_PROFILE_MAX_ROWS 20
+
+static void _print_profile (EvalProfile * profile)
+{
+	gchar * table = eval_profile_format (profile, EVAL_PROFILE_MAX_ROWS);
+	printf ("PROFILE:\n%s", table);
+	printf ("-------------------------------------------\n");
+	g_free (table);
+}
+
+
 /*******************************************************************************
  *                            Parallel Computation                             *
  *                                                                             *
@@ -165,7 +198,8 @@ typedef enum _RvStatusCode
   SUCCESS,
   SYNTAX_ERROR,
   EVAL_ERROR,
-  USER_CANCELATION
+  USER_CANCELATION,
+  FATAL_ERROR /*!< The worker is in an unknown state and must be killed. */
 } RvStatusCode;
 
 
@@ -205,658 +239,2487 @@ static gboolean read_message (FILE * fp, char ** pmsg)
 	}
 }
 
-/*! Process for the computation of a given term.
+/* How the result's BDD is passed to the parent. See _compute_terms_process. */
+typedef enum _RvTransferMode
+{
+  TRANSFER_DDDMP = 0, /*!< Dddmp text format through the pipe. */
+  TRANSFER_SHM /*!< Node table in a shared memory object. See BddTransfer.h */
+} RvTransferMode;
+
+static int write_transfer_mode (FILE * fp, RvTransferMode mode)
+{ return fprintf (fp, "%4d", (int)mode); }
+
+static int read_transfer_mode (FILE * fp, RvTransferMode * /*out*/ pmode)
+{ return fscanf (fp, "%4d", (int*)pmode); }
+
+/*! Writes a string of arbitrary length. See also \ref read_string. */
+static gboolean write_string (FILE * fp, const char * str, size_t len)
+{
+	fprintf (fp, "%8u", (unsigned int) len);
+	return len == 0 || 1 == fwrite (str, len, 1, fp);
+}
+
+/*! Reads a string written by \ref write_string. The string must be freed
+ * using \ref g_free. The length is optional.
+ */
+static gboolean read_string (FILE * fp, char ** pstr, size_t * plen)
+{
+	unsigned int len;
+
+	if (1 != fscanf (fp, "%8u", &len)) return FALSE;
+
+	*pstr = g_new0 (gchar, len + 1/*\0*/);
+	if (len > 0 && 1 != fread (*pstr, len, 1, fp)) {
+		g_free (*pstr);
+		*pstr = NULL;
+		return FALSE;
+	}
+	if (plen) *plen = len;
+	return TRUE;
+}
+
+/*! Sends terms to a worker process. They are evaluated in the given order
+ * and each result is bound to the corresponding name for the following
+ * terms. The current random numbers are sent along with the terms, so the
+ * worker continues with the same random numbers as the main process would.
+ * Returns FALSE if the worker is gone.
+ *
+ * \author stb
+ * \param fp The request stream of the worker.
+ * \param terms The terms to compute.
+ * \param relNames The names of the results.
+ * \param count The number of terms.
+ * \param flags Flags for the evaluation, e.g. RV_COMPUTE_FLAGS_PROFILE.
+ */
+static gboolean write_request (FILE * fp, gchar ** terms, gchar ** relNames,
+		guint count, RvComputeFlags flags)
+{
+	int r = random();
+	long int cudd_r = Cudd_Random();
+	guint i;
+
+	fprintf (fp, "%8u", count);
+	for (i = 0 ; i < count ; ++i) {
+		write_string (fp, terms[i], strlen (terms[i]));
+		write_string (fp, relNames[i], strlen (relNames[i]));
+	}
+	fprintf (fp, " %d %ld %d\n", r, cudd_r, (int) flags);
+	return 0 == fflush (fp) && !ferror (fp);
+}
+
+/*! Reads a request written by \ref write_request. Returns FALSE on EOF. The
+ * terms and the names must be freed using \ref g_strfreev.
+ */
+static gboolean read_request (FILE * fp, gchar *** pterms, gchar *** prelNames,
+		guint * pcount, int * pr, long int * pcudd_r, RvComputeFlags * pflags)
+{
+	unsigned int count, i;
+	gboolean ok = TRUE;
+
+	if (1 != fscanf (fp, "%8u", &count)) return FALSE;
+
+	*pterms = g_new0 (gchar*, count + 1);
+	*prelNames = g_new0 (gchar*, count + 1);
+	for (i = 0 ; ok && i < count ; ++i) {
+		ok = read_string (fp, &(*pterms)[i], NULL)
+				&& read_string (fp, &(*prelNames)[i], NULL);
+	}
+
+	/* No trailing whitespace in the format. It would block until the
+	 * next request arrives. */
+	if ( !ok || 3 != fscanf (fp, " %d %ld %d", pr, pcudd_r, (int*) pflags)) {
+		g_strfreev (*pterms);
+		g_strfreev (*prelNames);
+		return FALSE;
+	}
+
+	*pcount = count;
+	return TRUE;
+}
+
+/* Entries of the workspace synchronization which precedes each request.
+ * See _eval_worker_write_sync and _eval_worker_read_sync. */
+typedef enum _RvSyncOp
+{
+  SYNC_DELETE = 0,
+  SYNC_REL, /*!< The BDD is transfered through a shared memory object. */
+  SYNC_FUN,
+  SYNC_PROG,
+  SYNC_DOM
+} RvSyncOp;
+
+/*! Lua name of a global object. */
+static const gchar * _lua_global_name (const gchar * name)
+{ return g_str_equal (name, "$") ? KURE_DOLLAR_SUBST : name; }
+
+
+/* Interval in ms in which a worker publishes the metrics of its BDD
+ * manager during an evaluation. */
+#define EVAL_METRICS_INTERVAL 250
+
+/* Only used in the worker processes. See _compute_terms_process. */
+static EvalMetricsChannel * _worker_metrics = NULL;
+static EvalMetricsProbe _worker_probe;
+
+static void _worker_metrics_alarm_handler (int sig)
+{
+	if (_worker_metrics)
+		eval_metrics_channel_publish (_worker_metrics,
+				eval_metrics_probe_sample (&_worker_probe));
+}
+
+/*! Starts or stops to publish the metrics of the given manager
+ * periodically. A timer signal is used, because the evaluation can't be
+ * interrupted otherwise. */
+static void _worker_metrics_set_active (DdManager * manager, gboolean active)
+{
+	struct itimerval it = {{0}};
+
+	if (active) {
+		struct sigaction sa;
+
+		memset (&sa, 0, sizeof (sa));
+		sa.sa_handler = _worker_metrics_alarm_handler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset (&sa.sa_mask);
+		sigaction (SIGALRM, &sa, NULL);
+
+		eval_metrics_probe_start (&_worker_probe, manager);
+		if (_worker_metrics)
+			eval_metrics_channel_publish (_worker_metrics, &_worker_probe.cur);
+
+		it.it_interval.tv_usec = EVAL_METRICS_INTERVAL * 1000;
+		it.it_value = it.it_interval;
+	}
+	setitimer (ITIMER_REAL, &it, NULL);
+
+	if ( !active && _worker_metrics)
+		eval_metrics_channel_clear (_worker_metrics);
+}
+
+
+/*! Process for the computation of the given terms. The terms are evaluated
+ * in order. Each result is bound to its name, so later terms can use the
+ * results of earlier ones. All terms use the same BDD manager, hence common
+ * subterms share their nodes. An error only affects the term itself.
+ *
+ * All results are transfered at once after the last term.
  *
  * \author stb
  * \param pipeOut The pipe to the parent process. The process will write it's
- *                status code and the result to this stream.
- * \param term The term to compute.
+ *                status code and the results to this stream. The stream is
+ *                not closed, because the worker process is reused.
+ * \param terms The terms to compute.
+ * \param relNames The names of the results.
+ * \param count The number of terms.
+ * \param flags If RV_COMPUTE_FLAGS_PROFILE is set, the profile of the
+ *              evaluation is sent after the results. See EvalProfile.h
  * \param semId A semaphore which get unlocked by the process, when it finished
  *              the computation, regardless of a possible error.
  */
-void _compute_term_process (Relview * rv, lua_State * L, FILE * pipeOut,
-		const gchar * term, int semId)
+void _compute_terms_process (Relview * rv, lua_State * L, FILE * pipeOut,
+		gchar ** terms, gchar ** relNames, guint count, RvComputeFlags flags,
+		int semId)
 {
 	KureContext * context = rv_get_context(rv);
-	Timer timer;
-	KureError * kerr = NULL;
-	KureRel * impl;
+	DdManager * manager = kure_context_get_manager(context);
+	KureRel ** impls = g_new0 (KureRel*, count);
+	gchar ** errmsgs = g_new0 (gchar*, count);
+	DdNode ** roots = g_new0 (DdNode*, count);
+	guint i, root_count = 0;
+	EvalProfile * profile = NULL;
+	int saved;
+
+	if (flags & RV_COMPUTE_FLAGS_PROFILE) {
+		profile = eval_profile_new ();
+		eval_profile_attach (profile, L);
+	}
+
+	/* The results are bound to their names only for the rest of the batch.
+	 * The main process decides whether they are stored at all (see
+	 * rv_user_rename_or_not) and sends them with the next changes. */
+	lua_newtable (L);
+	saved = lua_gettop (L);
+	for (i = 0 ; i < count ; ++i) {
+		lua_getglobal (L, _lua_global_name (relNames[i]));
+		lua_setfield (L, saved, relNames[i]);
+	}
 
-	_timer_ctor(&timer);
-	_timer_start(&timer);
-	impl = kure_lang_exec(L, term, &kerr);
-	_timer_stop(&timer);
+	for (i = 0 ; i < count ; ++i) {
+		Timer timer;
+		KureError * kerr = NULL;
+
+		_timer_ctor(&timer);
+		_worker_metrics_set_active (manager, TRUE);
+		_timer_start(&timer);
+		impls[i] = kure_lang_exec(L, terms[i], &kerr);
+		_timer_stop(&timer);
+		_worker_metrics_set_active (manager, FALSE);
+
+		if (impls[i]) {
+			gchar * timestr = _format_timings(&timer,
+					eval_metrics_probe_sample (&_worker_probe));
+			printf ("%s\n", timestr);
+			g_free (timestr);
+			printf ("-------------------------------------------\n");
+			fflush (stdout);
 
-	if (!impl) {
+			kure_lua_set_rel_copy (L, _lua_global_name (relNames[i]), impls[i]);
+			roots[root_count ++] = kure_rel_get_bdd (impls[i]);
+		}
+		else {
+			errmsgs[i] = g_strdup ((kerr && kerr->message && *kerr->message)
+					? kerr->message : "Unknown error.");
+			if (kerr) kure_error_destroy(kerr);
+		}
 		_timer_dtor(&timer);
-		Semaphore_post (semId);
-		write_status_code (pipeOut, EVAL_ERROR);
-		write_message (pipeOut, kerr->message);
-		kure_error_destroy(kerr);
+	}
+
+	for (i = 0 ; i < count ; ++i) {
+		lua_getfield (L, saved, relNames[i]);
+		lua_setglobal (L, _lua_global_name (relNames[i]));
+	}
+	lua_pop (L, 1);
+
+	/* The Lua state is reused for the next request. */
+	if (profile) eval_profile_detach (profile, L);
+
+	MESSAGE ( "worker> sem_post () in child process.\n");
+	/* wake the parent up, so it reads the results from us. */
+	Semaphore_post (semId);
+	write_status_code (pipeOut, SUCCESS);
+
+	for (i = 0 ; i < count ; ++i) {
+		if (impls[i]) {
+			mpz_t rows, cols;
+
+			write_status_code (pipeOut, SUCCESS);
+
+			mpz_init (rows); mpz_init (cols);
+			kure_rel_get_rows (impls[i], rows);
+			kure_rel_get_cols (impls[i], cols);
+			_bignum_serialize_to_stream (pipeOut, rows);
+			_bignum_serialize_to_stream (pipeOut, cols);
+			mpz_clear (rows); mpz_clear (cols);
+		}
+		else {
+			write_status_code (pipeOut, EVAL_ERROR);
+			write_message (pipeOut, errmsgs[i]);
+		}
+	}
+
+	/* Prefer the shared memory object. The text format remains as a
+	 * fallback, e.g. if /dev/shm is full. */
+	if (root_count > 0) {
+		GError * err = NULL;
+		gchar * shm_name = bdd_transfer_shm_name (getppid(), getpid(), "result");
+
+		if (bdd_transfer_store_many (manager, roots, root_count, shm_name, &err)) {
+			write_transfer_mode (pipeOut, TRANSFER_SHM);
+		}
+		else {
+			MESSAGE ("worker> Unable to use shared memory: %s\n", err->message);
+			g_error_free (err);
+
+			write_transfer_mode (pipeOut, TRANSFER_DDDMP);
+
+			MESSAGE ("worker> Dddmp_cuddBddStore(...) started\n");
+			for (i = 0 ; i < root_count ; ++i)
+				Dddmp_cuddBddStore (manager, NULL, roots[i], NULL, NULL,
+						DDDMP_MODE_DEFAULT, (Dddmp_VarInfoType) NULL,
+						NULL, pipeOut);
+			MESSAGE ("worker> Dddmp_cuddBddStore(...) finished\n");
+		}
+		g_free (shm_name);
+	}
+
+	/* Write the current random numbers to the stream. Without that trick,
+	 * the random number generator in the main process won't increase and
+	 * every time a process is forked the same random numbers will be
+	 * generated. */
+	{
+		int r = random();
+		long int cudd_r = Cudd_Random();
+		MESSAGE("worker> Writing random numbers: %d %ld\n", r, cudd_r);
+
+		fprintf(pipeOut, "%d %ld\n", r, cudd_r);
+	}
+
+	if (profile) {
+		gchar * str = eval_profile_serialize (profile);
+		write_string (pipeOut, str, strlen (str));
+		g_free (str);
+		eval_profile_destroy (profile);
+	}
+
+	for (i = 0 ; i < count ; ++i) {
+		if (impls[i]) kure_rel_destroy (impls[i]);
+		g_free (errmsgs[i]);
+	}
+	g_free (impls);
+	g_free (errmsgs);
+	g_free (roots);
+}
+
+
+/*******************************************************************************
+ *                                Result Cache                                 *
+ *                                                                             *
+ * Results of successful evaluations are kept in the main process. They are   *
+ * keyed by the normalized term and the state of every global object the term *
+ * depends on, directly or through functions, programs and domains. Hence, a  *
+ * term whose inputs haven't changed, is never sent to a worker twice. The    *
+ * cache is bounded by the number of BDD nodes of the results. See the        *
+ * "eval_cache_nodes" setting.                                                *
+ ******************************************************************************/
+
+#define EVAL_CACHE_DEFAULT_NODES 1000000
+
+/* A relation used by a term. */
+typedef struct _EvalCacheInput
+{
+	gchar * name;
+	RelFingerprint fp;
+} EvalCacheInput;
+
+/* Also used for the cost history. See below. */
+typedef struct _EvalCacheKey
+{
+	gchar * str;
+	gchar * cost_str; /*!< The term and the rough sizes of its inputs. */
+	gboolean reusable; /*!< FALSE if the term uses random numbers. */
+	gchar ** deps; /*!< Names the term depends on, including those which
+	                * were undefined. */
+	GArray/*<EvalCacheInput>*/ * inputs; /*!< The relations in deps. */
+	gulong generation; /*!< Of the workspace when the key was computed. */
+} EvalCacheKey;
+
+typedef struct _EvalCacheEntry
+{
+	EvalCacheKey * key;
+	KureRel * result;
+	guint nodes;
+} EvalCacheEntry;
+
+typedef struct _EvalCache
+{
+	GHashTable/*<gchar*,GList*>*/ * entries; /*!< Links into lru. */
+	GQueue/*<EvalCacheEntry*>*/ * lru; /*!< Most recently used first. */
+	gulong nodes;
+	gulong hits, misses;
+	gulong generation; /*!< Of the workspace at the last sweep. */
+} EvalCache;
+
+static WorkspaceSync * _eval_sync ();
+
+
+static void _eval_cache_key_destroy (EvalCacheKey * key)
+{
+	guint i;
+
+	for (i = 0 ; i < key->inputs->len ; ++i)
+		g_free (g_array_index (key->inputs, EvalCacheInput, i).name);
+	g_array_free (key->inputs, TRUE);
+	g_free (key->str);
+	g_free (key->cost_str);
+	g_strfreev (key->deps);
+	g_free (key);
+}
+
+static void _append_ident (gpointer key, gpointer value, GQueue * todo)
+{ g_queue_push_tail (todo, key); }
+
+static gint _compare_strings (gconstpointer a, gconstpointer b)
+{ return strcmp (*(gchar**)a, *(gchar**)b); }
+
+/*! Returns the term with each sequence of whitespaces replaced by a single
+ * space, so that the layout of a term doesn't matter. */
+static gchar * _normalize_term (const gchar * term)
+{
+	gchar ** words = g_strsplit_set (term, " \t\r\n", -1);
+	GString * s = g_string_new ("");
+	gchar ** iter;
+
+	for (iter = words ; *iter ; ++iter) {
+		if (**iter) {
+			if (s->len > 0) g_string_append_c (s, ' ');
+			g_string_append (s, *iter);
+		}
+	}
+	g_strfreev (words);
+	return g_string_free (s, FALSE);
+}
+
+
+/*! Computes the key for the given term. The identifiers of the term and of
+ * the definitions of the functions, programs and domains it uses are
+ * collected transitively. The key is independent of the order in which the
+ * objects were found. The result of a term which uses random numbers isn't
+ * reusable, because the random state changes with each evaluation.
+ * Relations enter the key by their fingerprints. Their sizes are taken from
+ * rel_get_node_count, so the BDDs aren't traversed for each key. Compute
+ * the key once per evaluation and check it with _eval_cache_key_is_current
+ * later on.
+ *
+ * \author stb
+ */
+static EvalCacheKey * _eval_cache_key_new (const gchar * term)
+{
+	Relview * rv = rv_get_instance();
+	EvalCacheKey * key = g_new0 (EvalCacheKey, 1);
+	GHashTable * seen = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, NULL);
+	GQueue * todo = g_queue_new ();
+	GPtrArray * parts = g_ptr_array_new ();
+	GPtrArray * cost_parts = g_ptr_array_new ();
+	GPtrArray * deps = g_ptr_array_new ();
+	gboolean uses_random = FALSE;
+	gchar * normalized = _normalize_term (term);
+	GString * s = g_string_new (normalized);
+	GString * cost_s = g_string_new (normalized);
+	guint i;
+
+	key->inputs = g_array_new (FALSE, FALSE, sizeof (EvalCacheInput));
+	key->generation = workspace_sync_get_generation (_eval_sync ());
+
+	rv_lang_term_collect_identifiers (term, seen);
+	g_hash_table_foreach (seen, (GHFunc) _append_ident, todo);
+
+	while ( !g_queue_is_empty (todo)) {
+		const gchar * name = (const gchar*) g_queue_pop_head (todo);
+		GHashTable * idents = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, NULL);
+		Rel * rel = rel_manager_get_by_name (rv_get_rel_manager(rv), name);
+		Fun * fun;
+		Prog * prog;
+		Dom * dom;
+		gchar * part = NULL;
+
+		if (rel) {
+			EvalCacheInput input;
+
+			input.name = g_strdup (name);
+			rel_get_fingerprint (rel, &input.fp);
+			g_array_append_val (key->inputs, input);
+			part = g_strdup_printf ("R %s %p %" G_GINT64_MODIFIER "x %"
+					G_GINT64_MODIFIER "x", name, (void*) input.fp.root,
+					input.fp.rows, input.fp.cols);
+
+			/* Sizes within a factor of two are considered equal. */
+			g_ptr_array_add (cost_parts, g_strdup_printf ("%s %u", name,
+					g_bit_storage (rel_get_node_count (rel))));
+		}
+		else if ((fun = fun_manager_get_by_name (rv_get_fun_manager(rv), name))) {
+			part = g_strdup_printf ("F %s %s", name, fun_get_def (fun));
+			rv_lang_term_collect_identifiers (fun_get_def (fun), idents);
+		}
+		else if ((prog = prog_manager_get_by_name (rv_get_prog_manager(rv), name))) {
+			part = g_strdup_printf ("P %s %s", name, prog_get_term (prog));
+			rv_lang_term_collect_identifiers (prog_get_term (prog), idents);
+		}
+		else if ((dom = dom_manager_get_by_name (rv_get_dom_manager(rv), name))) {
+			part = g_strdup_printf ("D %s %d %s %s", name, (int) dom_get_type (dom),
+					dom_get_first_comp (dom), dom_get_second_comp (dom));
+			rv_lang_term_collect_identifiers (dom_get_first_comp (dom), idents);
+			rv_lang_term_collect_identifiers (dom_get_second_comp (dom), idents);
+		}
+		else if (g_str_has_prefix (name, "random"))
+			uses_random = TRUE;
+
+		/* Undefined names are either built-in or local. In both cases, they
+		 * don't contribute to the key. They are dependencies nevertheless,
+		 * because an object with that name may be created later on. */
+		g_ptr_array_add (deps, g_strdup (name));
+		if (part) {
+			GHashTableIter iter;
+			gpointer ident;
+
+			g_ptr_array_add (parts, part);
+
+			g_hash_table_iter_init (&iter, idents);
+			while (g_hash_table_iter_next (&iter, &ident, NULL)) {
+				if ( !g_hash_table_lookup_extended (seen, ident, NULL, NULL)) {
+					gchar * copy = g_strdup ((gchar*) ident);
+					g_hash_table_insert (seen, copy, NULL);
+					g_queue_push_tail (todo, copy);
+				}
+			}
+		}
+		g_hash_table_destroy (idents);
+	}
+
+	g_ptr_array_sort (parts, _compare_strings);
+	for (i = 0 ; i < parts->len ; ++i) {
+		g_string_append_c (s, '\n');
+		g_string_append (s, (gchar*) g_ptr_array_index (parts, i));
+		g_free (g_ptr_array_index (parts, i));
+	}
+	g_ptr_array_sort (cost_parts, _compare_strings);
+	for (i = 0 ; i < cost_parts->len ; ++i) {
+		g_string_append_c (cost_s, '\n');
+		g_string_append (cost_s, (gchar*) g_ptr_array_index (cost_parts, i));
+		g_free (g_ptr_array_index (cost_parts, i));
+	}
+	g_ptr_array_add (deps, NULL);
+	key->deps = (gchar**) g_ptr_array_free (deps, FALSE);
+	key->str = g_string_free (s, FALSE);
+	key->cost_str = g_string_free (cost_s, FALSE);
+	key->reusable = !uses_random;
+
+	g_ptr_array_free (parts, TRUE);
+	g_ptr_array_free (cost_parts, TRUE);
+	g_queue_free (todo);
+	g_hash_table_destroy (seen);
+	g_free (normalized);
+	return key;
+}
+
+
+static void _eval_cache_entry_destroy (EvalCacheEntry * entry)
+{
+	DdManager * manager = kure_context_get_manager(rv_get_context(rv_get_instance()));
+	guint i;
+
+	for (i = 0 ; i < entry->key->inputs->len ; ++i)
+		Cudd_RecursiveDeref (manager,
+				g_array_index (entry->key->inputs, EvalCacheInput, i).fp.root);
+	kure_rel_destroy (entry->result);
+	_eval_cache_key_destroy (entry->key);
+	g_free (entry);
+}
+
+
+static EvalCache * _eval_cache ()
+{
+	static EvalCache * cache = NULL;
+	if ( !cache) {
+		cache = g_new0 (EvalCache, 1);
+		cache->entries = g_hash_table_new (g_str_hash, g_str_equal);
+		cache->lru = g_queue_new ();
+		cache->generation = workspace_sync_get_generation (_eval_sync ());
+	}
+	return cache;
+}
+
+
+static void _eval_cache_remove_link (EvalCache * cache, GList * link)
+{
+	EvalCacheEntry * entry = (EvalCacheEntry*) link->data;
+
+	g_hash_table_remove (cache->entries, entry->key->str);
+	g_queue_delete_link (cache->lru, link);
+	cache->nodes -= entry->nodes;
+	_eval_cache_entry_destroy (entry);
+}
+
+
+static void _collect_changed_name (const gchar * name, WorkspaceSyncKind kind,
+		gpointer obj, GHashTable * changed)
+{ g_hash_table_insert (changed, g_strdup (name), GINT_TO_POINTER(1)); }
+
+/*! Drops each entry which depends on an object which has changed since the
+ * last sweep. The journal is updated by the observers of the managers.
+ */
+static void _eval_cache_sweep (EvalCache * cache)
+{
+	WorkspaceSync * sync = _eval_sync ();
+	gulong generation = workspace_sync_get_generation (sync);
+
+	if (generation != cache->generation) {
+		GHashTable * changed = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, NULL);
+		GList * iter = cache->lru->head;
+
+		workspace_sync_foreach_change (sync, cache->generation,
+				(WorkspaceSyncFunc) _collect_changed_name, changed);
+		cache->generation = generation;
+
+		while (iter) {
+			GList * next = iter->next;
+			EvalCacheEntry * entry = (EvalCacheEntry*) iter->data;
+			gchar ** dep;
+
+			for (dep = entry->key->deps ; *dep ; ++dep) {
+				if (g_hash_table_lookup (changed, *dep)) {
+					_eval_cache_remove_link (cache, iter);
+					break;
+				}
+			}
+			iter = next;
+		}
+		g_hash_table_destroy (changed);
+	}
+}
+
+
+/*! Returns TRUE if the key still describes the inputs of its term, i.e.
+ * none of the names it depends on has changed since it was computed. The
+ * fingerprints catch relations which were changed in place. This is much
+ * cheaper than computing the key again.
+ */
+static gboolean _eval_cache_key_is_current (EvalCacheKey * key)
+{
+	Relview * rv = rv_get_instance();
+	WorkspaceSync * sync = _eval_sync ();
+	gboolean current = TRUE;
+	guint i;
+
+	if (workspace_sync_get_generation (sync) != key->generation) {
+		GHashTable * changed = g_hash_table_new_full (g_str_hash, g_str_equal,
+				g_free, NULL);
+		gchar ** dep;
+
+		workspace_sync_foreach_change (sync, key->generation,
+				(WorkspaceSyncFunc) _collect_changed_name, changed);
+		for (dep = key->deps ; current && *dep ; ++dep)
+			current = !g_hash_table_lookup (changed, *dep);
+		g_hash_table_destroy (changed);
+	}
+
+	for (i = 0 ; current && i < key->inputs->len ; ++i) {
+		EvalCacheInput * input = &g_array_index (key->inputs, EvalCacheInput, i);
+		Rel * rel = rel_manager_get_by_name (rv_get_rel_manager(rv), input->name);
+		RelFingerprint fp;
+
+		if ( !rel) current = FALSE;
+		else {
+			rel_get_fingerprint (rel, &fp);
+			current = rel_fingerprint_same_contents (&fp, &input->fp);
+		}
+	}
+	return current;
+}
+
+
+/*! Returns a copy of the cached result for the given key, or NULL. Counts
+ * hits and misses.
+ */
+static KureRel * _eval_cache_lookup (EvalCacheKey * key)
+{
+	EvalCache * cache = _eval_cache ();
+	GList * link;
+
+	if ( !key->reusable) return NULL;
+
+	_eval_cache_sweep (cache);
+
+	link = (GList*) g_hash_table_lookup (cache->entries, key->str);
+	if ( !link) {
+		cache->misses ++;
+		return NULL;
+	}
+	else {
+		EvalCacheEntry * entry = (EvalCacheEntry*) link->data;
+
+		cache->hits ++;
+		g_queue_unlink (cache->lru, link);
+		g_queue_push_head_link (cache->lru, link);
+		return kure_rel_new_copy (entry->result);
+	}
+}
+
+
+/*! Stores a copy of the result for the given key. The key is taken over.
+ * The result isn't stored, if the inputs have changed since the key was
+ * computed, because the BDDs in the key may have been freed in the
+ * meantime.
+ */
+static void _eval_cache_insert (EvalCacheKey * key, KureRel * result)
+{
+	EvalCache * cache = _eval_cache ();
+	gulong max_nodes = prefs_get_int ("settings", "eval_cache_nodes",
+			EVAL_CACHE_DEFAULT_NODES);
+	guint nodes;
+
+	if ( !key->reusable || !_eval_cache_key_is_current (key)) {
+		_eval_cache_key_destroy (key);
 		return;
 	}
+
+	nodes = Cudd_DagSize (kure_rel_get_bdd (result));
+	_eval_cache_sweep (cache);
+
+	if (nodes > max_nodes || g_hash_table_lookup (cache->entries, key->str)) {
+		_eval_cache_key_destroy (key);
+	}
 	else {
-		gchar * timestr;
-		mpz_t rows, cols;
+		DdManager * manager = kure_context_get_manager(rv_get_context(rv_get_instance()));
+		EvalCacheEntry * entry = g_new0 (EvalCacheEntry, 1);
+		guint i;
+
+		/* Keep the input BDDs alive, so their addresses can't be reused
+		 * by other functions while the entry exists. */
+		for (i = 0 ; i < key->inputs->len ; ++i)
+			Cudd_Ref (g_array_index (key->inputs, EvalCacheInput, i).fp.root);
+
+		entry->key = key;
+		entry->result = kure_rel_new_copy (result);
+		entry->nodes = nodes;
+
+		g_queue_push_head (cache->lru, entry);
+		g_hash_table_insert (cache->entries, key->str, cache->lru->head);
+		cache->nodes += nodes;
+
+		/* Evict the least recently used entries. */
+		while (cache->nodes > max_nodes)
+			_eval_cache_remove_link (cache, cache->lru->tail);
+	}
+}
 
-		timestr = _format_timings(&timer);
-		printf ("%s\n", timestr);
-		g_free (timestr);
-		printf ("-------------------------------------------\n");
-		fflush (stdout);
 
-		write_status_code (pipeOut, SUCCESS);
+void eval_cache_get_stats (gulong * phits, gulong * pmisses, gulong * pnodes)
+{
+	EvalCache * cache = _eval_cache ();
+	if (phits) *phits = cache->hits;
+	if (pmisses) *pmisses = cache->misses;
+	if (pnodes) *pnodes = cache->nodes;
+}
+
 
-		MESSAGE ( "worker> sem_post () in child process.\n");
-		/* wake the parent up, so it reads the result from us. */
-		Semaphore_post (semId);
+void eval_cache_clear ()
+{
+	EvalCache * cache = _eval_cache ();
+	while ( !g_queue_is_empty (cache->lru))
+		_eval_cache_remove_link (cache, cache->lru->head);
+}
 
-		mpz_init (rows); mpz_init (cols);
 
-		kure_rel_get_rows (impl, rows);
-		kure_rel_get_cols (impl, cols);
+/*******************************************************************************
+ *                                Cost History                                 *
+ *                                                                             *
+ * Measured evaluation times, keyed by the normalized term and the rough      *
+ * sizes of its input relations (see EvalCacheKey::cost_str). A term which    *
+ * was cheap before is evaluated in the main process. This saves the round    *
+ * trip to a worker. Unknown and expensive terms are still evaluated by a     *
+ * worker, where they can be canceled. See the "eval_inline_max_ms" setting.  *
+ ******************************************************************************/
+
+#define EVAL_COST_MAX_ENTRIES 1000
+#define EVAL_INLINE_DEFAULT_MAX_MS 20
 
-		_bignum_serialize_to_stream (pipeOut, rows);
-		_bignum_serialize_to_stream (pipeOut, cols);
+typedef struct _EvalCost
+{
+	gchar * key;
+	gdouble secs; /*!< Moving average. */
+} EvalCost;
 
-		mpz_clear (rows); mpz_clear (cols);
+typedef struct _EvalCostHistory
+{
+	GHashTable/*<gchar*,GList*>*/ * entries; /*!< Links into lru. */
+	GQueue/*<EvalCost*>*/ * lru; /*!< Most recently used first. */
+} EvalCostHistory;
 
-		  MESSAGE ("worker> Dddmp_cuddBddStore(...) started\n");
-		  Dddmp_cuddBddStore (kure_context_get_manager(context), NULL,
-							  kure_rel_get_bdd(impl), NULL, NULL,
-							  DDDMP_MODE_DEFAULT, (Dddmp_VarInfoType) NULL,
-							  NULL, pipeOut);
-		  MESSAGE ("worker> Dddmp_cuddBddStore(...) finished\n");
+static EvalCostHistory * _eval_costs ()
+{
+	static EvalCostHistory * history = NULL;
+	if ( !history) {
+		history = g_new0 (EvalCostHistory, 1);
+		history->entries = g_hash_table_new (g_str_hash, g_str_equal);
+		history->lru = g_queue_new ();
+	}
+	return history;
+}
 
-		  /* Write the current random numbers to the stream. Without that trick,
-			 * the random number generator in the main process won't increase and
-			 * every time a process is forked the same random numbers will be
-			 * generated. */
-			{
-				int r = random();
-				long int cudd_r = Cudd_Random();
-				MESSAGE("worker> Writing random numbers: %d %ld\n", r, cudd_r);
 
-				fprintf(pipeOut, "%d %ld\n", r, cudd_r);
-			}
+/*! Records the time of a successful evaluation. Recent measurements have
+ * the same weight as all earlier ones together. */
+static void _eval_cost_record (EvalCacheKey * key, gdouble secs)
+{
+	EvalCostHistory * history = _eval_costs ();
+	GList * link = (GList*) g_hash_table_lookup (history->entries, key->cost_str);
+
+	if (link) {
+		EvalCost * cost = (EvalCost*) link->data;
+		cost->secs = (cost->secs + secs) / 2.0;
+		g_queue_unlink (history->lru, link);
+		g_queue_push_head_link (history->lru, link);
+	}
+	else {
+		EvalCost * cost = g_new0 (EvalCost, 1);
+		cost->key = g_strdup (key->cost_str);
+		cost->secs = secs;
+		g_queue_push_head (history->lru, cost);
+		g_hash_table_insert (history->entries, cost->key, history->lru->head);
+
+		if (g_queue_get_length (history->lru) > EVAL_COST_MAX_ENTRIES) {
+			EvalCost * oldest = (EvalCost*) g_queue_pop_tail (history->lru);
+			g_hash_table_remove (history->entries, oldest->key);
+			g_free (oldest->key);
+			g_free (oldest);
+		}
 	}
+}
 
-	_timer_dtor (&timer);
 
-	return;
+/*! Returns TRUE if the term was evaluated before with inputs of about the
+ * same size, and it was cheap. */
+static gboolean _eval_cost_is_cheap (EvalCacheKey * key)
+{
+	gint max_ms = prefs_get_int ("settings", "eval_inline_max_ms",
+			EVAL_INLINE_DEFAULT_MAX_MS);
+	GList * link = (GList*) g_hash_table_lookup (_eval_costs ()->entries,
+			key->cost_str);
+
+	return link && max_ms > 0
+			&& ((EvalCost*) link->data)->secs * 1000.0 <= (gdouble) max_ms;
 }
 
 
-struct worker_ctrl_info
+/* State passed from the main process to a new worker. */
+typedef struct _EvalWorkerState
+{
+	lua_State * L;
+	gulong generation; /*!< Of the workspace in L. See WorkspaceSync.h */
+} EvalWorkerState;
+
+/* Data associated with each worker in the main process. */
+typedef struct _EvalWorkerData
+{
+	gulong generation; /*!< Of the workspace the worker has. */
+	EvalMetricsChannel * metrics; /*!< NULL if not available. */
+} EvalWorkerData;
+
+
+/* A term of a job and its result. */
+typedef struct _EvalJobItem
 {
+  gchar * term;
+  gchar * relName;
+  RvStatusCode statusCode;
+  gchar * errmsg;
+  KureRel * result_impl; /*!< Filled by the controller thread. Contains
+                          * the result in case of success. */
+  EvalCacheKey * cacheKey; /*!< Computed when the job is queued or, if the
+                            * inputs have changed since, when it's started. */
+} EvalJobItem;
+
+struct _EvalJob
+{
+  guint id;
+  EvalJobItem * items;
+  guint item_count;
+  gchar * term; /*!< For display. All terms of a batch. */
+  gchar * relName; /*!< For display. All names of a batch. */
+  RvComputeFlags flags;
+  gpointer group; /*!< Non-NULL for the parts of a split term. Their results
+                   * are passed to the done callback instead of being
+                   * stored. See _eval_split_try. */
+  EvalJobState state;
+  EvalJobDoneFunc done;
+  gpointer user_data;
+
+  /* Only valid while the job is running. */
+  Worker * worker;
   pid_t child;
   int semId;
-  GMutex * mutex, * syncMutex;
   FILE * pipeIn;
-  GtkWidget * dialog;
-  GtkWidget * buttonCancelEval;
+  GThread * thread;
+  GMutex * mutex; /*!< Whoever gets it first, decides whether the job was
+                   * completed or canceled. It isn't released until the
+                   * job is finished. */
   GTimer * timer;
-  const gchar * relName;
-  RvStatusCode statusCode;
+
+  RvStatusCode statusCode; /*!< SUCCESS if the worker has evaluated all
+                            * items, even if some of them failed. */
   gchar * errmsg;
-  Relview * rv;
-  KureRel * result_impl; /*!< Filled by the worker thread. Contains
-						   * the result in case of success. */
+  gchar * profile; /*!< Serialized EvalProfile, if requested. */
 };
 
+static guint _eval_job_next_id = 1;
+static GQueue/*<EvalJob*>*/ * _eval_queue_pending = NULL;
+static GList/*<EvalJob*>*/ * _eval_queue_running = NULL;
+static GList/*<EvalJob*>*/ * _eval_queue_jobs = NULL; /*!< Both of them. */
+static GSList/*<EvalQueueObserver*>*/ * _eval_queue_observers = NULL;
+
+#define EVAL_QUEUE_OBSERVER_NOTIFY(func,...) \
+        OBSERVER_NOTIFY_GLOBAL(_eval_queue_observers,GSList,EvalQueueObserver,func, __VA_ARGS__)
+
+static WorkerPool * _eval_pool ();
+static gboolean _eval_worker_send (Worker * worker, EvalJob * job,
+		GError ** perr);
+static void _eval_queue_dispatch ();
+
+
+guint eval_job_get_id (EvalJob * self) { return self->id; }
+const gchar * eval_job_get_term (EvalJob * self) { return self->term; }
+const gchar * eval_job_get_rel_name (EvalJob * self) { return self->relName; }
+EvalJobState eval_job_get_state (EvalJob * self) { return self->state; }
+const gchar * eval_job_get_error (EvalJob * self) { return self->errmsg; }
+guint eval_job_get_size (EvalJob * self) { return self->item_count; }
+
+const gchar * eval_job_get_item_error (EvalJob * self, guint i)
+{ return (i < self->item_count) ? self->items[i].errmsg : NULL; }
+
+gdouble eval_job_get_elapsed (EvalJob * self)
+{ return self->timer ? g_timer_elapsed (self->timer, NULL) : 0.0; }
+
+gboolean eval_job_get_metrics (EvalJob * self, EvalMetrics * m)
+{
+	EvalWorkerData * data;
+
+	if (EVAL_JOB_RUNNING != self->state || !self->worker)
+		return FALSE;
+
+	data = (EvalWorkerData*) worker_get_data (self->worker);
+	return data && data->metrics && eval_metrics_channel_peek (data->metrics, m);
+}
+
+const GList * eval_queue_get_jobs () { return _eval_queue_jobs; }
+
+EvalJob * eval_queue_lookup_job (guint id)
+{
+	GList * iter;
+
+	for (iter = _eval_queue_jobs ; iter ; iter = iter->next)
+		if (((EvalJob*) iter->data)->id == id)
+			return (EvalJob*) iter->data;
+	return NULL;
+}
+
+void eval_queue_register_observer (EvalQueueObserver * o)
+{
+	if ( !g_slist_find (_eval_queue_observers, o))
+		_eval_queue_observers = g_slist_prepend (_eval_queue_observers, o);
+}
+
+void eval_queue_unregister_observer (EvalQueueObserver * o)
+{ _eval_queue_observers = g_slist_remove (_eval_queue_observers, o); }
+
+
+/*! Reads the results of the items from the worker and stores them in the
+ * job. Called by the controller thread while holding the GDK lock, because
+ * the global BDD manager is used.
+ *
+ * \author stb
+ */
+static void _eval_job_read_result (EvalJob * job)
+{
+	KureContext * context = rv_get_context(rv_get_instance());
+	DdManager * manager = kure_context_get_manager(context);
+	mpz_t * rows = g_new (mpz_t, job->item_count);
+	mpz_t * cols = g_new (mpz_t, job->item_count);
+	guint i, ok_count = 0;
+
+	for (i = 0 ; i < job->item_count ; ++i) {
+		EvalJobItem * item = &job->items[i];
+
+		mpz_init (rows[i]);
+		mpz_init (cols[i]);
+
+		if (1 != read_status_code (job->pipeIn, &item->statusCode))
+			item->statusCode = FATAL_ERROR;
+
+		if (SUCCESS == item->statusCode) {
+			_bignum_deserialize_from_stream(job->pipeIn, rows[i]);
+			_bignum_deserialize_from_stream(job->pipeIn, cols[i]);
+			ok_count ++;
+		}
+		else read_message (job->pipeIn, &item->errmsg);
+	}
+
+	if (ok_count > 0) {
+		RvTransferMode mode;
+
+		if (1 != read_transfer_mode (job->pipeIn, &mode))
+			mode = TRANSFER_DDDMP;
+
+		if (TRANSFER_SHM == mode) {
+			GError * err = NULL;
+			gchar * shm_name = bdd_transfer_shm_name (getpid(), job->child, "result");
+			guint loaded_count = 0;
+			DdNode ** roots;
+
+			MESSAGE("controller> bdd_transfer_load_many (...) started.\n");
+			roots = bdd_transfer_load_many (manager, shm_name, &loaded_count, &err);
+			MESSAGE("controller> bdd_transfer_load_many (...) finished.\n");
+			if ( !roots || loaded_count != ok_count) {
+				g_warning ("Unable to read the results. Reason: %s",
+						err ? err->message : "Wrong number of relations.");
+				if (err) g_error_free (err);
+			}
+
+			for (i = 0, ok_count = 0 ; i < job->item_count ; ++i) {
+				EvalJobItem * item = &job->items[i];
+
+				if (SUCCESS != item->statusCode) continue;
+				else if (roots && ok_count < loaded_count) {
+					/* bdd_transfer_load_many returns referenced nodes. */
+					item->result_impl = kure_rel_new_from_bdd(context,
+							roots[ok_count], rows[i], cols[i]);
+				}
+				else {
+					item->statusCode = EVAL_ERROR;
+					item->errmsg = g_strdup ("Unable to transfer the result "
+							"from the worker process.");
+				}
+				ok_count ++;
+			}
+
+			if (roots) {
+				for (i = 0 ; i < loaded_count ; ++i)
+					Cudd_RecursiveDeref (manager, roots[i]);
+				g_free (roots);
+			}
+			g_free (shm_name);
+		}
+		else {
+			for (i = 0 ; i < job->item_count ; ++i) {
+				EvalJobItem * item = &job->items[i];
+				DdNode * bdd;
+
+				if (SUCCESS != item->statusCode) continue;
+
+				MESSAGE("controller> Dddmp_cuddBddLoad (...) started.\n");
+				bdd = Dddmp_cuddBddLoad(manager, DDDMP_VAR_MATCHIDS, NULL,
+						NULL, NULL, DDDMP_MODE_DEFAULT, NULL, job->pipeIn);
+				MESSAGE("controller> Dddmp_cuddBddLoad (...) finished.\n");
+				assert (bdd);
+				Cudd_Ref(bdd);
+				item->result_impl = kure_rel_new_from_bdd(context, bdd, rows[i], cols[i]);
+				Cudd_Deref(bdd);
+				if (Cudd_IsNonConstant(bdd))
+					Cudd_Deref(bdd); // NOTE: Workaround! Don't know why this is necessary.
+			}
+		}
+	}
+
+	for (i = 0 ; i < job->item_count ; ++i) {
+		mpz_clear (rows[i]);
+		mpz_clear (cols[i]);
+	}
+	g_free (rows);
+	g_free (cols);
+
+	/* read the random numbers from the pipe */
+	{
+		int r;
+		long int cudd_r;
+		/* No trailing newline in the format. This would block
+		 * until the worker sends its next response. */
+		fscanf(job->pipeIn, "%d %ld", &r, &cudd_r);
+		MESSAGE("contoller> Read random numbers: %d %ld\n", r, cudd_r);
+		srandom(r);
+		Cudd_Srandom(cudd_r);
+	}
+
+	if ((job->flags & RV_COMPUTE_FLAGS_PROFILE)
+			&& !read_string (job->pipeIn, &job->profile, NULL))
+		g_warning ("Unable to read the profile of the evaluation.");
+}
+
+
+static gboolean _eval_job_finished (gpointer data);
+
+/*! Thread function for the process controller of a job. Waits for the
+ * worker to finish or the user to cancel the job and reads the result, if
+ * no error occurred. The job is finished in the main loop afterwards.
+ *
+ * \author stb
+ * \param data The job.
+ */
+static
+void _worker_controller_thread (void *data)
+{
+	EvalJob * job = (EvalJob*) data;
+
+	MESSAGE("controller> started! Waiting for the worker process, or user cancelation ...\n");
+
+	Semaphore_wait(job->semId);
+
+	/* check whether the user canceled the evaluation, or the child process
+	 * finished it. */
+	if (g_mutex_trylock (job->mutex)) /* worker finished first */
+	{
+		RvStatusCode code;
+
+		MESSAGE("controller> the worker finished evaluation. Check for errors.\n");
+
+		read_status_code(job->pipeIn, &code);
+		MESSAGE("controller> Status from worker process: %s\n", (code
+				== SUCCESS) ? "SUCCESS" : "ERROR");
+		job->statusCode = code;
+
+		if (SUCCESS == code) {
+			gdk_threads_enter();
+			_eval_job_read_result (job);
+			gdk_flush();
+			gdk_threads_leave();
+		}
+		else /* code != SUCCESS (error during evaluation) */ {
+			MESSAGE("controller> error during evaluation (%s)!\n",
+					(SYNTAX_ERROR == code) ? "syntax error" : (EVAL_ERROR
+							== code) ? "evaluation error" : "unknown error");
+
+			/* In case of an error, read the error message from the pipe. */
+			read_message(job->pipeIn, &job->errmsg);
+		}
+	}
+	else /* user cancelation */
+	{
+		MESSAGE("controller> user cancelation\n");
+	}
+
+	gdk_threads_add_idle (_eval_job_finished, job);
+
+	MESSAGE("controller> exited.\n");
+}
+
+
+static void _eval_job_destroy (EvalJob * self)
+{
+	guint i;
+
+	for (i = 0 ; i < self->item_count ; ++i) {
+		EvalJobItem * item = &self->items[i];
+		g_free (item->term);
+		g_free (item->relName);
+		g_free (item->errmsg);
+		if (item->result_impl) kure_rel_destroy (item->result_impl);
+		if (item->cacheKey) _eval_cache_key_destroy (item->cacheKey);
+	}
+	g_free (self->items);
+	g_free (self->term);
+	g_free (self->relName);
+	g_free (self->errmsg);
+	if (self->timer) g_timer_destroy (self->timer);
+	g_free (self->profile);
+	g_free (self);
+}
+
+
+/*! Stores the result of a successful evaluation in a relation with the
+ * given name. If a relation with that name already exists, the user is asked
+ * what to do (cancel, overwrite, enter another name), unless
+ * RV_COMPUTE_FLAGS_FORCE_OVERWRITE is set. Takes over the given KureRel.
+ *
+ * \author stb
+ */
+static void _compute_store_result (const gchar * relName, KureRel * impl,
+		RvComputeFlags flags)
+{
+	Relview * rv = rv_get_instance();
+	Rel * localRel = rel_new_from_impl(relName, impl);
+	gboolean inserted;
+
+#ifdef VERBOSE
+	{
+		// Debug code
+		DdManager * table = kure_context_get_manager(rv_get_context(rv));
+		Cudd_CheckZeroRef (table);
+		Cudd_CheckKeys (table);
+		cuddGarbageCollect(table, 1);
+	}
+#endif
+
+	if (flags & RV_COMPUTE_FLAGS_FORCE_OVERWRITE) {
+		/* delete the existing relation, with the desired name,
+		 * if there is one. (See above.) */
+		RelManager * manager = rv_get_rel_manager(rv);
+
+		rel_manager_delete_by_name(manager, relName);
+		rel_manager_insert(manager, localRel);
+		inserted = TRUE;
+	}
+	else inserted = rv_user_rename_or_not(rv, localRel);
+
+	if (inserted) {
+		relation_window_set_relation(relation_window_get_instance(), localRel);
+	}
+	else /* user canceled */ {
+		rel_destroy(localRel);
+	}
+}
+
+
+/*! Stores the results of the successful items of a finished job in their
+ * order and reports the failed ones. Returns the number of failed items.
+ * The results of the parts of a split term are kept in the job and the
+ * errors are reported for the whole term.
+ */
+static guint _eval_job_store_results (EvalJob * job)
+{
+	GString * errors = g_string_new ("");
+	guint i, failed = 0;
+
+	for (i = 0 ; i < job->item_count ; ++i) {
+		EvalJobItem * item = &job->items[i];
+
+		if (SUCCESS == item->statusCode) {
+			if (item->cacheKey) {
+				/* The time includes the transfers. It's an upper bound for
+				 * the time an evaluation in the main process would take. */
+				if (job->timer && 1 == job->item_count)
+					_eval_cost_record (item->cacheKey, g_timer_elapsed (job->timer, NULL));
+				_eval_cache_insert (item->cacheKey, item->result_impl);
+				item->cacheKey = NULL;
+			}
+			if ( !job->group) {
+				_compute_store_result (item->relName, item->result_impl, job->flags);
+				item->result_impl = NULL;
+			}
+		}
+		else {
+			if ( !item->errmsg)
+				item->errmsg = g_strdup ("Unknown error.");
+			g_string_append_printf (errors, "%s = %s\n\t%s\n", item->relName,
+					item->term, item->errmsg);
+			failed ++;
+		}
+	}
+
+	if (job->group)
+		;
+	else if (1 == job->item_count && failed > 0) {
+		job->errmsg = g_strdup (job->items[0].errmsg);
+		rv_user_error_with_descr ("Evaluation failed", job->errmsg,
+				"Further details are listed below. The term was\n\t\"%s\".",
+				job->items[0].term);
+	}
+	else if (failed > 0) {
+		job->errmsg = g_strdup (errors->str);
+		rv_user_error_with_descr ("Evaluation failed", job->errmsg,
+				"%u of %u terms could not be evaluated. The results of the "
+				"others were stored. Further details are listed below.",
+				failed, job->item_count);
+	}
+
+	g_string_free (errors, TRUE);
+	return failed;
+}
+
+
+/*! Removes a job from the queue after it has finished, failed or was
+ * canceled. The results are stored or an error is shown. The observers and
+ * the job's callback are notified and the job is destroyed. Then, the next
+ * jobs are started.
+ */
+static void _eval_job_complete (EvalJob * job)
+{
+	_eval_queue_running = g_list_remove (_eval_queue_running, job);
+	_eval_queue_jobs = g_list_remove (_eval_queue_jobs, job);
+
+	if (SUCCESS == job->statusCode) {
+		/* At this point, the controller thread has transfered the relations
+		 * into our global manager. */
+		if (job->profile) {
+			EvalProfile * profile = eval_profile_deserialize (job->profile);
+			if (profile) {
+				_print_profile (profile);
+				eval_profile_destroy (profile);
+			}
+		}
+
+		if (_eval_job_store_results (job) == job->item_count)
+			job->state = EVAL_JOB_FAILED;
+		else job->state = EVAL_JOB_FINISHED;
+	}
+	else if (USER_CANCELATION == job->statusCode) {
+		MESSAGE("main> The user has canceled the evaluation.\n");
+		job->state = EVAL_JOB_CANCELED;
+	}
+	else /* job->statusCode != SUCCESS */ {
+		job->state = EVAL_JOB_FAILED;
+		if ( !job->errmsg)
+			job->errmsg = g_strdup ("Unknown error.");
+
+		if ( !job->group)
+			rv_user_error_with_descr ("Evaluation failed", job->errmsg,
+					"Further details are listed below. The term was\n\t\"%s\".",
+					job->term);
+	}
+
+	EVAL_QUEUE_OBSERVER_NOTIFY(jobChanged, _1(job));
+	if (job->done)
+		job->done (job, job->user_data);
+	_eval_job_destroy (job);
+
+	_eval_queue_dispatch ();
+}
+
+
+/*! Called in the main loop once the controller thread of a running job
+ * has finished. See \ref _worker_controller_thread.
+ */
+static gboolean _eval_job_finished (gpointer data)
+{
+	EvalJob * job = (EvalJob*) data;
+	WorkerPool * pool = _eval_pool ();
+
+	g_thread_join (job->thread);
+	job->thread = NULL;
+	g_timer_stop (job->timer);
+
+	g_mutex_unlock (job->mutex);
+	g_mutex_free (job->mutex);
+	job->mutex = NULL;
+
+	/* A canceled worker was killed in the middle of the computation. On a
+	 * fatal error, the worker's state is broken. A replacement is started
+	 * in the background. */
+	if (USER_CANCELATION == job->statusCode || FATAL_ERROR == job->statusCode)
+		worker_pool_kill (pool, job->worker);
+	else worker_pool_release (pool, job->worker);
+	job->worker = NULL;
+
+	_eval_job_complete (job);
+	return FALSE;
+}
+
+
+/*! Sends the job's term to a worker and starts the controller thread. The
+ * job is completed immediately, if no worker can be used.
+ *
+ * \author stb
+ */
+static void _eval_job_start (EvalJob * job)
+{
+	WorkerPool * pool = _eval_pool ();
+	GError * err = NULL;
+	Worker * worker;
+
+	guint i;
+
+	/* The inputs are final at this point, because jobs which depend on
+	 * earlier jobs are started after them. The terms of a batch may depend
+	 * on each other. Their results are cached, but they are always
+	 * evaluated together. */
+	for (i = 0 ; i < job->item_count ; ++i) {
+		EvalJobItem * item = &job->items[i];
+
+		if (item->cacheKey && !_eval_cache_key_is_current (item->cacheKey)) {
+			_eval_cache_key_destroy (item->cacheKey);
+			item->cacheKey = NULL;
+		}
+		if ( !item->cacheKey)
+			item->cacheKey = _eval_cache_key_new (item->term);
+	}
+
+	if (1 == job->item_count && !(job->flags & RV_COMPUTE_FLAGS_PROFILE)) {
+		EvalJobItem * item = &job->items[0];
+
+		item->result_impl = _eval_cache_lookup (item->cacheKey);
+		if (item->result_impl) {
+			gulong hits, misses;
+
+			eval_cache_get_stats (&hits, &misses, NULL);
+			printf ("EVAL-TIME: cached (hits: %lu, misses: %lu)\n", hits, misses);
+			printf ("-------------------------------------------\n");
+
+			_eval_cache_key_destroy (item->cacheKey);
+			item->cacheKey = NULL;
+			item->statusCode = job->statusCode = SUCCESS;
+			_eval_job_complete (job);
+			return;
+		}
+	}
+
+	worker = worker_pool_acquire (pool, &err);
+
+	/* The worker may have died since it was used last time. Give it a
+	 * second chance with a fresh one. A fresh worker doesn't need any
+	 * changes, so invalidate the idle ones too. */
+	if (worker && !_eval_worker_send (worker, job, &err)) {
+		MESSAGE ("main> Unable to use worker: %s\n", err->message);
+		g_clear_error (&err);
+		worker_pool_kill (pool, worker);
+		worker_pool_invalidate (pool);
+		worker = worker_pool_acquire (pool, &err);
+		if (worker && !_eval_worker_send (worker, job, &err)) {
+			worker_pool_kill (pool, worker);
+			worker = NULL;
+		}
+	}
+
+	if ( !worker) {
+		job->statusCode = FATAL_ERROR;
+		job->errmsg = g_strdup_printf ("Unable to start the evaluation. "
+				"Trying again might solve the problem. Otherwise save your "
+				"workspace and restart the system. Reason: %s",
+				err ? err->message : "Unknown");
+		if (err) g_error_free (err);
+		_eval_job_complete (job);
+	}
+	else {
+		GError * error = NULL;
+
+		job->worker = worker;
+		job->child = worker_get_pid (worker);
+		job->semId = worker_get_sem_id (worker);
+		job->pipeIn = worker_get_results (worker);
+		job->statusCode = UNKNOWN;
+		job->mutex = g_mutex_new ();
+		job->timer = g_timer_new ();
+		job->state = EVAL_JOB_RUNNING;
+		_eval_queue_running = g_list_append (_eval_queue_running, job);
+
+		job->thread = g_thread_create ((GThreadFunc) _worker_controller_thread,
+				(gpointer) job, TRUE /*joinable*/, &error);
+		if (NULL == job->thread)
+		{
+			MESSAGE("controller> %s\n", error->message);
+			assert (FALSE);
+		}
+
+		EVAL_QUEUE_OBSERVER_NOTIFY(jobChanged, _1(job));
+	}
+}
+
+
+/*! Returns TRUE if the job has to wait for an unfinished job, which was
+ * queued earlier, because it uses or replaces the other job's result.
+ */
+static gboolean _eval_job_is_blocked (EvalJob * job)
+{
+	GHashTable * names = g_hash_table_new (g_str_hash, g_str_equal);
+	gboolean blocked = FALSE;
+	GList * iter;
+
+	guint i;
+
+	for (iter = _eval_queue_jobs ; iter && iter->data != job ; iter = iter->next) {
+		EvalJob * other = (EvalJob*) iter->data;
+
+		/* The parts of a split term are independent by construction. */
+		if (job->group && other->group == job->group)
+			continue;
+
+		for (i = 0 ; i < other->item_count ; ++i)
+			g_hash_table_insert (names, other->items[i].relName, other);
+	}
+
+	for (i = 0 ; i < job->item_count && !blocked
+			&& g_hash_table_size (names) > 0 ; ++i)
+		blocked = g_hash_table_lookup (names, job->items[i].relName)
+			|| rv_lang_term_mentions (job->items[i].term, names);
+
+	g_hash_table_destroy (names);
+	return blocked;
+}
+
+
+/*! Starts queued jobs while there are free workers. A job may complete
+ * immediately (e.g. if its result is cached), which dispatches recursively.
+ * Hence, the queue is scanned from the head after each start.
+ */
+static void _eval_queue_dispatch ()
+{
+	WorkerPool * pool = _eval_pool ();
+	gboolean started;
+
+	do {
+		GList * iter;
+
+		started = FALSE;
+		for (iter = _eval_queue_pending->head ; iter
+				&& g_list_length (_eval_queue_running) < worker_pool_get_size (pool)
+				; iter = iter->next) {
+			EvalJob * job = (EvalJob*) iter->data;
+
+			if ( !_eval_job_is_blocked (job)) {
+				g_queue_delete_link (_eval_queue_pending, iter);
+				_eval_job_start (job);
+				started = TRUE;
+				break;
+			}
+		}
+	} while (started);
+}
+
+
+/*! Creates a job for the given terms and queues it. See
+ * \ref compute_terms_batch. group is stored in the job. key is the cache
+ * key of a single term, if it's already known, or NULL. It's taken over.
+ * Returns the job's id. The job may have completed already, because it's
+ * dispatched right away.
+ */
+static guint _eval_job_queue (const gchar * const * terms,
+		const gchar * const * relNames, guint count, RvComputeFlags flags,
+		gpointer group, EvalCacheKey * key, EvalJobDoneFunc done,
+		gpointer user_data)
+{
+	EvalJob * job;
+	GString * term, * relName;
+	guint i, id;
+
+	g_return_val_if_fail (count > 0, 0);
+
+	if ( !_eval_queue_pending)
+		_eval_queue_pending = g_queue_new ();
+
+	job = g_new0 (EvalJob, 1);
+	job->id = _eval_job_next_id ++;
+	job->items = g_new0 (EvalJobItem, count);
+	job->item_count = count;
+	job->items[0].cacheKey = key;
+
+	term = g_string_new ("");
+	relName = g_string_new ("");
+	for (i = 0 ; i < count ; ++i) {
+		EvalJobItem * item = &job->items[i];
+
+		item->term = g_strdup (terms[i]);
+		item->relName = g_strstrip (g_strdup (relNames[i]));
+		item->statusCode = UNKNOWN;
+
+		if (1 == count)
+			g_string_append (term, item->term);
+		else g_string_append_printf (term, "%s%s = %s", i>0 ? "; " : "",
+				item->relName, item->term);
+		g_string_append_printf (relName, "%s%s", i>0 ? ", " : "", item->relName);
+	}
+	job->term = g_string_free (term, FALSE);
+	job->relName = g_string_free (relName, FALSE);
+
+	job->flags = flags;
+	job->group = group;
+	job->state = EVAL_JOB_QUEUED;
+	job->done = done;
+	job->user_data = user_data;
+
+	g_queue_push_tail (_eval_queue_pending, job);
+	_eval_queue_jobs = g_list_append (_eval_queue_jobs, job);
+	EVAL_QUEUE_OBSERVER_NOTIFY(jobChanged, _1(job));
+
+	id = job->id;
+	_eval_queue_dispatch ();
+	return id;
+}
+
+
+guint compute_terms_batch (const gchar * const * terms,
+		const gchar * const * relNames, guint count, RvComputeFlags flags,
+		EvalJobDoneFunc done, gpointer user_data)
+{
+	return _eval_job_queue (terms, relNames, count, flags, NULL, NULL, done,
+			user_data);
+}
+
+
+guint compute_term_async (const gchar * term, const gchar * relName,
+		RvComputeFlags flags, EvalJobDoneFunc done, gpointer user_data)
+{
+	return compute_terms_batch (&term, &relName, 1, flags, done, user_data);
+}
+
+
+void eval_job_cancel (EvalJob * self)
+{
+	if (EVAL_JOB_QUEUED == self->state) {
+		g_queue_remove (_eval_queue_pending, self);
+		self->statusCode = USER_CANCELATION;
+		_eval_job_complete (self);
+	}
+	else if (EVAL_JOB_RUNNING == self->state
+			&& g_mutex_trylock (self->mutex)) {
+		/* send SIGKILL to the computation process, on a cancelation
+		 * request. The controller thread wakes up and finishes the job. */
+		MESSAGE ("main> Sending SIGKILL to child process (pid: %d)\n", self->child);
+		kill (self->child, SIGKILL);
+		self->statusCode = USER_CANCELATION;
+		Semaphore_post (self->semId);
+	}
+}
+
+
+/* Use to handle SIGSEGV in the worker processes. See also
+ * _sigsegv_in_child_handler below. */
+jmp_buf _child_env;
+/*!
+ * Recover in case of an SIGSEGV. This is important, because the parent process would
+ * idle in this case without abortion by the user.
+ */
+void _sigsegv_in_child_handler (int signal)
+{
+	longjmp (_child_env, signal);
+}
+
 
-/*! Invoked, when the user want to cancel the running evaluation.
- * The evaluation will abort immediately.
- *
- * \author stb
- * \param button The button handle.
- * \param user_data The pointer to the worker_ctrl_info structure.
+/*! Returns the journal of workspace changes, which is used to keep the
+ * workspace of the evaluation workers up-to-date. It's the journal of the
+ * Relview object, so there is only one per process. Each worker and the
+ * result cache have their own generation.
  */
-void
-on_buttonCancelEval_clicked            (GtkButton       *button,
-                                        gpointer         user_data)
+static WorkspaceSync * _eval_sync ()
 {
-  struct worker_ctrl_info *wci = (struct worker_ctrl_info*) user_data;
-
-  /* send SIGKILL to the computation process, on a cancelation request. */
-
-  MESSAGE ("controller> Sending SIGKILL to child process (pid: %d)\n", wci->child);
-  kill (wci->child, SIGKILL);
-  wci->statusCode = USER_CANCELATION;
-  MESSAGE ("dialog> mutex lock\n");
-  g_mutex_lock (wci->mutex);
-  Semaphore_post (wci->semId);
+	return rv_get_workspace_sync (rv_get_instance());
 }
 
 
-/*! Timeout callback, which updates the elapsed time and the progress bar
- * in the appearing dialog during the evaluation process.
- *
- * \author stb
- * \param data The pointer to the worker_ctrl_info structure.
- * \return Returns TRUE to indicate, that the callback may called again.
+/*! Creates the Lua state for a new worker process in the main process. See
+ * \ref WorkerPoolPrepareFunc.
  */
-static
-gboolean _timeout_func (gpointer data)
+static gpointer _eval_worker_prepare (gpointer user_data)
+{
+	EvalWorkerState * state;
+	lua_State * L;
+
+	MESSAGE ("main> Creating Lua state for a new worker.\n");
+	L = rv_lang_new_state((Relview*) user_data);
+	if ( !L) return NULL;
+
+	state = g_new0 (EvalWorkerState, 1);
+	state->L = L;
+	state->generation = workspace_sync_get_generation (_eval_sync ());
+	return state;
+}
+
+static void _eval_worker_release (Worker * worker, gpointer state,
+		gpointer user_data)
 {
-  struct worker_ctrl_info *wci = (struct worker_ctrl_info*) data;
+	EvalWorkerState * s = (EvalWorkerState*) state;
 
-  GtkBuilder * builder = rv_get_gtk_builder (wci->rv);
-  GtkWidget *pb = GTK_WIDGET(gtk_builder_get_object(builder, "progressEval"));
-  GtkWidget *label = GTK_WIDGET(gtk_builder_get_object(builder, "labelTimeElapsedEval"));
-  gdouble telapsed = g_timer_elapsed (wci->timer, NULL);
-  gchar *s = NULL;
+	if (worker) {
+		EvalWorkerData * data = g_new0 (EvalWorkerData, 1);
+		gchar * shm_name = bdd_transfer_shm_name (getpid(),
+				worker_get_pid (worker), "metrics");
 
-  /* show the elapsed time in the format "hh:mm:ss" */
-  {
-    unsigned secs = ((unsigned) telapsed ) % 60,
-      mins = ((unsigned)(telapsed / 60.0) % 60),
-      hours = ((unsigned)(telapsed / 3600.0));
+		data->generation = s->generation;
+		data->metrics = eval_metrics_channel_open (shm_name, NULL);
+		g_free (shm_name);
+		worker_set_data (worker, data);
+	}
 
-    s = g_strdup_printf ("%.2u:%.2u:%.2u", hours, mins, secs);
-  }
+	lua_close (s->L);
+	g_free (s);
+}
 
-  gtk_progress_bar_pulse (GTK_PROGRESS_BAR (pb));
 
-  gtk_label_set_text (GTK_LABEL (label), s);
-  g_free (s);
+typedef struct _SyncChange
+{
+	gchar * name;
+	WorkspaceSyncKind kind;
+	gpointer obj; /*!< NULL if deleted. */
+} SyncChange;
 
-  return TRUE;
+static void _collect_sync_change (const gchar * name, WorkspaceSyncKind kind,
+		gpointer obj, GList ** pchanges)
+{
+	SyncChange * c = g_new0 (SyncChange, 1);
+	c->name = g_strdup (name);
+	c->kind = kind;
+	c->obj = obj;
+	*pchanges = g_list_prepend (*pchanges, c);
 }
 
 
-/*! Thread function for the process controller. Waits for the process to
- * terminate and reads it's result, if no error occured.
+/*! Sends the changes to the workspace since the worker was synchronized
+ * last time. Relations are passed in a shared memory object, all other
+ * objects in their Lua representation. The changes must be followed by a
+ * request. See \ref _eval_worker_read_sync for the worker's side.
  *
  * \author stb
- * \param data The pointer to the worker_ctrl_info structure.
+ * \return Returns FALSE if the changes could not be sent. The worker's state
+ *         is unknown in this case.
  */
-static
-void _worker_controller_thread (void *data)
+static gboolean _eval_worker_write_sync (Worker * worker, GError ** perr)
 {
-	struct worker_ctrl_info *wci = (struct worker_ctrl_info*) data;
-	int ret;
+	Relview * rv = rv_get_instance();
+	WorkspaceSync * sync = _eval_sync ();
+	EvalWorkerData * data = (EvalWorkerData*) worker_get_data (worker);
+	FILE * fp = worker_get_requests (worker);
+	GList * changes = NULL, *iter;
+	GPtrArray * roots = g_ptr_array_new ();
+	guint root_index = 0;
+	gboolean ok = TRUE;
+
+	workspace_sync_foreach_change (sync, data->generation,
+			(WorkspaceSyncFunc) _collect_sync_change, &changes);
+	changes = g_list_reverse (changes);
+
+	for (iter = changes ; iter ; iter = iter->next) {
+		SyncChange * c = (SyncChange*) iter->data;
+		if (c->obj && WORKSPACE_SYNC_RELATION == c->kind)
+			g_ptr_array_add (roots, kure_rel_get_bdd(rel_get_impl((Rel*) c->obj)));
+	}
 
-	MESSAGE("controller> started! Waiting for the worker process, or user cancelation ...\n");
+	if (roots->len > 0) {
+		gchar * shm_name = bdd_transfer_shm_name (getpid(),
+				worker_get_pid (worker), "sync");
+		ok = bdd_transfer_store_many (
+				kure_context_get_manager(rv_get_context(rv)),
+				(DdNode**) roots->pdata, roots->len, shm_name, perr);
+		g_free (shm_name);
+	}
 
-	Semaphore_wait(wci->semId);
+	if (ok) {
+		MESSAGE ("main> Sending %u changes (%u relations) to worker (pid: %d).\n",
+				g_list_length (changes), roots->len, worker_get_pid (worker));
+
+		fprintf (fp, "%8u%8u", g_list_length (changes), roots->len);
+
+		for (iter = changes ; iter ; iter = iter->next) {
+			SyncChange * c = (SyncChange*) iter->data;
+			RvSyncOp op = SYNC_DELETE;
+			const gchar * code;
+			size_t size;
+
+			if (c->obj) {
+				switch (c->kind) {
+				case WORKSPACE_SYNC_RELATION: op = SYNC_REL; break;
+				case WORKSPACE_SYNC_FUNCTION: op = SYNC_FUN; break;
+				case WORKSPACE_SYNC_PROGRAM: op = SYNC_PROG; break;
+				case WORKSPACE_SYNC_DOMAIN: op = SYNC_DOM; break;
+				default: g_assert_not_reached ();
+				}
+			}
 
-	/* check whether the user canceled the evaluation, or the child process
-	 * finished it. */
-	ret = g_mutex_trylock (wci->mutex) ? 0 : 1;
+			fprintf (fp, "%4d", (int) op);
+			write_string (fp, c->name, strlen (c->name));
 
+			switch (op) {
+			case SYNC_REL: {
+				mpz_t rows, cols;
 
-	if (0 == ret) /* worker finished first; we got the lock! */
-	{
-		int status;
-		RvStatusCode code;
+				mpz_init (rows); mpz_init (cols);
+				rel_get_rows ((Rel*) c->obj, rows);
+				rel_get_cols ((Rel*) c->obj, cols);
+				fprintf (fp, "%8u", root_index ++);
+				_bignum_serialize_to_stream (fp, rows);
+				_bignum_serialize_to_stream (fp, cols);
+				mpz_clear (rows); mpz_clear (cols);
+				break;
+			}
+			/* The bytecode saves the parser in the worker. */
+			case SYNC_FUN:
+				code = fun_get_luabin ((Fun*) c->obj, &size);
+				write_string (fp, code, size);
+				break;
+			case SYNC_PROG:
+				code = prog_get_luabin ((Prog*) c->obj, &size);
+				write_string (fp, code, size);
+				break;
+			case SYNC_DOM: {
+				Dom * dom = (Dom*) c->obj;
+				const gchar * comp1 = dom_get_first_comp_lua (dom);
+				const gchar * comp2 = dom_get_second_comp_lua (dom);
+
+				fprintf (fp, "%4d", (int) dom_get_type (dom));
+				write_string (fp, comp1, strlen (comp1));
+				write_string (fp, comp2, strlen (comp2));
+				break;
+			}
+			default: break;
+			}
+		}
 
-		MESSAGE("controller> Settings the buttons sensitivity to FALSE ... ");
-		gdk_threads_enter();
-		{
-			gtk_widget_set_sensitive (wci->buttonCancelEval, FALSE);
+		if (ferror (fp)) {
+			g_set_error_literal (perr, rv_error_domain(), 0,
+					"Unable to send the changes to the worker process.");
+			ok = FALSE;
 		}
-		gdk_threads_leave();
-		MESSAGE("done\n");
+		else data->generation = workspace_sync_get_generation (sync);
+	}
 
-		MESSAGE("controller> the worker finished evaluation. Check for errors.\n");
+	for (iter = changes ; iter ; iter = iter->next) {
+		g_free (((SyncChange*) iter->data)->name);
+		g_free (iter->data);
+	}
+	g_list_free (changes);
+	g_ptr_array_free (roots, TRUE);
+	return ok;
+}
 
-		g_mutex_unlock (wci->mutex);
 
-		read_status_code(wci->pipeIn, &code);
-		MESSAGE("controller> Status from worker process: %s\n", (code
-				== SUCCESS) ? "SUCCESS" : "ERROR");
-		wci->statusCode = code;
+/*! Applies the changes written by \ref _eval_worker_write_sync in the worker
+ * process. Returns FALSE on error. *peof is set to TRUE, if the main process
+ * has closed the stream.
+ *
+ * \author stb
+ */
+static gboolean _eval_worker_read_sync (Relview * rv, lua_State * L, FILE * fp,
+		gboolean * peof, GError ** perr)
+{
+	KureContext * context = rv_get_context(rv);
+	DdManager * manager = kure_context_get_manager(context);
+	unsigned int count, root_count, i;
+	DdNode ** roots = NULL;
+	guint loaded_count = 0;
+	gboolean ok = TRUE;
+
+	*peof = FALSE;
+	if (2 != fscanf (fp, "%8u%8u", &count, &root_count)) {
+		*peof = TRUE;
+		return FALSE;
+	}
 
-		if (SUCCESS == code)
-		{
-			MESSAGE("controller> child finished\n");
+	if (root_count > 0) {
+		gchar * shm_name = bdd_transfer_shm_name (getppid(), getpid(), "sync");
+		roots = bdd_transfer_load_many (manager, shm_name, &loaded_count, perr);
+		g_free (shm_name);
+		if ( !roots) return FALSE;
+		else if (loaded_count != root_count) {
+			g_set_error (perr, rv_error_domain(), 0, "Expected %u relations, "
+					"but got %u.", root_count, loaded_count);
+			ok = FALSE;
+		}
+	}
+
+	/* The changes are in the order they happened. Domains come last. */
+	for (i = 0 ; ok && i < count ; ++i) {
+		int op;
+		gchar * name = NULL;
 
-			/* wait until the main thread entered it's main loop */
-			MESSAGE("controller> waiting for the main loop ...\n");
-			g_mutex_lock (wci->syncMutex);
-			MESSAGE("controller> main loop started ...\n");
-			g_mutex_unlock (wci->syncMutex);
+		if (1 != fscanf (fp, "%4d", &op) || !read_string (fp, &name, NULL)) {
+			g_set_error_literal (perr, rv_error_domain(), 0,
+					"Unexpected end of the changes.");
+			ok = FALSE;
+			break;
+		}
 
-			MESSAGE("controller> dialog closed?\n");
+		switch ((RvSyncOp) op) {
+		case SYNC_DELETE:
+			/* Our copy of the workspace still knows the object. Maps "$"
+			 * like below. */
+			rv_lang_unbind (L, name);
+			break;
+		case SYNC_REL: {
+			unsigned int index;
+			mpz_t rows, cols;
+
+			if (1 != fscanf (fp, "%8u", &index) || index >= loaded_count) {
+				g_set_error (perr, rv_error_domain(), 0, "Invalid BDD for "
+						"relation \"%s\".", name);
+				ok = FALSE;
+				break;
+			}
 
-			gdk_threads_enter();
-			MESSAGE("controller> dialog closed?\n");
+			mpz_init (rows); mpz_init (cols);
+			_bignum_deserialize_from_stream (fp, rows);
+			_bignum_deserialize_from_stream (fp, cols);
 			{
-				DdNode * bdd = NULL;
-				mpz_t rows, cols;
-				KureContext * context = rv_get_context(wci->rv);
+				KureRel * impl = kure_rel_new_from_bdd (context, roots[index],
+						rows, cols);
+				kure_lua_set_rel_copy (L, _lua_global_name (name), impl);
+				kure_rel_destroy (impl);
+			}
+			mpz_clear (rows); mpz_clear (cols);
+			break;
+		}
+		case SYNC_FUN:
+		case SYNC_PROG: {
+			gchar * code = NULL;
+			size_t size;
+
+			if ( !read_string (fp, &code, &size)) {
+				g_set_error (perr, rv_error_domain(), 0, "Missing code for "
+						"\"%s\".", name);
+				ok = FALSE;
+				break;
+			}
 
-				mpz_init(rows);
-				mpz_init(cols);
+			/* Usually bytecode, which carries its own chunk name. See
+			 * rv_lang_compile. */
+			if (luaL_loadbuffer (L, code, size, name) || lua_pcall (L, 0, 0, 0)) {
+				g_set_error (perr, rv_error_domain(), 0, "Unable to load \"%s\" "
+						"into Lua. Reason: %s", name, lua_tostring (L, -1));
+				lua_pop (L, 1);
+				ok = FALSE;
+			}
+			g_free (code);
+			break;
+		}
+		case SYNC_DOM: {
+			int type;
+			gchar * comp1 = NULL, *comp2 = NULL;
+
+			if (1 != fscanf (fp, "%4d", &type)
+					|| !read_string (fp, &comp1, NULL)
+					|| !read_string (fp, &comp2, NULL)) {
+				g_set_error (perr, rv_error_domain(), 0, "Missing components "
+						"for domain \"%s\".", name);
+				ok = FALSE;
+			}
+			else {
+				KureDom * kdom = rv_lang_resolve_dom (L, name, (DomainType) type,
+						comp1, comp2, NULL, NULL);
+				/* Like rv_lang_new_state, we ignore invalid domains. */
+				if (kdom) {
+					kure_lua_set_dom_copy (L, _lua_global_name (name), kdom);
+					kure_dom_destroy (kdom);
+				}
+				else {
+					lua_pushnil (L);
+					lua_setglobal (L, _lua_global_name (name));
+				}
+			}
+			g_free (comp1);
+			g_free (comp2);
+			break;
+		}
+		default:
+			g_set_error (perr, rv_error_domain(), 0, "Unknown change %d.", op);
+			ok = FALSE;
+		}
 
-				_bignum_deserialize_from_stream(wci->pipeIn, rows);
-				_bignum_deserialize_from_stream(wci->pipeIn, cols);
+		g_free (name);
+	}
 
-#if VERBOSE
-				fprintf (stderr, "_worker_controller_thread: Cudd_ReadOne (%p) has ref-count of %d\n",
-						Cudd_ReadOne(kure_context_get_manager(context)),
-						Cudd_ReadOne(kure_context_get_manager(context))->ref);
-#endif
+	if (roots) {
+		for (i = 0 ; i < loaded_count ; ++i)
+			Cudd_RecursiveDeref (manager, roots[i]);
+		g_free (roots);
+	}
 
-				MESSAGE("controller> Dddmp_cuddBddLoad (...) started.\n");
-				bdd = Dddmp_cuddBddLoad(kure_context_get_manager(context),
-						DDDMP_VAR_MATCHIDS, NULL,
-						NULL, NULL, DDDMP_MODE_DEFAULT, NULL, wci->pipeIn);
-				MESSAGE("controller> Dddmp_cuddBddLoad (...) finished.\n");
-				assert (bdd);
-#if VERBOSE
-				fprintf (stderr, "_worker_controller_thread: Cudd_Ref(%p)\n", bdd);
-#endif
-				Cudd_Ref(bdd);
+	return ok;
+}
 
-#if VERBOSE
-				gmp_fprintf (stderr,"_worker_controller_thread: Calling kure_rel_new_from_bdd(context, %p, %Zd, %Zd)\n",
-						bdd, rows, cols);
-				fprintf (stderr, "_worker_controller_thread: Refs of node %p before new from bdd: %d (align: %d)\n",
-						bdd, Cudd_Regular(bdd)->ref, &((DdNode*)NULL)->ref);
-#endif
-				wci->result_impl = kure_rel_new_from_bdd(context, bdd, rows, cols);
-#if VERBOSE
-				fprintf (stderr, "_worker_controller_thread: Refs of node %p before deref: %d\n", bdd, Cudd_Regular(bdd)->ref);
-#endif
-				Cudd_Deref(bdd);
-				if (Cudd_IsNonConstant(bdd))
-					Cudd_Deref(bdd); // NOTE: Workaround! Don't know why this is necessary.
-				mpz_clear(rows);
-				mpz_clear(cols);
 
-#if VERBOSE
-				fprintf (stderr, "kure_rel_new_from_bdd: sizeof(DdNode): %d\n", sizeof(DdNode));
-				fprintf (stderr, "_worker_controller_thread: Refs of node %p after deref: %d\n", bdd, Cudd_Regular(bdd)->ref);
-				fprintf (stderr, "_worker_controller_thread: ZERO->ref=%d\n", Cudd_ReadOne(kure_context_get_manager(context))->ref);
-#endif
+/*! Main loop of an evaluation worker. Applies the changes to the workspace
+ * and evaluates the term of each request until the main process closes the
+ * request stream. See \ref WorkerPoolMainFunc.
+ */
+static void _eval_worker_main (gpointer state, FILE * requests, FILE * results,
+		int semId, gpointer user_data)
+{
+	Relview * rv = (Relview*) user_data;
+	lua_State * L = ((EvalWorkerState*) state)->L;
+	gchar ** terms = NULL, ** relNames = NULL;
+	guint count = 0;
+	GError * err = NULL;
+	gboolean eof = FALSE;
+	int r;
+	long int cudd_r;
+	RvComputeFlags flags;
+
+	signal (SIGSEGV, _sigsegv_in_child_handler);
+
+	/* The metrics are optional. */
+	{
+		gchar * shm_name = bdd_transfer_shm_name (getppid(), getpid(), "metrics");
+		_worker_metrics = eval_metrics_channel_open (shm_name, &err);
+		if ( !_worker_metrics) {
+			MESSAGE ("worker> No metrics: %s\n", err->message);
+			g_clear_error (&err);
+		}
+		g_free (shm_name);
+	}
 
-				/* tha case that a relation with the choosen name already exists, is
-				 * handled in the main thread. */
-
-				/* read the random numbers from the pipe */
-				{
-					int r;
-					long int cudd_r;
-					fscanf(wci->pipeIn, "%d %ld\n", &r, &cudd_r);
-					MESSAGE("contoller> Read random numbers: %d %ld\n", r,
-							cudd_r);
-					srandom(r);
-					Cudd_Srandom(cudd_r);
-				}
+	while (TRUE) {
+		int sig = -1;
 
-				gdk_flush();
+		if ( !_eval_worker_read_sync (rv, L, requests, &eof, &err)) {
+			if ( !eof) {
+				/* The workspace is inconsistent. The main process kills us. */
+				Semaphore_post (semId);
+				write_status_code (results, FATAL_ERROR);
+				write_message (results, err->message);
+				fflush (results);
+				g_error_free (err);
 			}
-			gdk_threads_leave();
+			break;
+		}
 
-			/* prevent the worker from becoming a zombie */
-			do
-			{
-				ret = waitpid(wci->child, &status, 0);
-				if (ret < 0 && errno != EINTR)
-				{
-					perror("waitpid");
-					assert (FALSE);
-				}
-			} while (ret != wci->child);
+		if ( !read_request (requests, &terms, &relNames, &count, &r,
+				&cudd_r, &flags))
+			break;
 
+		srandom (r);
+		Cudd_Srandom (cudd_r);
 
-			gdk_threads_enter();
-			{
-				g_signal_emit_by_name(GTK_DIALOG (wci->dialog), "close");
-				gdk_flush();
-			}
-			gdk_threads_leave();
+		sig = setjmp (_child_env);
+		if (0 == sig) /* first try */
+			_compute_terms_process(rv, L, results, terms, relNames, count,
+					flags, semId);
+		else {
+			Semaphore_post (semId);
+			write_status_code (results, FATAL_ERROR);
+
+			if (SIGSEGV == sig)
+				write_message (results, "Caught SIGSEGV. Please save your current "
+						"state and restart the systems.");
+			else
+				write_message (results, "Unknown signal caught.");
+
+			/* Our state is unknown. The main process kills us. */
+			fflush (results);
+			g_strfreev (terms);
+			g_strfreev (relNames);
+			break;
 		}
-		else /* code != SUCCESS (error during evaluation) */
-		{
-			MESSAGE("controller> error during evaluation (%s)!\n",
-					(SYNTAX_ERROR == code) ? "syntax error" : (EVAL_ERROR
-							== code) ? "evaluation error" : "unknown error");
 
-			/* In case of an error, read the error message from the pipe. */
-			read_message(wci->pipeIn, &wci->errmsg);
+		fflush (results);
+		g_strfreev (terms);
+		g_strfreev (relNames);
+		terms = relNames = NULL;
+	}
 
-			/* wait until the main thread entered it main loop */
-			MESSAGE("controller> waiting for the main loop ...\n");
-			g_mutex_lock (wci->syncMutex);
-			MESSAGE("controller> main loop started ...\n");
-			g_mutex_unlock (wci->syncMutex);
+	if (_worker_metrics) eval_metrics_channel_close (_worker_metrics);
+	MESSAGE ("worker> Exit.\n");
+}
 
-			gdk_threads_enter();
-			{
-				g_signal_emit_by_name(GTK_DIALOG (wci->dialog), "close");
-				//gdk_flush();
-			}
-			gdk_threads_leave();
+/*! Removes the worker's shared memory objects and its data. See
+ * \ref WorkerPoolExitedFunc.
+ */
+static void _eval_worker_exited (Worker * worker, gpointer user_data)
+{
+	static const gchar * purposes[] = { "result", "sync", "metrics", NULL };
+	EvalWorkerData * data = (EvalWorkerData*) worker_get_data (worker);
+	const gchar ** ptr;
+
+	for (ptr = purposes ; *ptr ; ++ptr) {
+		gchar * shm_name = bdd_transfer_shm_name (getpid(),
+				worker_get_pid (worker), *ptr);
+		bdd_transfer_unlink (shm_name);
+		g_free (shm_name);
+	}
 
-			/* prevent the worker from becoming a zombie */
-			do
-			{
-				ret = waitpid(wci->child, &status, 0);
-				if (ret < 0)
-				{
-					perror("waitpid");
-					assert (FALSE);
-				}
-			} while (ret != wci->child);
-		}
+	if (data) {
+		if (data->metrics) eval_metrics_channel_close (data->metrics);
+		g_free (data);
 	}
-	else /* user cancelation */
-	{
-		MESSAGE("controller> mutex (%p) don't got the lock!\n", wci->mutex);
+}
 
-		MESSAGE("controller> user cancelation\n");
+static WorkerPoolClass _eval_worker_class = {
+	_eval_worker_prepare, _eval_worker_main, _eval_worker_release,
+	_eval_worker_exited };
 
-		/* in this case the user has already quit the dialog's
-		 * main loop. */
 
-		MESSAGE("controller> mutex (%p) unlock!\n", wci->mutex);
-		g_mutex_unlock (wci->mutex);
-	}
+/*! One worker per processor by default. */
+static gint _eval_default_workers ()
+{
+	long n = sysconf (_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (gint) n : 1;
+}
 
-	MESSAGE("controller> exited.\n");
+static void _eval_pool_prefs_changed (WorkerPool * pool, const gchar * section,
+		const gchar * key)
+{
+	if (g_str_equal (section, "settings") && g_str_equal (key, "eval_workers"))
+		worker_pool_set_size (pool, prefs_get_int ("settings", "eval_workers", _eval_default_workers ()));
 }
 
 
-/*! Callback which get called, when the dialog entered it's main loop in
- * the gtk_dialog_run () routine. Sets a mutex which shows the controller
- * thread, that the dialog may get closed.
+/*! Returns the pool of evaluation workers. The workers have a copy of the
+ * workspace. Changes to the workspace are sent along with the next request.
+ * See \ref _eval_worker_write_sync.
  *
  * \author stb
- * \param data The pointer to the worker_ctrl_info structure.
- * \return Return FALSE, so the beloning source get kicked from the
- *         dialogs main loop.
  */
-static gboolean _sync_threads (gpointer data)
+static WorkerPool * _eval_pool ()
 {
-  struct worker_ctrl_info *wci = (struct worker_ctrl_info*) data;
-
-  g_mutex_unlock (wci->syncMutex);
-
-  return FALSE;
-}
+	static WorkerPool * pool = NULL;
 
+	if ( !pool) {
+		static PrefsObserver po = {0};
+		Relview * rv = rv_get_instance();
 
+		/* The journal must exist before the first worker is created. */
+		_eval_sync ();
 
-/*! After the fork () the parent process calls this routine. It shows the
- * dialog to cancel the evaluation and waits for the dialog to get closed
- * by either the controller thread (ie. when the child process finished, or
- * an error occured), or the user.
- *
- * \author stb
- * \param pipeIn The read-only pipe to the child process.
- * \param child The child PID.
- * \param semId The semaphore, the controller thread will use to control
- *              the child process.
- * \param relName The rel. name, the evaluation result should stored in.
- *                A current relation, if exist, will get removed.
- */
-void _parent_process(FILE * pipeIn, pid_t child, int semId,
-		const gchar *relName, const gchar *term, RvComputeFlags flags)
-{
-	GThread *thread = NULL;
-	struct worker_ctrl_info wci = { 0 };
-	guint timeoutId;
-	GSource *timeoutSource;
-	Relview * rv = rv_get_instance();
-	GtkBuilder * builder = rv_get_gtk_builder(rv);
-	gulong handler_id;
-
-	wci.child = child;
-	wci.semId = semId;
-	wci.pipeIn = pipeIn;
-	wci.relName = relName;
-	wci.statusCode = UNKNOWN;
-	wci.errmsg = NULL;
-	wci.result_impl = NULL;
-
-	/* create a dialog to interact with the user and also create a thread
-	 * to control the worker process. When the user requests abortion,
-	 * the controller thread will close the dialog's main loop. */
-
-	wci.rv = rv;
-	wci.dialog = GTK_WIDGET(gtk_builder_get_object(builder, "dialogEvalProgress"));
-	gtk_window_set_transient_for (wci.dialog, GTK_WINDOW(eval_window_get_widget(eval_window_get_instance())));
-	gtk_window_set_modal (wci.dialog, TRUE);
-	/* GTK_WIN_POS_CENTER (as set in Glade) doesn't seem to keep the window
-	 * centered after it popped up several times. GTK_WIN_POS_CENTER_ALWAYS
-	 * seem to work even if the GTK Ref. says it is some sort of cursed. */
-	gtk_window_set_position (wci.dialog, GTK_WIN_POS_CENTER_ALWAYS);
-	wci.buttonCancelEval = GTK_WIDGET(gtk_builder_get_object(builder, "buttonCancelEval"));
-	gtk_widget_set_sensitive (wci.buttonCancelEval, TRUE);
+		pool = worker_pool_new (prefs_get_int ("settings", "eval_workers", _eval_default_workers ()),
+				&_eval_worker_class, rv);
 
-	{
-		GError *error;
+		po.changed = PREFS_OBSERVER_CHANGED_FUNC(_eval_pool_prefs_changed);
+		po.object = pool;
+		prefs_register_observer (&po);
+	}
 
-		wci.mutex = g_mutex_new ();
-		wci.syncMutex = g_mutex_new ();
+	return pool;
+}
 
-		g_mutex_lock (wci.syncMutex);
 
-		thread = g_thread_create ((GThreadFunc) _worker_controller_thread,
-				(gpointer) &wci,
-				TRUE /*joinable*/, &error);
-		if (NULL == thread)
-		{
-			MESSAGE("controller> %s\n", error->message);
-			assert (FALSE);
-		}
+/*! Sends the terms of the job along with the changes to the workspace to
+ * the worker. Returns FALSE if the worker is unusable.
+ */
+static gboolean _eval_worker_send (Worker * worker, EvalJob * job,
+		GError ** perr)
+{
+	gchar ** terms, ** relNames;
+	gboolean ok;
+	guint i;
+
+	if ( !_eval_worker_write_sync (worker, perr))
+		return FALSE;
+
+	terms = g_new (gchar*, job->item_count);
+	relNames = g_new (gchar*, job->item_count);
+	for (i = 0 ; i < job->item_count ; ++i) {
+		terms[i] = job->items[i].term;
+		relNames[i] = job->items[i].relName;
 	}
 
-	wci.timer = g_timer_new();
-	MESSAGE("main> create_dialogEvalProgress () ...\n");
+	ok = write_request (worker_get_requests(worker), terms, relNames,
+			job->item_count, job->flags);
+	g_free (terms);
+	g_free (relNames);
 
-	handler_id = g_signal_connect (G_OBJECT (wci.buttonCancelEval), "clicked",
-			G_CALLBACK (on_buttonCancelEval_clicked),
-			(gpointer) &wci);
-
-	timeoutId = g_timeout_add(60 /*ms*/, _timeout_func, (gpointer) &wci);
+	if ( !ok) {
+		g_set_error_literal (perr, rv_error_domain(), 0,
+				"Unable to send the terms to the worker process.");
+		return FALSE;
+	}
+	else return TRUE;
+}
 
-	g_idle_add(_sync_threads, &wci);
-	gtk_dialog_run(GTK_DIALOG (wci.dialog));
 
-	MESSAGE("main> gtk_dialog_run has finished ...\n");
+/*******************************************************************************
+ *                              Split Evaluation                               *
+ ******************************************************************************/
 
-	/* We left the main loop. That means, An event has occurred. Start cleanup
-	 * an see what's happend. First, hide the window which show the progress
-	 * bar. */
-	gtk_widget_hide(wci.dialog);
+/* Default minimum number of BDD nodes of the relations an operand uses, for
+ * the operand to be evaluated by a worker on its own. */
+#define EVAL_SPLIT_DEFAULT_MIN_NODES 10000
 
-	/* Because we use GtkBuilder and reuse our evaluation progress widget,
-	 * we have to remove the previous handler so it isn't used next time. */
-	g_signal_handler_disconnect(G_OBJECT(wci.buttonCancelEval), handler_id);
+/* A term of the form "T1 op T2 op ... op Tn" with op being an intersection
+ * or a union, whose operands are evaluated in parallel by separate jobs.
+ * The results are combined in the main process. */
+typedef struct _EvalSplit
+{
+  gchar * term;
+  gchar * relName;
+  RvComputeFlags flags;
+  gchar op;
+  guint count;
+  guint pending;
+  EvalJob ** jobs; /*!< NULL once the part has completed. */
+  gboolean * completed;
+  KureRel ** results;
+  GString * errors;
+  gboolean canceled;
+  guint queuing; /*!< Index of the part which is being queued. */
+  gboolean busy; /*!< Prevents the split from being finished while parts
+                  * are queued or canceled. */
+} EvalSplit;
+
+/*! Returns the term without surrounding whitespaces and parentheses which
+ * enclose the whole term. */
+static gchar * _term_strip_parens (const gchar * term)
+{
+	gchar * s = g_strstrip (g_strdup (term));
 
-	timeoutSource = g_main_context_find_source_by_id(NULL /* default context */, timeoutId);
-	g_source_destroy(timeoutSource);
-	g_timer_destroy(wci.timer);
+	while ('(' == s[0]) {
+		gint depth = 0;
+		gchar * p;
 
-	/* wait for the controller */
-	MESSAGE("main> wait for the process controller thread ...\n");
-	g_thread_join(thread);
+		for (p = s ; *p ; ++p) {
+			if ('(' == *p || '[' == *p || '{' == *p) depth ++;
+			else if (')' == *p || ']' == *p || '}' == *p) {
+				if (--depth == 0) break;
+			}
+		}
 
-	MESSAGE("main> destroy mutexes and semaphores\n");
-	MESSAGE("main> mutex (%p) unlock and free\n", wci.mutex);
-	g_mutex_free (wci.mutex);
-	g_mutex_free (wci.syncMutex);
+		/* The first parenthesis must close at the end. */
+		if (*p && '\0' == *(p+1)) {
+			gchar * t;
 
-	if (SUCCESS == wci.statusCode)
-	/* At this point, the worker thread has transfered the relation into our
-	 * global manager. */
+			*p = '\0';
+			t = g_strstrip (g_strdup (s + 1));
+			g_free (s);
+			s = t;
+		}
+		else break;
+	}
+	return s;
+}
 
-	/* If a relation with the given name already exists, ask the user
-	 * what to do (cancel, overwrite, enter another name). */
-	{
-		gboolean inserted;
-		DdManager * table = kure_context_get_manager(kure_rel_get_context(wci.result_impl));
-		Rel * localRel = rel_new_from_impl(wci.relName, wci.result_impl);
+/*! Splits the term at each occurrence of the given operator outside of
+ * parentheses and brackets. Operands which are of the same form are split
+ * too, because the operators are associative. The stripped operands are
+ * added to the array. Returns FALSE and adds nothing if the operator
+ * doesn't occur at the top level. */
+static gboolean _term_split_top (const gchar * term, gchar op,
+		GPtrArray * operands)
+{
+	gchar * s = _term_strip_parens (term);
+	GPtrArray * pieces = g_ptr_array_new ();
+	const gchar * begin = s, * p;
+	gint depth = 0;
+	guint i;
+
+	for (p = s ; *p ; ++p) {
+		if ('(' == *p || '[' == *p || '{' == *p) depth ++;
+		else if (')' == *p || ']' == *p || '}' == *p) depth --;
+		else if (op == *p && 0 == depth) {
+			g_ptr_array_add (pieces, g_strndup (begin, p - begin));
+			begin = p + 1;
+		}
+	}
 
-#if VERBOSE
-    	printf ("_parent_process: Ref. Count of BDD %p of the newly "
-    			"created Rel \"%s\" (%p, KureRel: %p) is %d\n",
-    			kure_rel_get_bdd(rel_get_impl(localRel)),
-    			rel_get_name (localRel), localRel, rel_get_impl(localRel),
-    			Cudd_Regular(kure_rel_get_bdd(rel_get_impl(localRel)))->ref);
-
-    	fprintf (stderr, "_parent_process: ZERO->ref=%d\n", Cudd_ReadOne(table)->ref);
-    	Cudd_ReadOne(table)->type;
-    	Cudd_DeadAreCounted();
-#endif
+	if (0 == pieces->len) {
+		g_ptr_array_free (pieces, TRUE);
+		g_free (s);
+		return FALSE;
+	}
 
-#ifdef VERBOSE
-		// Debug code
-		Cudd_CheckZeroRef (table);
-		Cudd_CheckKeys (table);
-		cuddGarbageCollect(table, 1);
-#endif
+	g_ptr_array_add (pieces, g_strdup (begin));
+	for (i = 0 ; i < pieces->len ; ++i) {
+		gchar * piece = (gchar*) g_ptr_array_index (pieces, i);
 
+		if ( !_term_split_top (piece, op, operands))
+			g_ptr_array_add (operands, _term_strip_parens (piece));
+		g_free (piece);
+	}
 
-    	if (flags & RV_COMPUTE_FLAGS_FORCE_OVERWRITE) {
-    		/* delete the existing relation, with the desired name,
-    		 * if there is one. (See above.) */
-    		RelManager * manager = rv_get_rel_manager(rv);
+	g_ptr_array_free (pieces, TRUE);
+	g_free (s);
+	return TRUE;
+}
 
-    		rel_manager_delete_by_name(manager, wci.relName);
-    		rel_manager_insert(manager, localRel);
-    		inserted = TRUE;
-    	}
-    	else inserted = rv_user_rename_or_not(rv, localRel);
+static gboolean _sum_rel_nodes (const gchar * name, gpointer value, gulong * psum)
+{
+	Rel * rel = rel_manager_get_by_name (rv_get_rel_manager(rv_get_instance()), name);
+	if (rel)
+		*psum += rel_get_node_count (rel);
+	return FALSE;
+}
 
-#if VERBOSE
-    	printf ("_parent_process: Ref. Count of BDD %p of the newly "
-    			"created Rel \"%s\" (%p, KureRel: %p) is %d\n",
-    			kure_rel_get_bdd(rel_get_impl(localRel)),
-    			rel_get_name (localRel), localRel, rel_get_impl(localRel),
-    			Cudd_Regular(kure_rel_get_bdd(rel_get_impl(localRel)))->ref);
-#endif
+/*! Estimates the costs of an operand by the number of BDD nodes of the
+ * relations it uses directly. Returns 0 for a plain identifier, because
+ * there is nothing to evaluate. */
+static gulong _term_estimate_nodes (const gchar * term)
+{
+	GHashTable * idents;
+	const gchar * p;
+	gulong sum = 0;
+
+	for (p = term ; *p ; ++p)
+		if ( !g_ascii_isalnum (*p) && '_' != *p && '$' != *p) break;
+	if ('\0' == *p)
+		return 0;
+
+	idents = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	rv_lang_term_collect_identifiers (term, idents);
+	g_hash_table_find (idents, (GHRFunc) _sum_rel_nodes, &sum);
+	g_hash_table_destroy (idents);
+	return sum;
+}
 
-		if (inserted) {
-			relation_window_set_relation(relation_window_get_instance(), localRel);
-		}
-		else /* user canceled */ {
-			rel_destroy(localRel);
-		}
+static void _eval_split_destroy (EvalSplit * split)
+{
+	guint i;
+
+	for (i = 0 ; i < split->count ; ++i)
+		if (split->results[i]) kure_rel_destroy (split->results[i]);
+	g_free (split->results);
+	g_free (split->jobs);
+	g_free (split->completed);
+	g_string_free (split->errors, TRUE);
+	g_free (split->term);
+	g_free (split->relName);
+	g_free (split);
+}
 
+/*! Combines the results of the parts and stores the result, or reports the
+ * errors of the parts. Destroys the split. */
+static void _eval_split_finish (EvalSplit * split)
+{
+	if (split->errors->len > 0) {
+		rv_user_error_with_descr ("Evaluation failed", split->errors->str,
+				"Further details are listed below. The term was\n\t\"%s\".",
+				split->term);
 	}
-	else if (USER_CANCELATION == wci.statusCode)
-	{
-		/* no nothing */
-		MESSAGE("main> The user has canceled the evaluation.\n");
-	}
-	else /* wci->statusCode != SUCCESS */
-	{
-		gchar * errmsg = wci.errmsg;
-
-		if ( !wci.errmsg)
-			errmsg = "Unknown error.";
+	else if ( !split->canceled) {
+		KureContext * context = rv_get_context (rv_get_instance());
+		lua_State * L = kure_lua_new (context);
+		GString * expr = g_string_new ("");
+		KureError * kerr = NULL;
+		KureRel * impl;
+		guint i;
+
+		for (i = 0 ; i < split->count ; ++i) {
+			gchar * name = g_strdup_printf ("part%u", i);
+			kure_lua_set_rel_copy (L, name, split->results[i]);
+			g_string_append_printf (expr, "%s%s", i>0 ? (split->op == '&'
+					? " & " : " | ") : "", name);
+			g_free (name);
+		}
 
-		rv_user_error_with_descr ("Evaluation failed", errmsg,
-				"Further details are listed below. The term was\n\t\"%s\".",
-				term);
+		impl = kure_lang_exec (L, expr->str, &kerr);
+		kure_lua_destroy (L);
+		g_string_free (expr, TRUE);
 
-		if ( wci.errmsg) {
-			g_free (wci.errmsg);
-			wci.errmsg = NULL;
+		if (impl)
+			_compute_store_result (split->relName, impl, split->flags);
+		else {
+			rv_user_error_with_descr ("Evaluation failed",
+					(kerr && kerr->message) ? kerr->message : "Unknown error.",
+					"Unable to combine the results of the parts. The term was"
+					"\n\t\"%s\".", split->term);
+			if (kerr) kure_error_destroy (kerr);
 		}
 	}
 
-	return;
+	_eval_split_destroy (split);
 }
 
-
-/* Use to handle SIGSEGV in compute_term_mp. See also _sigsegv_in_child_handler below. */
-jmp_buf _child_env;
-/*!
- * Recover in case of an SIGSEGV. This is important, because the parent process would
- * idle in this case without abortion by the user.
- */
-void _sigsegv_in_child_handler (int signal)
+/*! Cancels the parts which haven't completed yet. */
+static void _eval_split_cancel_parts (EvalSplit * split)
 {
-	longjmp (_child_env, signal);
-}
+	guint i;
 
+	split->busy = TRUE;
+	for (i = 0 ; i < split->count ; ++i)
+		if (split->jobs[i]) eval_job_cancel (split->jobs[i]);
+	split->busy = FALSE;
+}
 
-/*! Evaluates the given term and stores the result in a relation with the
- * given name. If the evaluation takes too long a window appears and offers
- * the user a progress bar and a cancel button to abort the evaluation.
- *
- * \author stb
- * \date 14.04.2008
- * \param term The term so evaluate.
- * \param relName The destination relation.
+/*! Called when a part of a split term has completed. If a part fails or is
+ * canceled, the remaining parts are canceled too. See \ref EvalJobDoneFunc.
  */
-static void compute_term_mp (const gchar *term, const gchar *relNameOrig,
-                             RvComputeFlags flags)
+static void _eval_split_part_done (EvalJob * job, EvalSplit * split)
 {
-	Relview * rv = rv_get_instance();
-	lua_State * L;
+	guint i, index = split->queuing;
+
+	/* A part which completes immediately isn't known yet. */
+	for (i = 0 ; i < split->count ; ++i)
+		if (split->jobs[i] == job) index = i;
+	assert (index < split->count && !split->completed[index]);
+
+	split->jobs[index] = NULL;
+	split->completed[index] = TRUE;
+	split->pending --;
 
-	MESSAGE ("main> Creating Lua state.\n");
-	L = rv_lang_new_state(rv);
-	if (!L)	{
-		MESSAGE ("main> Unable to create Lua state.\n");
+	if (EVAL_JOB_FINISHED == job->state) {
+		split->results[index] = job->items[0].result_impl;
+		job->items[0].result_impl = NULL;
 	}
 	else {
-		gchar * relName = g_strstrip (g_strdup (relNameOrig));
-		int pipefd[2];
-		pid_t child;
-		int semId;
+		if (EVAL_JOB_CANCELED == job->state)
+			split->canceled = TRUE;
+		else g_string_append_printf (split->errors, "%s\n\t%s\n",
+				job->items[0].term, job->items[0].errmsg
+				? job->items[0].errmsg : (job->errmsg ? job->errmsg
+						: "Unknown error."));
+
+		if ( !split->busy)
+			_eval_split_cancel_parts (split);
+	}
 
-		pipe(pipefd);
-		semId = Semaphore_new_private(S_IWUSR | S_IRUSR, 0 /* initial value */);
+	if (0 == split->pending && !split->busy)
+		_eval_split_finish (split);
+}
 
-		child = fork();
-		if (-1 == child)
-		{
-			rv_user_error_with_descr("Internal error", g_strerror(errno),
-					"Unable to fork the process (see below)."
-						"Trying again might solve the problem. Otherwise save your "
-						"workspace and restart the system.");
-			return;
+/*! Evaluates the operands of a wide intersection or union in parallel, if
+ * at least two of them are expensive. The costs are estimated by the sizes
+ * of the relations an operand uses (see the "eval_split_min_nodes"
+ * setting, 0 disables splitting). Cheap operands are evaluated together as
+ * one part. Equal operands are evaluated only once, because both operations
+ * are idempotent. key is the cache key of the whole term. Returns FALSE if
+ * the term isn't split.
+ */
+static gboolean _eval_split_try (const gchar * term, const gchar * relName,
+		RvComputeFlags flags, const EvalCacheKey * key)
+{
+	gulong min_nodes = prefs_get_int ("settings", "eval_split_min_nodes",
+			EVAL_SPLIT_DEFAULT_MIN_NODES);
+	static const gchar ops[] = { '|', '&', '\0' };
+	GPtrArray * operands = g_ptr_array_new_with_free_func (g_free);
+	GPtrArray * parts = g_ptr_array_new_with_free_func (g_free);
+	GHashTable * seen = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, NULL);
+	GString * cheap = g_string_new ("");
+	EvalSplit * split = NULL;
+	const gchar * op;
+	guint i, heavy = 0;
+
+	if (0 == min_nodes || (flags & RV_COMPUTE_FLAGS_PROFILE)
+			|| worker_pool_get_size (_eval_pool ()) < 2)
+		goto out;
+
+	/* The lowest precedence comes first. */
+	for (op = ops ; *op ; ++op)
+		if (_term_split_top (term, *op, operands)) break;
+	if ('\0' == *op)
+		goto out;
+
+	for (i = 0 ; i < operands->len ; ++i) {
+		const gchar * operand = (const gchar*) g_ptr_array_index (operands, i);
+		gchar * normalized = _normalize_term (operand);
+
+		if (g_hash_table_lookup (seen, normalized)) {
+			g_free (normalized);
+			continue;
 		}
-		else if (0 == child) /* child */
-		{
-			int sig = -1;
-			FILE *pipeOut = fdopen(pipefd[1], "w");
-			close(pipefd[0]);
-
-			signal (SIGSEGV, _sigsegv_in_child_handler);
+		g_hash_table_insert (seen, normalized, normalized);
 
-			sig = setjmp (_child_env);
-			if (0 == sig) /* first try */
-				_compute_term_process(rv, L, pipeOut, term, semId);
-			else{
-				Semaphore_post (semId);
-				write_status_code (pipeOut, EVAL_ERROR);
-
-				if (SIGSEGV == sig)
-					write_message (pipeOut, "Caught SIGSEGV. Please save your current "
-							"state and restart the systems.");
-				else
-					write_message (pipeOut, "Unknown signal caught.");
-			}
-
-			fclose(pipeOut);
-			MESSAGE ("worker> Exit.\n");
-			exit(0);
+		if (_term_estimate_nodes (operand) >= min_nodes) {
+			g_ptr_array_add (parts, g_strdup (operand));
+			heavy ++;
 		}
-		else /* parent */
-		{
-			FILE *pipeIn = fdopen(pipefd[0], "r");
-			close(pipefd[1]);
-
-			_parent_process(pipeIn, child, semId, relName, term, flags);
+		else g_string_append_printf (cheap, "%s(%s)", cheap->len > 0
+				? (*op == '&' ? " & " : " | ") : "", operand);
+	}
 
-			fclose(pipeIn);
+	/* Random numbers would differ from a sequential evaluation. */
+	if ( !key->reusable || heavy < 2)
+		goto out;
+
+	if (cheap->len > 0)
+		g_ptr_array_add (parts, g_strdup (cheap->str));
+
+	MESSAGE ("main> Splitting \"%s\" into %u parts.\n", term, parts->len);
+
+	split = g_new0 (EvalSplit, 1);
+	split->term = g_strdup (term);
+	split->relName = g_strstrip (g_strdup (relName));
+	split->flags = flags;
+	split->op = *op;
+	split->count = split->pending = parts->len;
+	split->jobs = g_new0 (EvalJob*, parts->len);
+	split->completed = g_new0 (gboolean, parts->len);
+	split->results = g_new0 (KureRel*, parts->len);
+	split->errors = g_string_new ("");
+
+	/* A part may complete immediately if its result is cached. */
+	split->busy = TRUE;
+	for (i = 0 ; i < parts->len && !split->canceled
+			&& 0 == split->errors->len ; ++i) {
+		const gchar * part = (const gchar*) g_ptr_array_index (parts, i);
+		EvalJob * job;
+		guint id;
+
+		split->queuing = i;
+		id = _eval_job_queue (&part, (const gchar * const *) &split->relName,
+				1, flags, split, NULL, (EvalJobDoneFunc) _eval_split_part_done,
+				split);
+
+		/* The job is gone if it has completed already. */
+		job = eval_queue_lookup_job (id);
+		if (job) {
+			assert ( !split->completed[i]);
+			split->jobs[i] = job;
+			g_free (job->relName);
+			job->relName = g_strdup_printf ("%s [%u/%u]", split->relName,
+					i + 1, split->count);
 		}
+	}
+	split->queuing = split->count;
+	split->pending -= split->count - i; /* parts which were never queued */
+	split->busy = FALSE;
+
+	if (split->canceled || split->errors->len > 0)
+		_eval_split_cancel_parts (split);
+	if (0 == split->pending)
+		_eval_split_finish (split);
+
+out:
+	g_string_free (cheap, TRUE);
+	g_hash_table_destroy (seen);
+	g_ptr_array_free (parts, TRUE);
+	g_ptr_array_free (operands, TRUE);
+	return split != NULL;
+}
 
-		Semaphore_destroy(semId);
-		g_free(relName);
 
-		/* Close earlier? */
-		lua_close(L);
-	}
+/*! Evaluates the given term and stores the result in a relation with the
+ * given name. The term is queued and evaluated in the background by one of
+ * the long-lived worker processes from \ref _eval_pool. The user can watch
+ * and cancel the jobs in the job window.
+ *
+ * \author stb
+ * \date 14.04.2008
+ * \param term The term so evaluate.
+ * \param relName The destination relation.
+ * \param key The key of the term. It's taken over and passed to the job,
+ *            which computes it again only if the inputs have changed until
+ *            the job is started.
+ */
+static void compute_term_mp (const gchar *term, const gchar *relNameOrig,
+                             RvComputeFlags flags, EvalCacheKey * key)
+{
+	if (_eval_split_try (term, relNameOrig, flags, key))
+		_eval_cache_key_destroy (key);
+	else _eval_job_queue (&term, &relNameOrig, 1, flags, NULL, key, NULL, NULL);
 }
 
 
@@ -885,38 +2748,66 @@ static int _lua_assert_func (lua_State * L)
  * \date 17.07.2008
  * \param term The term so evaluate.
  * \param relName The destination relation.
+ * \param key The key of the term for the result cache and the cost history.
+ *            It's taken over. If NULL, neither is used, e.g. because
+ *            assertions have to be checked.
  */
 static void compute_term_seq (const gchar *term, const gchar *relNameOrig,
-                              RvComputeFlags flags)
+                              RvComputeFlags flags, EvalCacheKey * key)
 {
 	lua_State * L;
 	gchar * relName = g_strdup(relNameOrig);
 	Relview * rv = rv_get_instance();
+	KureRel * impl = NULL;
 
 	g_strstrip (relName);
 
 	if (strlen(relName) == 0) {
 		g_warning ("compute_term_seq: Empty relation names are allowed here!\n");
+		if (key) _eval_cache_key_destroy (key);
 		g_free (relName);
 		return;
 	}
 
-	L = rv_lang_new_state(rv);
-	if (!L)	{
+	if (key && !(flags & RV_COMPUTE_FLAGS_PROFILE)
+			&& (impl = _eval_cache_lookup (key))) {
+		gulong hits, misses;
+
+		eval_cache_get_stats (&hits, &misses, NULL);
+		printf ("EVAL-TIME: cached (hits: %lu, misses: %lu)\n", hits, misses);
+		printf ("-------------------------------------------\n");
+		_compute_store_result (relName, impl, flags);
+	}
+	/* The debugger installs its assertion callback and hooks in the state,
+	 * so it gets a state of its own. Otherwise, a child environment of the
+	 * shared state is sufficient. */
+	else if ( !(L = (flags & RV_COMPUTE_FLAGS_CHECK_ASSERTIONS)
+			? rv_lang_state_checkout(rv) : rv_lang_new_env(rv))) {
 		rv_user_error("We've got problems!",
 				"Unable to create a Lua state. Sorry ...");
 	}
 	else {
 		Timer timer;
 		KureError * kerr = NULL;
-		KureRel * impl;
+		EvalMetricsProbe probe;
+		EvalProfile * profile = NULL;
 
 		/* Set the callback for the assertions is necessary. */
 		if (flags & RV_COMPUTE_FLAGS_CHECK_ASSERTIONS) {
 			kure_lang_set_assert_func (L, debug_window_assert_failed_func);
 		}
 
+		/* The profiler would confuse the debugger. */
+		if ((flags & RV_COMPUTE_FLAGS_PROFILE)
+				&& !(flags & RV_COMPUTE_FLAGS_CHECK_ASSERTIONS)) {
+			/* The functions and programs are globals of the shared state. */
+			profile = eval_profile_new ();
+			eval_profile_attach (profile, rv_lang_get_state (rv));
+		}
+
 		_timer_ctor(&timer);
+		eval_metrics_probe_start (&probe,
+				kure_context_get_manager(rv_get_context(rv)));
 		_timer_start(&timer);
 		impl = kure_lang_exec(L, term, &kerr);
 		_timer_stop(&timer);
@@ -932,47 +2823,31 @@ static void compute_term_seq (const gchar *term, const gchar *relNameOrig,
 
 			debug_window_finished_func(L);
 
-			timestr = _format_timings(&timer);
+			timestr = _format_timings(&timer, eval_metrics_probe_sample (&probe));
 			printf ("%s\n", timestr);
 			g_free (timestr);
 		    printf ("-------------------------------------------\n");
+		    if (profile) _print_profile (profile);
 
-		    /* Insert the new relation into the global manager and handle the
-		     * case in which a relation with the given name already exists.
-		     * See \ref rv_user_rename_or_not. */
-		    {
-		    	gboolean inserted;
-		    	Rel * rel = rel_new_from_impl(relName, impl);
-
-#if VERBOSE
-    	printf ("compute_term_seq: Ref. Count of BDD %p of the newly "
-    			"created Rel \"%s\" (%p, KureRel: %p) is %d\n",
-    			kure_rel_get_bdd(rel_get_impl(rel)),
-    			rel_get_name (rel), rel, rel_get_impl(rel),
-    			Cudd_Regular(kure_rel_get_bdd(rel_get_impl(rel)))->ref);
-#endif
-
-		    	if (flags & RV_COMPUTE_FLAGS_FORCE_OVERWRITE) {
-		    		/* delete the existing relation, with the desired name,
-		    		 * if there is one. (See above.) */
-		    		RelManager * manager = rv_get_rel_manager(rv);
-		    		rel_manager_delete_by_name(manager, relName);
-		    		rel_manager_insert(manager, rel);
-		    		inserted = TRUE;
-		    	}
-		    	else inserted = rv_user_rename_or_not(rv, rel);
-
-				if (inserted)
-					relation_window_set_relation(relation_window_get_instance(), rel);
-				else /* user cancelation */
-					rel_destroy(rel);
+		    if (key) {
+		    	_eval_cost_record (key, _timer_secs_elapsed (&timer));
+		    	_eval_cache_insert (key, impl);
+		    	key = NULL;
 		    }
+		    _compute_store_result (relName, impl, flags);
 		}
 
+		if (profile) {
+			eval_profile_detach (profile, rv_lang_get_state (rv));
+			eval_profile_destroy (profile);
+		}
 		_timer_dtor(&timer);
-		lua_close(L);
+		if (flags & RV_COMPUTE_FLAGS_CHECK_ASSERTIONS)
+			rv_lang_state_return (rv, L);
+		else rv_lang_env_destroy (rv, L);
 	}
 
+	if (key) _eval_cache_key_destroy (key);
 	g_free (relName);
 	return;
 }
@@ -995,20 +2870,32 @@ static void compute_term_seq (const gchar *term, const gchar *relNameOrig,
 void compute_term (const gchar *term, const gchar *relNameOrig,
                    RvComputeFlags flags)
 {
+	if (prefs_get_int ("settings", "eval_profile", 0))
+		flags |= RV_COMPUTE_FLAGS_PROFILE;
 
 	/* Assertions can't be checked in multi-processing mode, so we use the
 	 * sequential variant. */
 	if (flags & RV_COMPUTE_FLAGS_CHECK_ASSERTIONS)
 	{
-		compute_term_seq(term, relNameOrig, flags);
+		compute_term_seq(term, relNameOrig, flags, NULL);
 	}
 	else {
+		/* The key is computed only once per evaluation. See
+		 * _eval_cache_key_is_current. */
+		EvalCacheKey * key = _eval_cache_key_new (term);
+
 		if (flags & RV_COMPUTE_FLAGS_SEQUENTIAL)
 		{
-			compute_term_seq(term, relNameOrig, flags);
+			compute_term_seq(term, relNameOrig, flags, key);
+		}
+		/* A term which was cheap before is evaluated right here. That's only
+		 * possible if no job is queued, because a job may change its inputs
+		 * or its result. */
+		else if ( !eval_queue_get_jobs () && _eval_cost_is_cheap (key)) {
+			compute_term_seq (term, relNameOrig, flags, key);
 		}
 		else {
-			compute_term_mp (term, relNameOrig, flags);
+			compute_term_mp (term, relNameOrig, flags, key);
 		}
 	}
 }
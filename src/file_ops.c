@@ -32,6 +32,11 @@
 #include "Relview.h"
 #include "file_ops.h" // includes IOHandler.h
 #include "FileLoader.h" // DefaultReplacePolicyHandler
+#include "config.h" // PACKAGE_VERSION
+#include <lua.h> // LUA_RELEASE, lua_Number
+
+#include <string.h>
+#include <stdlib.h>
 
 
 /****************************************************************************/
@@ -54,49 +59,226 @@ typedef struct {
 	FunManager * funs;
 	ProgManager * progs;
 
+	GString * cache; /*!< If non-NULL, the parsed objects are recorded for
+	                  * the cache. See _prog_cache_store. */
+
 	GError * err;
 } ProgFile;
 
-Kure_bool _on_program (void * object, const char * code, const char * lua_code)
+/*! Appends an object to the cache contents. Each field is the length in
+ * decimal, a newline and the data. */
+static void _prog_cache_append (GString * cache, char kind, const char * code,
+		const char * lua_code)
+{
+	size_t bin_size = 0;
+	gchar * bin = rv_lang_compile (lua_code, strlen (lua_code), &bin_size);
+
+	g_string_append_printf (cache, "%c%lu\n", kind, (unsigned long) strlen (code));
+	g_string_append (cache, code);
+	g_string_append_printf (cache, "%lu\n", (unsigned long) strlen (lua_code));
+	g_string_append (cache, lua_code);
+	g_string_append_printf (cache, "%lu\n", (unsigned long) bin_size);
+	if (bin) g_string_append_len (cache, bin, bin_size);
+	g_free (bin);
+}
+
+static void _add_program (ProgFile * info, const char * code,
+		const char * lua_code, const gchar * bin, size_t bin_size)
 {
-	ProgFile * info = (ProgFile*) object;
 	if ( !info->err) {
 		Prog * f = prog_new_with_lua(code, lua_code, &info->err);
 		if (f) {
 			const gchar * name = prog_get_name(f);
 
+			if (bin_size > 0) prog_set_luabin (f, bin, bin_size);
+
 			if (prog_manager_exists(info->progs, name)
 					|| fun_manager_exists(info->funs, name)) {
 				printf ("%s: Program/file with name \"%s\" already exists. "
 						"Skipped!\n", info->filename, name);
+				prog_destroy (f);
 			}
 			else prog_manager_insert(info->progs, f);
 		}
 	}
-
-	return TRUE; //go on
 }
 
-Kure_bool _on_function (void * object, const char * code, const char * lua_code)
+static void _add_function (ProgFile * info, const char * code,
+		const char * lua_code, const gchar * bin, size_t bin_size)
 {
-	ProgFile * info = (ProgFile*) object;
 	if ( !info->err) {
 		Fun * f = fun_new_with_lua(code, lua_code, &info->err);
 		if (f) {
 			const gchar * name = fun_get_name(f);
 
+			if (bin_size > 0) fun_set_luabin (f, bin, bin_size);
+
 			if (prog_manager_exists(info->progs, name)
 					|| fun_manager_exists(info->funs, name)) {
 				printf ("%s: Program/file with name \"%s\" already exists. "
 						"Skipped!\n", info->filename, name);
+				fun_destroy (f);
 			}
 			else fun_manager_insert(info->funs, f);
 		}
 	}
+}
 
+Kure_bool _on_program (void * object, const char * code, const char * lua_code)
+{
+	ProgFile * info = (ProgFile*) object;
+	if (info->cache) _prog_cache_append (info->cache, 'P', code, lua_code);
+	_add_program (info, code, lua_code, NULL, 0);
+	return TRUE; //go on
+}
+
+Kure_bool _on_function (void * object, const char * code, const char * lua_code)
+{
+	ProgFile * info = (ProgFile*) object;
+	if (info->cache) _prog_cache_append (info->cache, 'F', code, lua_code);
+	_add_function (info, code, lua_code, NULL, 0);
 	return TRUE; //go on
 }
 
+
+/*******************************************************************************
+ *                             Compiled File Cache                             *
+ ******************************************************************************/
+
+/* Program files are translated to Lua by the Kure parser. The result only
+ * depends on the contents of the file and on the version. The translation
+ * and the bytecode are kept in a cache directory, one file per content hash.
+ * See prog_file_set_cache_enabled. */
+
+#define PROG_CACHE_MAGIC "relview-prog-cache 1\n"
+
+static gboolean _prog_cache_enabled = TRUE;
+
+/* An object in a cache file. The fields are the definition, the Lua code
+ * and the bytecode. They point into the contents of the file. */
+typedef struct _ProgCacheEntry
+{
+	char kind; /*!< 'F' or 'P' */
+	const gchar * f[3];
+	gsize len[3];
+} ProgCacheEntry;
+
+void prog_file_set_cache_enabled (gboolean yesno) { _prog_cache_enabled = yesno; }
+
+/*! Returns the path of the cache file for the given program file, or NULL
+ * if the file can't be read. */
+static gchar * _prog_cache_path (const gchar * filename)
+{
+	gchar * contents = NULL, *hash, *base, *path, *build;
+	gsize len;
+	GChecksum * sum;
+
+	if ( !g_file_get_contents (filename, &contents, &len, NULL))
+		return NULL;
+
+	/* Lua bytecode depends on the Lua release and on the binary layout of
+	 * the platform. It's checked by Lua on load as well, but a cache file
+	 * shared with another build would be rejected again and again. */
+	build = g_strdup_printf ("%s %s %u %u %u", PACKAGE_VERSION, LUA_RELEASE,
+			(guint) sizeof (lua_Number), (guint) sizeof (size_t),
+			(guint) G_BYTE_ORDER);
+
+	sum = g_checksum_new (G_CHECKSUM_SHA1);
+	g_checksum_update (sum, (const guchar*) build, strlen (build) + 1);
+	g_checksum_update (sum, (const guchar*) contents, len);
+	hash = g_strdup (g_checksum_get_string (sum));
+	g_checksum_free (sum);
+	g_free (contents);
+	g_free (build);
+
+	base = g_strconcat (hash, ".progc", NULL);
+	path = g_build_filename (g_get_user_cache_dir (), "relview", base, NULL);
+	g_free (base);
+	g_free (hash);
+	return path;
+}
+
+/*! Reads a field written by _prog_cache_append. Returns NULL if the data is
+ * truncated. */
+static const gchar * _prog_cache_read_field (const gchar * p, const gchar * end,
+		const gchar ** pfield, gsize * plen)
+{
+	gchar * nl;
+	unsigned long len;
+
+	if (p >= end) return NULL;
+	len = strtoul (p, &nl, 10);
+	if (nl >= end || '\n' != *nl || (gsize)(end - nl - 1) < len) return NULL;
+
+	*pfield = nl + 1;
+	*plen = len;
+	return nl + 1 + len;
+}
+
+/*! Loads the objects of a program file from the cache. Returns FALSE and
+ * adds nothing if there is no valid cache entry. */
+static gboolean _prog_cache_load (ProgFile * info, const gchar * cache_path)
+{
+	gchar * contents = NULL;
+	gsize len;
+	const gchar * p, * end;
+	GArray * fields;
+	gboolean ok = TRUE;
+	guint i;
+
+	if ( !g_file_get_contents (cache_path, &contents, &len, NULL))
+		return FALSE;
+
+	if ( !g_str_has_prefix (contents, PROG_CACHE_MAGIC)) {
+		g_free (contents);
+		return FALSE;
+	}
+
+	/* Check the whole file before anything is added. */
+	fields = g_array_new (FALSE, FALSE, sizeof (ProgCacheEntry));
+	end = contents + len;
+	for (p = contents + strlen (PROG_CACHE_MAGIC) ; ok && p < end ; ) {
+		ProgCacheEntry e;
+
+		e.kind = *p++;
+		ok = ('F' == e.kind || 'P' == e.kind)
+			&& (p = _prog_cache_read_field (p, end, &e.f[0], &e.len[0]))
+			&& (p = _prog_cache_read_field (p, end, &e.f[1], &e.len[1]))
+			&& (p = _prog_cache_read_field (p, end, &e.f[2], &e.len[2]));
+		if (ok) g_array_append_val (fields, e);
+	}
+
+	for (i = 0 ; ok && i < fields->len ; ++i) {
+		ProgCacheEntry * e = &g_array_index (fields, ProgCacheEntry, i);
+		gchar * code = g_strndup (e->f[0], e->len[0]);
+		gchar * lua_code = g_strndup (e->f[1], e->len[1]);
+
+		if ('F' == e->kind)
+			_add_function (info, code, lua_code, e->f[2], e->len[2]);
+		else _add_program (info, code, lua_code, e->f[2], e->len[2]);
+
+		g_free (code);
+		g_free (lua_code);
+	}
+
+	g_array_free (fields, TRUE);
+	g_free (contents);
+	return ok;
+}
+
+/*! Writes the recorded objects to the cache. Errors are ignored, the cache
+ * is optional. */
+static void _prog_cache_store (const gchar * cache_path, GString * cache)
+{
+	gchar * dir = g_path_get_dirname (cache_path);
+
+	if (0 == g_mkdir_with_parents (dir, 0700)
+			&& !g_file_set_contents (cache_path, cache->str, cache->len, NULL))
+		g_warning ("Unable to write the cache file \"%s\".", cache_path);
+	g_free (dir);
+}
+
+
 static gboolean prog_load_file(Relview * rv, const gchar * path_file,
 		IOHandler_ReplaceCallback replace_callback, gpointer user_data,
 		GError ** perr)
@@ -105,6 +287,7 @@ static gboolean prog_load_file(Relview * rv, const gchar * path_file,
 	KureParserObserver o = {0};
 	ProgFile file_info = {0};
 	Kure_success success;
+	gchar * cache_path = _prog_cache_enabled ? _prog_cache_path (path_file) : NULL;
 
 	file_info.err = NULL; /* non-NULL indicates an error condition. */
 	file_info.filename = path_file;
@@ -112,11 +295,26 @@ static gboolean prog_load_file(Relview * rv, const gchar * path_file,
 	file_info.progs = prog_manager_new ();
 	file_info.rv = rv;
 
-	o.object = &file_info;
-	o.onFunction = _on_function;
-	o.onProgram = _on_program;
+	if (cache_path && _prog_cache_load (&file_info, cache_path)) {
+		VERBOSE(VERBOSE_INFO, printf ("Using the cached translation of \"%s\".\n", path_file););
+		success = TRUE;
+	}
+	else {
+		o.object = &file_info;
+		o.onFunction = _on_function;
+		o.onProgram = _on_program;
+
+		if (cache_path)
+			file_info.cache = g_string_new (PROG_CACHE_MAGIC);
+
+		success = kure_lang_parse_file (path_file, &o, &kerr);
+		if (success && !file_info.err && file_info.cache)
+			_prog_cache_store (cache_path, file_info.cache);
+		if (file_info.cache)
+			g_string_free (file_info.cache, TRUE);
+	}
+	g_free (cache_path);
 
-	success = kure_lang_parse_file (path_file, &o, &kerr);
 	if (! success) {
 		g_set_error_literal(perr, rv_error_domain(), 0, kerr->message);
 		kure_error_destroy(kerr);
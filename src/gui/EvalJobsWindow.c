@@ -0,0 +1,374 @@
+/*
+ * EvalJobsWindow.c
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "EvalJobsWindow.h"
+#include "Relview.h"
+#include "compute.h"
+
+#include <gtk/gtk.h>
+
+/* Time in ms an evaluation may take before the window pops up. */
+#define EVAL_JOBS_WINDOW_POPUP_DELAY 1000
+
+/* Update interval in ms for the elapsed times and the metrics. */
+#define EVAL_JOBS_WINDOW_UPDATE_INTERVAL 500
+
+struct _EvalJobsWindow
+{
+	GtkWidget * window;
+	GtkWidget * treeview;
+	GtkListStore * model;
+
+	guint popup_source; /*!< 0 if none */
+	guint update_source; /*!< 0 if none */
+
+	EvalQueueObserver observer;
+};
+
+enum {
+	JOBS_MODEL_COL_OBJECT,
+	JOBS_MODEL_COL_ID,
+	JOBS_MODEL_COL_REL_NAME,
+	JOBS_MODEL_COL_TERM,
+	JOBS_MODEL_COL_STATE,
+	JOBS_MODEL_COL_TIME,
+	JOBS_MODEL_COL_METRICS,
+
+	JOBS_MODEL_COL_COUNT
+};
+
+
+static const gchar * _job_state_name (EvalJobState state)
+{
+	switch (state) {
+	case EVAL_JOB_QUEUED: return "Queued";
+	case EVAL_JOB_RUNNING: return "Running";
+	case EVAL_JOB_FINISHED: return "Finished";
+	case EVAL_JOB_FAILED: return "Failed";
+	case EVAL_JOB_CANCELED: return "Canceled";
+	default: return "Unknown";
+	}
+}
+
+
+/*!
+ * Formats the elapsed time of a job as "hh:mm:ss".
+ */
+static gchar * _format_elapsed (gdouble telapsed)
+{
+	unsigned secs = ((unsigned) telapsed ) % 60,
+		mins = ((unsigned)(telapsed / 60.0) % 60),
+		hours = ((unsigned)(telapsed / 3600.0));
+
+	return g_strdup_printf ("%.2u:%.2u:%.2u", hours, mins, secs);
+}
+
+
+static gboolean _is_visible (EvalJobsWindow * self)
+{
+#if GTK_MINOR_VERSION >= 18
+	return gtk_widget_get_visible (self->window);
+#else
+	return GTK_WIDGET_VISIBLE(self->window);
+#endif
+}
+
+
+static gboolean _find_job (EvalJobsWindow * self, EvalJob * job,
+		GtkTreeIter * /*out*/ piter)
+{
+	GtkTreeModel * model = GTK_TREE_MODEL(self->model);
+
+	if (gtk_tree_model_get_iter_first (model, piter)) {
+		do {
+			EvalJob * cur = NULL;
+			gtk_tree_model_get (model, piter, JOBS_MODEL_COL_OBJECT,
+					(gpointer*) &cur, -1);
+			if (cur == job) return TRUE;
+		} while (gtk_tree_model_iter_next (model, piter));
+	}
+	return FALSE;
+}
+
+
+/*!
+ * Formats the metrics of a running job's BDD manager. They tell whether
+ * the evaluation is about to blow up.
+ */
+static gchar * _format_metrics (EvalJob * job)
+{
+	EvalMetrics m;
+
+	if ( !eval_job_get_metrics (job, &m))
+		return g_strdup ("");
+	else {
+		gdouble hit_rate = (m.cache_lookups > 0.0)
+			? 100.0 * m.cache_hits / m.cache_lookups : 0.0;
+
+		return g_strdup_printf ("%lu nodes (peak %lu), %u GC, %u reord., "
+				"%.0f%% cache hits, %.1f MB", m.live_nodes, m.peak_nodes, m.gcs,
+				m.reorderings, hit_rate, m.memory / (1024.0 * 1024.0));
+	}
+}
+
+
+static void _update_row (EvalJobsWindow * self, GtkTreeIter * iter,
+		EvalJob * job)
+{
+	gchar * time = _format_elapsed (eval_job_get_elapsed (job));
+	gchar * metrics = _format_metrics (job);
+
+	gtk_list_store_set (self->model, iter,
+			JOBS_MODEL_COL_STATE, _job_state_name (eval_job_get_state (job)),
+			JOBS_MODEL_COL_TIME, time,
+			JOBS_MODEL_COL_METRICS, metrics, -1);
+	g_free (time);
+	g_free (metrics);
+}
+
+
+static gboolean _on_update_times (gpointer data)
+{
+	EvalJobsWindow * self = (EvalJobsWindow*) data;
+	GtkTreeModel * model = GTK_TREE_MODEL(self->model);
+	GtkTreeIter iter;
+
+	if ( !gtk_tree_model_get_iter_first (model, &iter)) {
+		self->update_source = 0;
+		return FALSE;
+	}
+
+	do {
+		EvalJob * job = NULL;
+		gtk_tree_model_get (model, &iter, JOBS_MODEL_COL_OBJECT,
+				(gpointer*) &job, -1);
+		_update_row (self, &iter, job);
+	} while (gtk_tree_model_iter_next (model, &iter));
+
+	return TRUE;
+}
+
+
+static gboolean _on_popup (gpointer data)
+{
+	EvalJobsWindow * self = (EvalJobsWindow*) data;
+	GtkTreeIter iter;
+
+	self->popup_source = 0;
+
+	/* Show the window only if there is still something going on. */
+	if (gtk_tree_model_get_iter_first (GTK_TREE_MODEL(self->model), &iter))
+		eval_jobs_window_show (self);
+
+	return FALSE;
+}
+
+
+/*!
+ * Callback for the evaluation queue.
+ */
+static void _on_job_changed (gpointer user_data, EvalJob * job)
+{
+	EvalJobsWindow * self = (EvalJobsWindow*) user_data;
+	EvalJobState state = eval_job_get_state (job);
+	GtkTreeIter iter;
+	gboolean found = _find_job (self, job, &iter);
+
+	if (EVAL_JOB_QUEUED == state || EVAL_JOB_RUNNING == state) {
+		if ( !found) {
+			gtk_list_store_append (self->model, &iter);
+			gtk_list_store_set (self->model, &iter,
+					JOBS_MODEL_COL_OBJECT, (gpointer) job,
+					JOBS_MODEL_COL_ID, eval_job_get_id (job),
+					JOBS_MODEL_COL_REL_NAME, eval_job_get_rel_name (job),
+					JOBS_MODEL_COL_TERM, eval_job_get_term (job), -1);
+		}
+		_update_row (self, &iter, job);
+
+		if ( !self->update_source)
+			self->update_source = g_timeout_add (EVAL_JOBS_WINDOW_UPDATE_INTERVAL,
+					_on_update_times, self);
+
+		if ( !self->popup_source && !_is_visible (self))
+			self->popup_source = g_timeout_add (EVAL_JOBS_WINDOW_POPUP_DELAY,
+					_on_popup, self);
+	}
+	else /* finished, failed or canceled. The job is gone afterwards. */ {
+		if (found)
+			gtk_list_store_remove (self->model, &iter);
+	}
+}
+
+
+static void _on_cancel_clicked (GtkButton * button, EvalJobsWindow * self)
+{
+	GtkTreeSelection * selection
+		= gtk_tree_view_get_selection (GTK_TREE_VIEW(self->treeview));
+	GtkTreeModel * model = NULL;
+	GList * rows = gtk_tree_selection_get_selected_rows (selection, &model);
+	GList * ids = NULL, *iter;
+
+	/* Canceling a job changes the model and may complete other jobs too,
+	 * e.g. the other parts of a split term. Collect the ids first and look
+	 * each job up again right before it's canceled. */
+	for (iter = rows ; iter ; iter = iter->next) {
+		GtkTreeIter tree_iter;
+		if (gtk_tree_model_get_iter (model, &tree_iter, (GtkTreePath*) iter->data)) {
+			guint id = 0;
+			gtk_tree_model_get (model, &tree_iter, JOBS_MODEL_COL_ID, &id, -1);
+			ids = g_list_prepend (ids, GUINT_TO_POINTER(id));
+		}
+	}
+	g_list_foreach (rows, (GFunc) gtk_tree_path_free, NULL);
+	g_list_free (rows);
+
+	/* Cancel the youngest job first, so no job is started in between which
+	 * would be canceled anyway. */
+	for (iter = ids ; iter ; iter = iter->next) {
+		EvalJob * job = eval_queue_lookup_job (GPOINTER_TO_UINT(iter->data));
+		if (job)
+			eval_job_cancel (job);
+	}
+	g_list_free (ids);
+}
+
+
+static void _on_close_clicked (GtkButton * button, EvalJobsWindow * self)
+{ eval_jobs_window_hide (self); }
+
+
+static gboolean _on_delete_event (GtkWidget * widget, GdkEvent * event,
+		EvalJobsWindow * self)
+{
+	eval_jobs_window_hide (self);
+	return TRUE; /* don't destroy */
+}
+
+
+static void _add_text_column (EvalJobsWindow * self, const gchar * title,
+		gint column)
+{
+	GtkTreeViewColumn * col = gtk_tree_view_column_new_with_attributes (title,
+			gtk_cell_renderer_text_new (), "text", column, NULL);
+	gtk_tree_view_column_set_resizable (col, TRUE);
+	gtk_tree_view_append_column (GTK_TREE_VIEW(self->treeview), col);
+}
+
+
+static EvalJobsWindow * _eval_jobs_window_new ()
+{
+	EvalJobsWindow * self = g_new0 (EvalJobsWindow, 1);
+	Workspace * workspace = rv_get_workspace (rv_get_instance());
+	GtkWidget * vbox, *scrolled, *bbox, *button;
+
+	self->model = gtk_list_store_new (JOBS_MODEL_COL_COUNT, G_TYPE_POINTER,
+			G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+			G_TYPE_STRING, G_TYPE_STRING);
+
+	self->window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_title (GTK_WINDOW(self->window), "Evaluations");
+	gtk_window_set_default_size (GTK_WINDOW(self->window), 650, 200);
+	gtk_container_set_border_width (GTK_CONTAINER(self->window), 5);
+	g_signal_connect (G_OBJECT(self->window), "delete-event",
+			G_CALLBACK(_on_delete_event), self);
+
+	vbox = gtk_vbox_new (FALSE, 5);
+	gtk_container_add (GTK_CONTAINER(self->window), vbox);
+
+	self->treeview = gtk_tree_view_new_with_model (GTK_TREE_MODEL(self->model));
+	gtk_tree_selection_set_mode (gtk_tree_view_get_selection (
+			GTK_TREE_VIEW(self->treeview)), GTK_SELECTION_MULTIPLE);
+	_add_text_column (self, "#", JOBS_MODEL_COL_ID);
+	_add_text_column (self, "Result", JOBS_MODEL_COL_REL_NAME);
+	_add_text_column (self, "Term", JOBS_MODEL_COL_TERM);
+	_add_text_column (self, "State", JOBS_MODEL_COL_STATE);
+	_add_text_column (self, "Time", JOBS_MODEL_COL_TIME);
+	_add_text_column (self, "BDD", JOBS_MODEL_COL_METRICS);
+
+	scrolled = gtk_scrolled_window_new (NULL, NULL);
+	gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW(scrolled),
+			GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+	gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW(scrolled),
+			GTK_SHADOW_IN);
+	gtk_container_add (GTK_CONTAINER(scrolled), self->treeview);
+	gtk_box_pack_start (GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
+
+	bbox = gtk_hbutton_box_new ();
+	gtk_button_box_set_layout (GTK_BUTTON_BOX(bbox), GTK_BUTTONBOX_END);
+	gtk_box_set_spacing (GTK_BOX(bbox), 5);
+	gtk_box_pack_start (GTK_BOX(vbox), bbox, FALSE, FALSE, 0);
+
+	button = gtk_button_new_with_label ("Cancel selected");
+	g_signal_connect (G_OBJECT(button), "clicked",
+			G_CALLBACK(_on_cancel_clicked), self);
+	gtk_container_add (GTK_CONTAINER(bbox), button);
+
+	button = gtk_button_new_from_stock (GTK_STOCK_CLOSE);
+	g_signal_connect (G_OBJECT(button), "clicked",
+			G_CALLBACK(_on_close_clicked), self);
+	gtk_container_add (GTK_CONTAINER(bbox), button);
+
+	gtk_widget_show_all (vbox);
+
+	/* Add the window to the workspace. Restores the position. */
+	workspace_add_window (workspace, GTK_WINDOW(self->window), "eval-jobs-window");
+
+	self->observer.jobChanged = _on_job_changed;
+	self->observer.object = self;
+	eval_queue_register_observer (&self->observer);
+
+	return self;
+}
+
+
+static void _eval_jobs_window_destroy (EvalJobsWindow * self)
+{
+	eval_queue_unregister_observer (&self->observer);
+	if (self->popup_source) g_source_remove (self->popup_source);
+	if (self->update_source) g_source_remove (self->update_source);
+	gtk_widget_destroy (self->window);
+	g_object_unref (self->model);
+	g_free (self);
+}
+
+
+static EvalJobsWindow * _window = NULL;
+
+EvalJobsWindow * eval_jobs_window_get_instance ()
+{
+	if ( !_window)
+		_window = _eval_jobs_window_new ();
+	return _window;
+}
+
+void eval_jobs_window_destroy_instance ()
+{
+	if (_window) {
+		_eval_jobs_window_destroy (_window);
+		_window = NULL;
+	}
+}
+
+GtkWidget * eval_jobs_window_get_widget (EvalJobsWindow * self)
+{ return self->window; }
+
+void eval_jobs_window_show (EvalJobsWindow * self)
+{ gtk_window_present (GTK_WINDOW(self->window)); }
+
+void eval_jobs_window_hide (EvalJobsWindow * self)
+{ gtk_widget_hide (self->window); }
@@ -322,8 +322,9 @@ void on_buttonEval_clicked(GtkButton * button, gpointer user_data)
 				/* Parse the commands from the input. */
 				gchar ** lines = g_strsplit(term, "\n", 0), **p;
 				GList * l = NULL, *iter;
+				GPtrArray * terms, * relNames;
 				gboolean go_on = FALSE;
-				gint i;
+				guint i;
 
 				for (p = lines ; *p ; p ++) {
 					gboolean go_on_now = go_on;
@@ -354,8 +355,10 @@ void on_buttonEval_clicked(GtkButton * button, gpointer user_data)
 				}
 #endif
 
-				/* Now execute the commands in the given order. Commands must
+				/* Now collect the commands in the given order. Commands must
 				 * have the form "<rel> = <term>" */
+				terms = g_ptr_array_new_with_free_func (g_free);
+				relNames = g_ptr_array_new_with_free_func (g_free);
 				for (iter = l ; iter ; iter = iter->next) {
 					GString * cmd = (GString*)iter->data;
 					gchar ** arr = g_strsplit(cmd->str, "=", 3);
@@ -363,15 +366,37 @@ void on_buttonEval_clicked(GtkButton * button, gpointer user_data)
 						rv_user_error ("Invalid command", "Missing '=' in "
 								"\"%s\". Format is <rel> = <term>. Remaining "
 								"commands are ignored!", cmd->str);
+						g_strfreev(arr);
 						break;
 					}
-					else /* execute */ {
-						compute_term(arr[1], arr[0], flags);
+					else {
+						g_ptr_array_add (relNames, g_strdup (arr[0]));
+						g_ptr_array_add (terms, g_strdup (arr[1]));
 					}
 
 					g_strfreev(arr);
 				}
 
+				/* Several commands are evaluated by a single worker. The
+				 * assertions and the sequential mode need the main
+				 * process. */
+				if (terms->len > 1 && !(flags & (RV_COMPUTE_FLAGS_CHECK_ASSERTIONS
+						| RV_COMPUTE_FLAGS_SEQUENTIAL))) {
+					if (prefs_get_int ("settings", "eval_profile", 0))
+						flags |= RV_COMPUTE_FLAGS_PROFILE;
+					compute_terms_batch ((const gchar * const *) terms->pdata,
+							(const gchar * const *) relNames->pdata,
+							terms->len, flags, NULL, NULL);
+				}
+				else {
+					for (i = 0 ; i < terms->len ; ++i)
+						compute_term (g_ptr_array_index (terms, i),
+								g_ptr_array_index (relNames, i), flags);
+				}
+
+				g_ptr_array_free (terms, TRUE);
+				g_ptr_array_free (relNames, TRUE);
+
 				for (iter = l ; iter ; iter = iter->next)
 					g_string_free((GString*)iter->data, TRUE);
 				g_list_free(l);
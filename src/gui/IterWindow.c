@@ -259,7 +259,7 @@ G_MODULE_EXPORT void on_buttonEvalIW_clicked (GtkButton * button, gpointer user_
 			rv_user_error ("No such relation", "There is no relation with name \"%s\".", input);
 		}
 		else {
-			lua_State * L = rv_lang_new_state(self->rv);
+			lua_State * L = rv_lang_new_env(self->rv);
 			char * lua_rel_name = NULL;
 			KureError * err = NULL;
 
@@ -305,7 +305,7 @@ G_MODULE_EXPORT void on_buttonEvalIW_clicked (GtkButton * button, gpointer user_
 				free (lua_rel_name);
 			}
 
-			lua_close (L);
+			rv_lang_env_destroy (self->rv, L);
 		}
 
 		g_free (output);
@@ -32,12 +32,16 @@
 #include "GraphWindow.h"
 #include "RelationWindow.h"
 #include "RelationProxyAdapter.h"
+#include "RelationBdd.h"
 
 #include <gtk/gtk.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+typedef struct _DensityPyramid DensityPyramid;
+typedef struct _ViewportRenderer ViewportRenderer;
+
 struct _RelationViewport
 {
 	Relview * rv;
@@ -101,6 +105,25 @@ struct _RelationViewport
   /* TRUE, if the window must be drawn before it's drawn to
    * the screen. */
   gboolean needRedraw;
+
+  /* Rendered tiles of the matrix, most recently used first. See
+   * _relation_viewport_draw_tiles. */
+  GHashTable/*<ViewportTileKey*,ViewportTile*>*/ * tiles;
+  GQueue/*<ViewportTile*>*/ * tileLru;
+  int tilesVisible; /* in the last frame. The cache holds at least twice
+                     * as many tiles. */
+
+  /* Renders the tiles which are missing in the cache. Created on demand.
+   * See _relation_viewport_request_tile. */
+  ViewportRenderer * renderer;
+
+  /* Density overview of relations beyond the display limit. A pixel shows
+   * a block of 2^densityShift x 2^densityShift cells. densityShift is -1
+   * until the overview was fitted to the window. See
+   * _relation_viewport_draw_density. */
+  int densityShift;
+  DensityPyramid * density;
+  guint densityIdleId; /* _relation_viewport_on_density_step, 0 if none. */
 };
 
 #define MINMARGIN 20  /* minimum border on all sides [pixels] */
@@ -112,6 +135,86 @@ struct _RelationViewport
 
 #define GRIDCELL_FILLMETHOD 0
 
+/* Up to this cell size, the cells of a tile are written to its pixels
+ * directly instead of being filled as cairo rectangles. */
+#define RASTER_MAX_DELTA 8 /* px */
+
+/* Size of a tile of the matrix and the number of tiles to keep. */
+#define TILE_SIZE_PX     256 /* px */
+#define TILE_CACHE_SIZE  64
+
+/* A tile covers the cells [tx*n,(tx+1)*n) x [ty*n,(ty+1)*n) where n is the
+ * number of cells per tile at the given cell size (delta). */
+typedef struct _ViewportTileKey
+{
+  RelFingerprint fp;
+  int delta;
+  int tx, ty;
+} ViewportTileKey;
+
+typedef struct _ViewportTile
+{
+  ViewportTileKey key;
+  cairo_surface_t * surface;
+  GList * link; /*!< in tileLru */
+} ViewportTile;
+
+/* A tile to be rendered by the worker thread. */
+typedef struct _ViewportRenderJob
+{
+  ViewportTileKey key;
+  int n;
+  guint8 * bits; /*!< The entries of the tile. See REL_BDD_BLOCK_GET. */
+  cairo_surface_t * surface; /*!< The result. */
+} ViewportRenderJob;
+
+/* The BDD manager isn't thread-safe and is used by the main loop and the
+ * controller threads of the evaluations at any time. Hence, the worker
+ * thread never touches it. The entries of a tile are extracted in the main
+ * loop, which is a single walk over a bounded block of the BDD, and the
+ * worker thread only rasterizes them. */
+struct _ViewportRenderer
+{
+  GThread * thread; /*!< NULL if it couldn't be created. */
+  GMutex * mutex;
+  GCond * cond; /*!< Signaled on new jobs and on quit. */
+
+  /* Protected by the mutex. */
+  gboolean quit;
+  GQueue/*<ViewportRenderJob*>*/ * pending;
+  GQueue/*<ViewportRenderJob*>*/ * done;
+  guint idleId; /*!< _relation_viewport_on_tiles_rendered, 0 if none. */
+
+  /* Pending jobs and the one in progress. Only used in the main loop. */
+  GHashTable/*<ViewportTileKey*,ViewportRenderJob*>*/ * requested;
+};
+
+/* Levels of the density pyramid from the finest one with at most this many
+ * blocks up to a single block are held completely. */
+#define DENSITY_MAX_BLOCKS (1 << 20)
+
+/* Number of blocks of the finest level which are counted at once. See
+ * _relation_viewport_on_density_step. */
+#define DENSITY_STEP_BLOCKS (1 << 16)
+
+/* Level s of the pyramid holds the number of entries of each aligned block
+ * of 2^s x 2^s cells (see rel_bdd_count_blocks). Only the finest level is
+ * counted on the BDD, a few rows of blocks at a time in the main loop. The
+ * others are the sums of 2x2 blocks below and are built once the finest
+ * level is complete. */
+struct _DensityPyramid
+{
+  RelFingerprint fp;
+  int rows, cols;
+  int base, top;
+  int counted; /* Rows of blocks of the finest level counted so far. */
+  double ** levels; /* levels[s-base], only levels[0] until complete. */
+
+  /* A window of a level below base. Computed on demand. */
+  int winShift, winRow, winCol, winHeight, winWidth;
+  double * win;
+};
+
 /* -------------------------------------------------- Function Prototypes --- */
 
 static
@@ -180,6 +283,13 @@ static void draw_matrix(RelationViewport * self, GdkRectangle cliprect);
 static void _relation_viewport_redraw_real(RelationViewport * self);
 static void _relation_viewport_set_labels (RelationViewport * self,
                                    Label * rowLabel, Label * colLabel);
+static void _relation_viewport_clear_tiles (RelationViewport * self);
+static void _relation_viewport_stop_renderer (RelationViewport * self);
+static void _relation_viewport_configure_density (RelationViewport * self,
+                                                  int width, int height);
+static void _relation_viewport_density_zoom (RelationViewport * self,
+                                             int pix_x, int pix_y, int dir);
+static void _density_pyramid_destroy (DensityPyramid * self);
 
 
 
@@ -330,6 +440,7 @@ void relation_viewport_set_line_mode(RelationViewport * self,
   self->lineMode = lineMode;
 }
 
+/* Must be called inside an edit transaction. See rel_edit_begin. */
 static void _foreach_in_line(Rel * rel,
 		RelationViewportLineMode lineMode, int x, int y,
 		gboolean yesno)
@@ -349,13 +460,13 @@ static void _foreach_in_line(Rel * rel,
 		case MODE_DOWN_UP:
 			i = 0;
 			while ((y - i) >= 0) {
-				kure_set_bit_si (impl, yesno, y - i, x);
+				rel_edit_set_bit (rel, y - i, x, yesno);
 				i ++;
 			}
 
 			i = 0;
 			while ((y + i) < hoehe) {
-				kure_set_bit_si (impl, yesno, y + i, x);
+				rel_edit_set_bit (rel, y + i, x, yesno);
 				i ++;
 			}
 			break;
@@ -363,13 +474,13 @@ static void _foreach_in_line(Rel * rel,
 		case MODE_LEFT_RIGHT:
 			i = 0;
 			while ((x - i) >= 0) {
-				kure_set_bit_si (impl, yesno, y, x-i);
+				rel_edit_set_bit (rel, y, x-i, yesno);
 				i ++;
 			}
 
 			i = 0;
 			while ((x + i) < breite) {
-				kure_set_bit_si (impl, yesno, y, x+i);
+				rel_edit_set_bit (rel, y, x+i, yesno);
 				i ++;
 			}
 			break;
@@ -385,7 +496,7 @@ static void _foreach_in_line(Rel * rel,
 			}
 			/* loop through line */
 			for (; (x < breite) && (y < hoehe); x ++, y ++)
-				kure_set_bit_si (impl, yesno, y,x);
+				rel_edit_set_bit (rel, y, x, yesno);
 			break;
 
 		case MODE_DOWN_LEFT:
@@ -399,7 +510,7 @@ static void _foreach_in_line(Rel * rel,
 			}
 			/* loop through line */
 			for (; (x >= 0) && (y < hoehe); x --, y ++)
-				kure_set_bit_si (impl, yesno, y,x);
+				rel_edit_set_bit (rel, y, x, yesno);
 			break;
 		}
 	}
@@ -419,15 +530,18 @@ gboolean _relation_viewport_on_left_button_press(GtkWidget * widget,
     if (pixelToGrid(self, event->x, event->y, &x, &y)) {
 
       gboolean isSet = kure_get_bit_si (impl, y, x, NULL);
-      kure_set_bit_si(impl, !isSet, y, x);
 
-      rel_changed(rel);
+      rel_edit_begin (rel);
+      rel_edit_set_bit (rel, y, x, !isSet);
+      rel_edit_commit (rel);
 
       gridToPixel(self, x, y, &pix_x, &pix_y);
       drawGridCell(self, pix_x, pix_y, !isSet, TRUE);
       _relation_viewport_sbar_update_entries(self);
     }
   }
+  else if ( !self->tooBig)
+    _relation_viewport_density_zoom (self, event->x, event->y, -1);
 
   return FALSE;
 }
@@ -454,15 +568,19 @@ gboolean _relation_viewport_on_middle_button_press(GtkWidget * widget,
     				(err && err->message) ? err->message : "Unknown");
     	}
     	else {
+		  /* All cells at once instead of one BDD operation per cell. This
+		   * emits 'changed' once. */
+		  rel_edit_begin (rel);
 		  _foreach_in_line(rel, self->lineMode, x, y, !complete);
-
-		  rel_changed(rel);
+		  rel_edit_commit (rel);
 
 		  relation_viewport_redraw(self);
 		  relation_viewport_invalidate_rect(self, NULL);
     	}
     }
   }
+  else if ( !self->tooBig)
+    _relation_viewport_density_zoom (self, event->x, event->y, +1);
 
   return FALSE;
 }
@@ -644,6 +762,16 @@ void relation_viewport_configure(RelationViewport * self)
     cairo_set_antialias(self->crOffset, CAIRO_ANTIALIAS_NONE);
     cairo_set_line_width(self->crOffset, 1);
 
+    /* Relations beyond the display limit are shown as a density
+     * overview. */
+    if ( !rel_allow_display (rel)) {
+      _relation_viewport_configure_density (self, vis_rect.width,
+                                            vis_rect.height);
+      relation_viewport_refresh (self);
+      _relation_viewport_sbar_update_entries(self);
+      return;
+    }
+
     colCount = breite = kure_rel_get_cols_si(impl);
     rowCount = hoehe = kure_rel_get_rows_si(impl);
 
@@ -926,6 +1054,7 @@ RelationViewport * relation_viewport_new()
   self->zoom = prefs_get_int("settings", "relationwindow_zoom", 3);
   self->zoomFont = TRUE;
   self->fontFamily = strdup("Sans");
+  self->densityShift = -1;
 
   self->sbar_position = (char*) calloc (1,1); // \0
   self->sbar_entries = (char*) calloc (1,1); // \0
@@ -960,6 +1089,8 @@ RelationViewport * relation_viewport_new()
 
 void relation_viewport_destroy(RelationViewport * self)
 {
+  _relation_viewport_stop_renderer (self);
+
   /* the popup owner is responsible to destroy the menu. */
   if (self->popup) {
     gtk_menu_detach(GTK_MENU (self->popup));
@@ -975,6 +1106,11 @@ void relation_viewport_destroy(RelationViewport * self)
     cairo_destroy(self->crOffset);
   }
 
+  _relation_viewport_clear_tiles (self);
+  if (self->densityIdleId)
+    g_source_remove (self->densityIdleId);
+  if (self->density)
+    _density_pyramid_destroy (self->density);
   mpz_clear(self->relEntryCount);
 
   free(self->fontFamily);
@@ -1080,6 +1216,9 @@ void relation_viewport_set_relation(RelationViewport * self, Rel * rel)
        * to internal conversion problems to (unsigned) int. */
       self->tooBig = !kure_rel_fits_si(rel_get_impl(rel));
 
+      /* Fit the density overview to the window again. */
+      self->densityShift = -1;
+
       /* Set labels. */
       {
     	  LabelAssoc assoc = rv_label_assoc_get (self->rv, self->rel, self);
@@ -1277,7 +1416,7 @@ void adjustAdjustments(RelationViewport * self, GtkRange * range, gfloat upper,
   value_correction = (adjust->value + (adjust->page_size / 2)) / adjust->upper;
 
   adjust->upper = upper;
-  adjust->page_size = (rel_allow_display(self->rel)) ? page_size : upper;
+  adjust->page_size = page_size;
   adjust->step_increment = 1; /* (adjust->page_size / 10); */
   adjust->page_increment = adjust->page_size;
   gtk_adjustment_changed(adjust);
@@ -1431,13 +1570,821 @@ gint _relation_viewport_draw_caption(RelationViewport * self)
 /*                              displayable relations                        */
 /*              09-MAR-2008 STB: Labeling enhancements                       */
 /*****************************************************************************/
+static guint _viewport_tile_key_hash (const ViewportTileKey * k)
+{
+  return rel_fingerprint_hash (&k->fp) ^ (k->delta * 7919)
+      ^ (k->tx * 31337) ^ (k->ty * 65537);
+}
+
+static gboolean _viewport_tile_key_equal (const ViewportTileKey * a,
+                                          const ViewportTileKey * b)
+{
+  return a->delta == b->delta && a->tx == b->tx && a->ty == b->ty
+      && rel_fingerprint_equal (&a->fp, &b->fp);
+}
+
+static void _viewport_tile_destroy (ViewportTile * tile)
+{
+  cairo_surface_destroy (tile->surface);
+  g_free (tile);
+}
+
+static void _relation_viewport_clear_tiles (RelationViewport * self)
+{
+  if (self->tiles) {
+    g_hash_table_destroy (self->tiles);
+    g_queue_free (self->tileLru);
+    self->tiles = NULL;
+    self->tileLru = NULL;
+  }
+}
+
+/* Returns the entries of the tile (tx,ty) with n x n cells as a packed
+ * block. Use g_free. Must be called in the main loop, because it walks the
+ * BDD. */
+static guint8 * _relation_viewport_get_tile_bits (KureRel * impl, int n,
+                                                  int tx, int ty)
+{
+  guint8 * bits = g_malloc (REL_BDD_BLOCK_SIZE(n, n));
+
+  /* Relations which are too big are drawn as a density overview. The tile
+   * is left empty otherwise. */
+  if ( !rel_bdd_get_block (impl, ty * n, tx * n, n, n, bits))
+    g_warning ("%s: The relation is too big.", G_STRFUNC);
+  return bits;
+}
+
+/* Renders the grid and the cells of a tile from its entries. The surface
+ * has a border of one pixel on each side, so the grid lines at the tile's
+ * edges are inside. Doesn't use the BDD manager, so it can be called from
+ * the worker thread. */
+static cairo_surface_t * _relation_viewport_render_tile (const guint8 * bits,
+                                                         int delta, int n)
+{
+  int size = n * delta + 2;
+  cairo_surface_t * surface
+      = cairo_image_surface_create (CAIRO_FORMAT_RGB24, size, size);
+  cairo_t * cr = cairo_create (surface);
+  int i, j;
+
+  /* Same settings as for the back pixmap. */
+  cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
+  cairo_set_line_width (cr, 1);
+  cairo_translate (cr, 1, 1);
+
+  cairo_set_source_rgb (cr, 1, 1, 1);
+  cairo_paint (cr);
+
+  cairo_set_source_rgb (cr, 0, 0, 0);
+  for (j = 0; j <= n; j ++) {
+    cairo_move_to (cr, j*delta, 0);
+    cairo_rel_line_to (cr, 0, n * delta);
+  }
+  for (i = 0; i <= n; i ++) {
+    cairo_move_to (cr, 0, i*delta);
+    cairo_rel_line_to (cr, n * delta, 0);
+  }
+  cairo_stroke (cr);
+
+  if (delta <= RASTER_MAX_DELTA) {
+    /* The grid lines are on the pixels 0, delta, 2*delta, ... of the
+     * surface, the cells are in between. All pixel rows of a row of cells
+     * are the same. Thus, the first one is filled span by span and then
+     * copied. The gray 0.6 is 0x99 in every channel and the unused byte of
+     * RGB24 is ignored, so a span is a single memset. */
+    guint8 * data;
+    int stride;
+
+    cairo_surface_flush (surface);
+    data = cairo_image_surface_get_data (surface);
+    stride = cairo_image_surface_get_stride (surface);
+
+    for (i = 0; i < n; i ++) {
+      guint8 * line = data + (gsize)(1 + i*delta) * stride;
+      gsize k = (gsize)i*n;
+      gboolean any = FALSE;
+      int y;
+
+      for (j = 0; j < n; j ++, k ++) {
+        if (REL_BDD_BLOCK_GET(bits, k)) {
+          memset (line + (1 + j*delta) * 4, 0x99, (delta-1) * 4);
+          any = TRUE;
+        }
+      }
+
+      if (any)
+        for (y = 1; y < delta-1; y ++)
+          memcpy (line + (gsize)y * stride, line, size * 4);
+    }
+    cairo_surface_mark_dirty (surface);
+  }
+  else {
+    cairo_set_source_rgb (cr, 0.6, 0.6, 0.6);
+    for (i = 0; i < n; i ++)
+      for (j = 0; j < n; j ++)
+        if (REL_BDD_BLOCK_GET(bits, (gsize)i*n + j))
+          cairo_rectangle (cr, j*delta, i*delta, delta-1, delta-1);
+    cairo_fill (cr);
+  }
+
+  cairo_destroy (cr);
+  return surface;
+}
+
+static void _viewport_tile_key_init (ViewportTileKey * key,
+                                     const RelFingerprint * fp,
+                                     int delta, int tx, int ty)
+{
+  memset (key, 0, sizeof (*key));
+  key->fp = *fp;
+  key->delta = delta;
+  key->tx = tx;
+  key->ty = ty;
+}
+
+/* Returns the tile from the cache or NULL. The tile is moved to the front
+ * of the LRU list. */
+static ViewportTile * _relation_viewport_lookup_tile (RelationViewport * self,
+                                                      const ViewportTileKey * key)
+{
+  ViewportTile * tile;
+
+  if ( !self->tiles)
+    return NULL;
+
+  tile = (ViewportTile*) g_hash_table_lookup (self->tiles, key);
+  if (tile) {
+    g_queue_unlink (self->tileLru, tile->link);
+    g_queue_push_head_link (self->tileLru, tile->link);
+  }
+  return tile;
+}
+
+/* Puts a rendered tile into the cache, which takes the surface. The least
+ * recently used tiles are dropped if the cache is full. */
+static ViewportTile * _relation_viewport_add_tile (RelationViewport * self,
+                                                   const ViewportTileKey * key,
+                                                   cairo_surface_t * surface)
+{
+  ViewportTile * tile;
+
+  if ( !self->tiles) {
+    self->tiles = g_hash_table_new_full ((GHashFunc) _viewport_tile_key_hash,
+                                         (GEqualFunc) _viewport_tile_key_equal,
+                                         NULL,
+                                         (GDestroyNotify) _viewport_tile_destroy);
+    self->tileLru = g_queue_new ();
+  }
+
+  /* Replaces an existing tile. */
+  tile = (ViewportTile*) g_hash_table_lookup (self->tiles, key);
+  if (tile) {
+    g_queue_delete_link (self->tileLru, tile->link);
+    g_hash_table_remove (self->tiles, key);
+  }
+
+  /* Visible tiles must not push each other out. Otherwise, each rendered
+   * tile would cause another one to be rendered again. */
+  while (g_queue_get_length (self->tileLru)
+         >= MAX(TILE_CACHE_SIZE, 2 * self->tilesVisible)) {
+    ViewportTile * victim = (ViewportTile*) g_queue_pop_tail (self->tileLru);
+    g_hash_table_remove (self->tiles, &victim->key);
+  }
+
+  tile = g_new0 (ViewportTile, 1);
+  tile->key = *key;
+  tile->surface = surface;
+  g_queue_push_head (self->tileLru, tile);
+  tile->link = self->tileLru->head;
+  g_hash_table_insert (self->tiles, &tile->key, tile);
+  return tile;
+}
+
+static void _viewport_render_job_destroy (ViewportRenderJob * job)
+{
+  if (job->surface)
+    cairo_surface_destroy (job->surface);
+  g_free (job->bits);
+  g_free (job);
+}
+
+/* Called in the main loop once the worker thread has rendered tiles. Moves
+ * them into the cache and redraws the viewport. */
+static gboolean _relation_viewport_on_tiles_rendered (gpointer data)
+{
+  RelationViewport * self = (RelationViewport*) data;
+  ViewportRenderer * r = self->renderer;
+  ViewportRenderJob * job;
+  GQueue * done;
+
+  g_mutex_lock (r->mutex);
+  done = r->done;
+  r->done = g_queue_new ();
+  r->idleId = 0;
+  g_mutex_unlock (r->mutex);
+
+  while ((job = (ViewportRenderJob*) g_queue_pop_head (done))) {
+    g_hash_table_remove (r->requested, &job->key);
+    _relation_viewport_add_tile (self, &job->key, job->surface);
+    job->surface = NULL;
+    _viewport_render_job_destroy (job);
+  }
+  g_queue_free (done);
+
+  relation_viewport_refresh (self);
+  return FALSE;
+}
+
+/* Thread function of the renderer. Renders the pending jobs one after
+ * another until the renderer is stopped. */
+static gpointer _relation_viewport_render_thread (gpointer data)
+{
+  RelationViewport * self = (RelationViewport*) data;
+  ViewportRenderer * r = self->renderer;
+
+  g_mutex_lock (r->mutex);
+  while ( !r->quit) {
+    ViewportRenderJob * job = (ViewportRenderJob*) g_queue_pop_head (r->pending);
+
+    if ( !job) {
+      g_cond_wait (r->cond, r->mutex);
+      continue;
+    }
+
+    g_mutex_unlock (r->mutex);
+    job->surface = _relation_viewport_render_tile (job->bits,
+                                                   job->key.delta, job->n);
+    g_mutex_lock (r->mutex);
+
+    g_queue_push_tail (r->done, job);
+    if (0 == r->idleId)
+      r->idleId = gdk_threads_add_idle (_relation_viewport_on_tiles_rendered,
+                                        self);
+  }
+  g_mutex_unlock (r->mutex);
+
+  return NULL;
+}
+
+/* Returns the renderer or NULL, if there is no worker thread. */
+static ViewportRenderer * _relation_viewport_get_renderer (RelationViewport * self)
+{
+  if ( !self->renderer) {
+    ViewportRenderer * r = g_new0 (ViewportRenderer, 1);
+    GError * err = NULL;
+
+    r->mutex = g_mutex_new ();
+    r->cond = g_cond_new ();
+    r->pending = g_queue_new ();
+    r->done = g_queue_new ();
+    r->requested = g_hash_table_new ((GHashFunc) _viewport_tile_key_hash,
+                                     (GEqualFunc) _viewport_tile_key_equal);
+    self->renderer = r;
+
+    r->thread = g_thread_create (_relation_viewport_render_thread, self,
+                                 TRUE /* joinable */, &err);
+    if ( !r->thread) {
+      g_warning ("_relation_viewport_get_renderer: Unable to create the "
+                 "render thread: %s. Rendering in the main loop.",
+                 err ? err->message : "Unknown");
+      if (err) g_error_free (err);
+    }
+  }
+
+  return self->renderer->thread ? self->renderer : NULL;
+}
+
+/* Cancels the jobs which were not started yet, except for those whose key
+ * is in keep. keep may be NULL to cancel all of them. */
+static void _relation_viewport_cancel_tiles (RelationViewport * self,
+                                             GHashTable * keep)
+{
+  ViewportRenderer * r = self->renderer;
+  ViewportRenderJob * job;
+  GQueue * canceled;
+  GList * iter;
+
+  if ( !r)
+    return;
+
+  canceled = g_queue_new ();
+  g_mutex_lock (r->mutex);
+  for (iter = r->pending->head ; iter ; ) {
+    GList * next = iter->next;
+
+    job = (ViewportRenderJob*) iter->data;
+    if ( !keep || !g_hash_table_lookup (keep, &job->key)) {
+      g_queue_unlink (r->pending, iter);
+      g_queue_push_tail_link (canceled, iter);
+    }
+    iter = next;
+  }
+  g_mutex_unlock (r->mutex);
+
+  while ((job = (ViewportRenderJob*) g_queue_pop_head (canceled))) {
+    g_hash_table_remove (r->requested, &job->key);
+    _viewport_render_job_destroy (job);
+  }
+  g_queue_free (canceled);
+}
+
+/* Stops the worker thread and waits for the tile in progress. */
+static void _relation_viewport_stop_renderer (RelationViewport * self)
+{
+  ViewportRenderer * r = self->renderer;
+  ViewportRenderJob * job;
+
+  if ( !r)
+    return;
+
+  _relation_viewport_cancel_tiles (self, NULL);
+
+  if (r->thread) {
+    g_mutex_lock (r->mutex);
+    r->quit = TRUE;
+    g_cond_signal (r->cond);
+    g_mutex_unlock (r->mutex);
+
+    g_thread_join (r->thread);
+  }
+
+  if (r->idleId)
+    g_source_remove (r->idleId);
+  while ((job = (ViewportRenderJob*) g_queue_pop_head (r->done)))
+    _viewport_render_job_destroy (job);
+
+  g_queue_free (r->pending);
+  g_queue_free (r->done);
+  g_hash_table_destroy (r->requested);
+  g_cond_free (r->cond);
+  g_mutex_free (r->mutex);
+  g_free (r);
+  self->renderer = NULL;
+}
+
+/* Queues the tile for the worker thread unless it's already queued or in
+ * progress. Returns FALSE if there is no worker thread. */
+static gboolean _relation_viewport_request_tile (RelationViewport * self,
+                                                 const ViewportTileKey * key,
+                                                 int n)
+{
+  ViewportRenderer * r = _relation_viewport_get_renderer (self);
+  ViewportRenderJob * job;
+
+  if ( !r)
+    return FALSE;
+  else if (g_hash_table_lookup (r->requested, key))
+    return TRUE;
+
+  job = g_new0 (ViewportRenderJob, 1);
+  job->key = *key;
+  job->n = n;
+  job->bits = _relation_viewport_get_tile_bits (rel_get_impl (self->rel), n,
+                                                key->tx, key->ty);
+  g_hash_table_insert (r->requested, &job->key, job);
+
+  g_mutex_lock (r->mutex);
+  g_queue_push_tail (r->pending, job);
+  g_cond_signal (r->cond);
+  g_mutex_unlock (r->mutex);
+  return TRUE;
+}
+
+/* Hatches the area of a tile which is still being rendered. */
+static void _relation_viewport_draw_placeholder (cairo_t * cr, int x, int y,
+                                                 int size)
+{
+  int k;
+
+  cairo_save (cr);
+  cairo_rectangle (cr, x, y, size, size);
+  cairo_clip (cr);
+
+  cairo_set_source_rgb (cr, 0.85, 0.85, 0.85);
+  for (k = 0; k < 2 * size; k += 8) {
+    cairo_move_to (cr, x + k, y);
+    cairo_rel_line_to (cr, -size, size);
+  }
+  cairo_stroke (cr);
+
+  cairo_restore (cr);
+}
+
+/* Draws the cells [firstRow,firstRow+rows) x [firstCol,firstCol+cols) with
+ * their grid at the given pixel position. Tiles which are still in the cache
+ * are only copied, so scrolling renders only the newly exposed tiles. The
+ * others are rendered by the worker thread and are hatched until they are
+ * ready. Queued tiles which are still visible stay in the queue. The others
+ * were scrolled out or belong to an older state of the relation and are
+ * dropped. */
+static void _relation_viewport_draw_tiles (RelationViewport * self,
+                                           int pix_x, int pix_y,
+                                           int firstRow, int firstCol,
+                                           int rows, int cols, int delta)
+{
+  cairo_t * cr = self->crOffset;
+  int n = MAX(1, TILE_SIZE_PX / delta);
+  RelFingerprint fp;
+  ViewportTileKey * keys;
+  GHashTable * visible;
+  int tx, ty, k = 0;
+
+  rel_get_fingerprint (self->rel, &fp);
+  self->tilesVisible = ((firstRow + rows - 1) / n - firstRow / n + 1)
+      * ((firstCol + cols - 1) / n - firstCol / n + 1);
+  keys = g_new (ViewportTileKey, self->tilesVisible);
+  visible = g_hash_table_new ((GHashFunc) _viewport_tile_key_hash,
+                              (GEqualFunc) _viewport_tile_key_equal);
+
+  /* The outer grid lines are drawn directly. Everything inside is taken
+   * from the tiles. */
+  cairo_set_source_rgb (cr, 0, 0, 0);
+  cairo_rectangle (cr, pix_x, pix_y, cols * delta, rows * delta);
+  cairo_stroke (cr);
+
+  cairo_save (cr);
+  cairo_rectangle (cr, pix_x, pix_y, cols * delta, rows * delta);
+  cairo_clip (cr);
+
+  for (ty = firstRow / n ; ty <= (firstRow + rows - 1) / n ; ty ++) {
+    for (tx = firstCol / n ; tx <= (firstCol + cols - 1) / n ; tx ++) {
+      ViewportTileKey * key = &keys[k ++];
+      ViewportTile * tile;
+      int x = pix_x + (tx * n - firstCol) * delta,
+          y = pix_y + (ty * n - firstRow) * delta;
+
+      _viewport_tile_key_init (key, &fp, delta, tx, ty);
+      g_hash_table_insert (visible, key, key);
+      tile = _relation_viewport_lookup_tile (self, key);
+      if ( !tile && !_relation_viewport_request_tile (self, key, n)) {
+        guint8 * bits = _relation_viewport_get_tile_bits (rel_get_impl (self->rel),
+                                                          n, tx, ty);
+        tile = _relation_viewport_add_tile (self, key,
+            _relation_viewport_render_tile (bits, delta, n));
+        g_free (bits);
+      }
+
+      if (tile) {
+        cairo_set_source_surface (cr, tile->surface, x - 1, y - 1);
+        cairo_paint (cr);
+      }
+      else _relation_viewport_draw_placeholder (cr, x, y, n * delta);
+    }
+  }
+
+  _relation_viewport_cancel_tiles (self, visible);
+  g_hash_table_destroy (visible);
+  g_free (keys);
+
+  cairo_restore (cr);
+  cairo_set_source_rgb (cr, 0, 0, 0);
+}
+
+static void _density_pyramid_destroy (DensityPyramid * self)
+{
+  int s;
+
+  for (s = self->base ; s <= self->top ; s ++)
+    g_free (self->levels[s - self->base]);
+  g_free (self->levels);
+  g_free (self->win);
+  g_free (self);
+}
+
+static DensityPyramid * _density_pyramid_new (Rel * rel)
+{
+  KureRel * impl = rel_get_impl (rel);
+  DensityPyramid * self = g_new0 (DensityPyramid, 1);
+  int s;
+
+  rel_get_fingerprint (rel, &self->fp);
+  self->rows = kure_rel_get_rows_si (impl);
+  self->cols = kure_rel_get_cols_si (impl);
+
+  for (s = 0 ; (gint64) REL_BDD_BLOCKS(self->rows, s)
+         * REL_BDD_BLOCKS(self->cols, s) > DENSITY_MAX_BLOCKS ; s ++) ;
+  self->base = self->top = s;
+  while (REL_BDD_BLOCKS(self->rows, self->top) > 1
+         || REL_BDD_BLOCKS(self->cols, self->top) > 1)
+    self->top ++;
+
+  self->levels = g_new0 (double*, self->top - self->base + 1);
+  self->levels[0] = g_new0 (double, (gsize) REL_BDD_BLOCKS(self->rows, s)
+                            * REL_BDD_BLOCKS(self->cols, s));
+  return self;
+}
+
+static gboolean _density_pyramid_is_complete (const DensityPyramid * self)
+{
+  return self->counted >= REL_BDD_BLOCKS(self->rows, self->base);
+}
+
+/* Counts the next rows of blocks of the finest level. The coarser levels
+ * are built after the last ones. */
+static void _density_pyramid_step (DensityPyramid * self, KureRel * impl)
+{
+  int blockRows = REL_BDD_BLOCKS(self->rows, self->base),
+      blockCols = REL_BDD_BLOCKS(self->cols, self->base);
+  int height = MIN(blockRows - self->counted,
+                   MAX(1, DENSITY_STEP_BLOCKS / blockCols));
+  int s, i, j;
+
+  if (_density_pyramid_is_complete (self))
+    return;
+
+  rel_bdd_count_blocks (impl, self->base, self->counted, 0, height, blockCols,
+                        self->levels[0] + (gsize) self->counted * blockCols);
+  self->counted += height;
+  if ( !_density_pyramid_is_complete (self))
+    return;
+
+  for (s = self->base + 1 ; s <= self->top ; s ++) {
+    int fineRows = REL_BDD_BLOCKS(self->rows, s-1),
+        fineCols = REL_BDD_BLOCKS(self->cols, s-1),
+        cols = REL_BDD_BLOCKS(self->cols, s);
+    const double * fine = self->levels[s-1 - self->base];
+    double * coarse = g_new0 (double, (gsize) REL_BDD_BLOCKS(self->rows, s) * cols);
+
+    for (i = 0 ; i < fineRows ; i ++)
+      for (j = 0 ; j < fineCols ; j ++)
+        coarse[(gsize)(i >> 1) * cols + (j >> 1)] += fine[(gsize) i * fineCols + j];
+    self->levels[s - self->base] = coarse;
+  }
+}
+
+/* Idle handler which builds the density pyramid step by step, so the main
+ * loop stays responsive for big relations. Starts over if the relation has
+ * changed in between. */
+static gboolean _relation_viewport_on_density_step (gpointer data)
+{
+  RelationViewport * self = (RelationViewport*) data;
+  RelFingerprint fp;
+
+  if ( !self->rel || !self->density) {
+    self->densityIdleId = 0;
+    return FALSE;
+  }
+
+  rel_get_fingerprint (self->rel, &fp);
+  if ( !rel_fingerprint_same_contents (&fp, &self->density->fp)) {
+    _density_pyramid_destroy (self->density);
+    self->density = _density_pyramid_new (self->rel);
+  }
+
+  _density_pyramid_step (self->density, rel_get_impl (self->rel));
+  relation_viewport_refresh (self);
+
+  if (_density_pyramid_is_complete (self->density)) {
+    self->densityIdleId = 0;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Returns the counts of the blocks [row,row+height) x [col,col+width) of the
+ * given level. The window must be inside the level. stride receives the
+ * distance between two rows of blocks. Levels below the pyramid are counted
+ * for the window only. */
+static const double * _density_pyramid_get (DensityPyramid * self,
+                                            KureRel * impl, int shift,
+                                            int row, int col, int height,
+                                            int width, int * stride)
+{
+  if (shift >= self->base) {
+    shift = MIN(shift, self->top);
+    *stride = REL_BDD_BLOCKS(self->cols, shift);
+    return self->levels[shift - self->base] + (gsize) row * (*stride) + col;
+  }
+
+  if ( !self->win || self->winShift != shift || self->winRow != row
+       || self->winCol != col || self->winHeight != height
+       || self->winWidth != width) {
+    g_free (self->win);
+    self->win = g_new (double, (gsize) height * width);
+    rel_bdd_count_blocks (impl, shift, row, col, height, width, self->win);
+    self->winShift = shift;
+    self->winRow = row; self->winCol = col;
+    self->winHeight = height; self->winWidth = width;
+  }
+
+  *stride = width;
+  return self->win;
+}
+
+/* Smallest level at which the relation fits into the given number of
+ * pixels. */
+static int _relation_viewport_density_fit (RelationViewport * self,
+                                           int width, int height)
+{
+  KureRel * impl = rel_get_impl (self->rel);
+  int rows = kure_rel_get_rows_si (impl), cols = kure_rel_get_cols_si (impl);
+  int shift = 0;
+
+  while (REL_BDD_BLOCKS(cols, shift) > MAX(1, width)
+         || REL_BDD_BLOCKS(rows, shift) > MAX(1, height))
+    shift ++;
+  return shift;
+}
+
+/* Pixel position of the first block and the number of blocks which fit into
+ * the window. */
+static void _relation_viewport_density_area (RelationViewport * self,
+                                             int width, int height,
+                                             GdkRectangle * area)
+{
+  area->x = MINMARGIN;
+  area->y = CAPTION_MARGIN_TOP + MINMARGIN;
+  area->width = MAX(1, width - 2 * MINMARGIN);
+  area->height = MAX(1, height - area->y - MINMARGIN);
+}
+
+static void _relation_viewport_configure_density (RelationViewport * self,
+                                                  int width, int height)
+{
+  KureRel * impl = rel_get_impl (self->rel);
+  GdkRectangle area;
+
+  _relation_viewport_density_area (self, width, height, &area);
+
+  /* Initially, the complete relation is shown. */
+  if (self->densityShift < 0)
+    self->densityShift = _relation_viewport_density_fit (self, area.width,
+                                                         area.height);
+
+  self->labelmx = self->labelmy = 0;
+  self->marginx = self->marginy = MINMARGIN;
+
+  gtk_signal_handler_block_by_func
+    (GTK_OBJECT (self->drawingarea),
+        GTK_SIGNAL_FUNC (_relation_viewport_on_configure), self);
+
+  adjustAdjustments(self, GTK_RANGE (self->horzScroll),
+                    REL_BDD_BLOCKS(kure_rel_get_cols_si (impl),
+                                   self->densityShift), area.width);
+  adjustAdjustments(self, GTK_RANGE (self->vertScroll),
+                    REL_BDD_BLOCKS(kure_rel_get_rows_si (impl),
+                                   self->densityShift), area.height);
+
+  gtk_signal_handler_unblock_by_func
+    (GTK_OBJECT (self->drawingarea),
+    GTK_SIGNAL_FUNC (_relation_viewport_on_configure), self);
+}
+
+/* Zooms the density overview in (dir < 0) or out (dir > 0) by one level.
+ * The block under the pointer stays where it is. */
+static void _relation_viewport_density_zoom (RelationViewport * self,
+                                             int pix_x, int pix_y, int dir)
+{
+  KureRel * impl = rel_get_impl (self->rel);
+  int rows = kure_rel_get_rows_si (impl), cols = kure_rel_get_cols_si (impl);
+  int shift = self->densityShift + dir;
+  GdkRectangle area;
+  GdkPoint scroll_pos;
+  int x, y;
+
+  if (self->densityShift < 0 || shift < 0 || shift > 30
+      || (dir > 0 && REL_BDD_BLOCKS(rows, self->densityShift) <= 1
+          && REL_BDD_BLOCKS(cols, self->densityShift) <= 1))
+    return;
+
+  _relation_viewport_density_area (self,
+                                   self->drawingarea->allocation.width,
+                                   self->drawingarea->allocation.height,
+                                   &area);
+  pix_x = CLAMP(pix_x - area.x, 0, area.width - 1);
+  pix_y = CLAMP(pix_y - area.y, 0, area.height - 1);
+
+  scroll_pos = getCanvasOrigin(self->horzScroll, self->vertScroll);
+  x = scroll_pos.x + pix_x;
+  y = scroll_pos.y + pix_y;
+  if (dir < 0) { x *= 2; y *= 2; }
+  else { x /= 2; y /= 2; }
+
+  self->densityShift = shift;
+  relation_viewport_configure (self);
+
+  gtk_adjustment_set_value (gtk_range_get_adjustment (GTK_RANGE (self->horzScroll)),
+                            x - pix_x);
+  gtk_adjustment_set_value (gtk_range_get_adjustment (GTK_RANGE (self->vertScroll)),
+                            y - pix_y);
+  relation_viewport_refresh (self);
+}
+
+/* Draws the density overview of a relation beyond the display limit. Each
+ * pixel shows the fraction of the entries which are set in its block. The
+ * darker the pixel, the more entries. Blocks with at least one entry are
+ * never white. At level 0, each pixel is a single cell. */
+static void _relation_viewport_draw_density (RelationViewport * self)
+{
+  cairo_t * cr = self->crOffset;
+  KureRel * impl = rel_get_impl (self->rel);
+  int rows = kure_rel_get_rows_si (impl), cols = kure_rel_get_cols_si (impl);
+  GdkRectangle vis_rect, area;
+  GdkPoint scroll_pos;
+  int shift, width, height, stride, i, j;
+  const double * counts;
+  cairo_surface_t * surface;
+  guint8 * data;
+  gchar * text;
+
+  vis_rect = getVisibleRect(self->drawingarea, self->horzScroll,
+                            self->vertScroll);
+  scroll_pos = getCanvasOrigin(self->horzScroll, self->vertScroll);
+  _relation_viewport_density_area (self, vis_rect.width, vis_rect.height,
+                                   &area);
+
+  if (self->densityShift < 0)
+    self->densityShift = _relation_viewport_density_fit (self, area.width,
+                                                         area.height);
+  shift = self->densityShift;
+
+  width = MIN(REL_BDD_BLOCKS(cols, shift) - scroll_pos.x, area.width);
+  height = MIN(REL_BDD_BLOCKS(rows, shift) - scroll_pos.y, area.height);
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (self->density) {
+    RelFingerprint fp;
+
+    rel_get_fingerprint (self->rel, &fp);
+    if ( !rel_fingerprint_same_contents (&fp, &self->density->fp)) {
+      _density_pyramid_destroy (self->density);
+      self->density = NULL;
+    }
+  }
+  if ( !self->density)
+    self->density = _density_pyramid_new (self->rel);
+
+  /* The levels of the pyramid are still being counted. Levels below it
+   * are counted for the window only, so they needn't wait. */
+  if (shift >= self->density->base
+      && !_density_pyramid_is_complete (self->density)) {
+    if ( !self->densityIdleId)
+      self->densityIdleId = gdk_threads_add_idle (_relation_viewport_on_density_step,
+                                                  self);
+    text = g_strdup_printf ("Counting the entries for the overview ... %d%%",
+                            (int) (100.0 * self->density->counted
+                                   / REL_BDD_BLOCKS(rows, self->density->base)));
+    _relation_viewport_draw_message (self, text);
+    g_free (text);
+    return;
+  }
+
+  counts = _density_pyramid_get (self->density, impl, shift, scroll_pos.y,
+                                 scroll_pos.x, height, width, &stride);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+
+  for (i = 0 ; i < height ; i ++) {
+    guint32 * line = (guint32*) (data + i * cairo_image_surface_get_stride (surface));
+    gint64 r = (gint64) (scroll_pos.y + i) << shift;
+    double blockRows = (double) MIN(rows - r, (gint64) 1 << shift);
+
+    for (j = 0 ; j < width ; j ++) {
+      gint64 c = (gint64) (scroll_pos.x + j) << shift;
+      double blockCols = (double) MIN(cols - c, (gint64) 1 << shift);
+      double d = counts[(gsize) i * stride + j] / (blockRows * blockCols);
+      guint32 v = (d <= .0) ? 255 : (guint32) (220 * (1. - MIN(d, 1.)));
+
+      line[j] = (v << 16) | (v << 8) | v;
+    }
+  }
+  cairo_surface_mark_dirty (surface);
+
+  cairo_set_source_surface (cr, surface, area.x, area.y);
+  cairo_paint (cr);
+  cairo_surface_destroy (surface);
+
+  cairo_set_source_rgb (cr, 0, 0, 0);
+  cairo_rectangle (cr, area.x - 1, area.y - 1, width + 1, height + 1);
+  cairo_stroke (cr);
+
+  if (0 == shift)
+    text = g_strdup_printf ("Exceeds the display limit of %d. 1 pixel = "
+                            "1 cell. Middle click zooms out.",
+                            prefs_get_int("settings", "relation_display_limit", 2 << 26));
+  else
+    text = g_strdup_printf ("Exceeds the display limit of %d. 1 pixel = "
+                            "%dx%d cells. Left click zooms in, middle click "
+                            "zooms out.",
+                            prefs_get_int("settings", "relation_display_limit", 2 << 26),
+                            1 << shift, 1 << shift);
+  cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, 0);
+  cairo_set_font_size(cr, 12);
+  cairo_move_to (cr, area.x, vis_rect.height - 5);
+  cairo_show_text (cr, text);
+  cairo_new_path (cr);
+  g_free (text);
+}
+
 void draw_matrix(RelationViewport * self, GdkRectangle cliprect)
 {
   GdkPoint scroll_pos; /* [cells] */
   GdkRectangle vis_rect; /* x,y in [cells], width,height in [px] */
   GdkPoint draw_pos; /* [cells] */
   Rel * rel = self->rel;
-  KureRel * impl = rel_get_impl (rel);
   int delta = _relation_viewport_get_delta(self);
 
   vis_rect = getVisibleRect(self->drawingarea, self->horzScroll,
@@ -1477,45 +2424,9 @@ void draw_matrix(RelationViewport * self, GdkRectangle cliprect)
     cols = MAX(1, MIN (breite-(signed)scroll_pos.x, (vis_rect.width - pix_x) / delta));
     rows = MAX(1, MIN (hoehe-(signed)scroll_pos.y, (vis_rect.height - pix_y_start) / delta));
 
-    /* draw the grid cells column-wise */
-    {
-      gint firstCol = draw_pos.x, firstRow = draw_pos.y;
-      gint i, j;
-      int vars_cols = kure_rel_get_vars_cols(impl), vars_rows = kure_rel_get_vars_rows(impl);
-
-      {
-        cairo_t * cr = self->crOffset;
-
-        /* Draw the complete grid at once. */
-        cairo_set_source_rgb(cr, 0, 0, 0);
-        for (j = 0; j <= cols; j ++) /* vertical grid lines */{
-          cairo_move_to(cr, pix_x + j*delta, pix_y_start);
-          cairo_rel_line_to(cr, 0, rows * delta);
-        }
-        for (i = 0; i <= rows; i ++) /* horizontal grid lines */{
-          cairo_move_to(cr, pix_x, pix_y_start + i*delta);
-          cairo_rel_line_to(cr, cols * delta, 0);
-        }
-        cairo_stroke(cr);
-
-        /* Draw the bits set */
-        cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
-        for (j = 0; j < cols; j ++) {
-          for (i = 0; i < rows; i ++) {
-            if (kure_get_bit_fast_si (impl,i+firstRow,j+firstCol,vars_rows,vars_cols)) {
-              int x = pix_x + j*delta, y = pix_y_start + i*delta;
-
-              cairo_rectangle(cr, x, y, delta-1, delta-1);
-            }
-          }
-        }
-        cairo_fill(cr);
-
-        /* Reset the color to black */
-        cairo_set_source_rgb(cr, 0, 0, 0);
-      }
-
-    }
+    /* draw the grid cells from the cached tiles */
+    _relation_viewport_draw_tiles (self, pix_x, pix_y_start, draw_pos.y,
+                                   draw_pos.x, rows, cols, delta);
 
     /* draw the labels */
     vis_width = self->drawingarea->allocation.width - self->marginx
@@ -1575,11 +2486,7 @@ void draw_matrix(RelationViewport * self, GdkRectangle cliprect)
     }
 
   } else /* ! rel_allow_display (rel) */{
-    int relationLimit = prefs_get_int("settings", "relation_display_limit", 2 << 26);
-    char errMessage[100];
-    sprintf(errMessage,"This relation can not be displayed, because the limit of %i was reached.", relationLimit);
-
-    _relation_viewport_draw_message(self, errMessage);
+    _relation_viewport_draw_density(self);
   }
 
   _relation_viewport_sbar_update_labels(self);
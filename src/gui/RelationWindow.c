@@ -619,6 +619,7 @@ void _relation_window_rel_changed (RelationWindow * self, Rel * old_rel, Rel * n
 #include "GraphWindow.h"
 #include "Relation.h" /* rel_is_valid_name */
 #include "RelationProxyAdapter.h"
+#include "RelationBdd.h"
 #include "Observer.h"
 
 #include <stdio.h>
@@ -634,6 +635,13 @@ void _relation_window_rel_changed (RelationWindow * self, Rel * old_rel, Rel * n
 /*    CREATED : 17-AUG-1995 PS                                               */
 /*   MODIFIED : 13-JUN-2000 WL: GTK+ port                                    */
 /*****************************************************************************/
+static void _rel_to_xgraph_build_edge (int row, int col, GraphBuilder * builder)
+{
+	if (! builder->buildEdge (builder,row,col)) {
+		g_warning ("_rel_to_xgraph: Unable to create an edge %d->%d.\n", row+1,col+1);
+	}
+}
+
 static XGraph * _rel_to_xgraph (Rel * rel)
 {
 	KureRel * impl = rel_get_impl(rel);
@@ -645,23 +653,19 @@ static XGraph * _rel_to_xgraph (Rel * rel)
 	}
 	else {
 		gint n = (gint) kure_rel_get_rows_si(impl);
-		gint i,j;
+		gint i;
 
 		XGraph * gr = xgraph_new (rel_get_name(rel));
 		GraphBuilder * builder = xgraph_get_builder(gr);
-		RelationProxy * proxy = relation_proxy_adapter_new(rel);
 
 		for (i = 0 ; i < n ; i ++) {
 			g_assert (builder->buildNode (builder, i));
 		}
-		for (i = 0 ; i < n ; i ++)
-			for (j = 0 ; j < n ; j ++)
-				if (proxy->getBit (proxy,j,i))
-					if (! builder->buildEdge (builder,i,j)) {
-						g_warning ("_rel_to_xgraph: Unable to create an edge %d->%d.\n", i+1,j+1);
-					}
 
-		proxy->destroy (proxy);
+		/* Only the entries are visited, not all n^2 pairs. */
+		rel_bdd_foreach_entry (impl, 0, 0, n, n,
+				(RelBddEntryFunc) _rel_to_xgraph_build_edge, builder);
+
 		builder->destroy (builder);
 
 		return gr;
@@ -30,6 +30,7 @@
 #include "Relview.h"
 #include "global.h"
 #include "Relation.h"
+#include "RelationBdd.h"
 #include "Graph.h"
 #include "utilities.h"
 #include "label.h"
@@ -208,16 +209,20 @@ void menuitemCreateVectorFromNodeSelection_activate(GtkMenuItem * menuitem,
 		SelectionManager * selManager = graph_window_get_selection_manager(gw);
 		const GList * l = selManager->getSelection(selManager, NULL);
 		const GList * iter = l;
-		KureRel * impl = rel_get_impl (vec);
+		GArray/*<RelBddPair>*/ * pairs = g_array_new (FALSE, FALSE, sizeof(RelBddPair));
 
 		for (; iter; iter = iter->next) {
 			/* Maybe the node numbers are shown in the graph window and are not the
 			 * internal node numbers. */
 			XGraphNode * node = (XGraphNode*) iter->data;
-			gint nodeNum = atoi(xgraph_node_get_name(node));
+			RelBddPair p = { atoi(xgraph_node_get_name(node)) - 1, 0 };
 
-			kure_set_bit_si(impl, TRUE, nodeNum-1, 0);
+			g_array_append_val (pairs, p);
 		}
+
+		rel_bdd_set_pairs (rel_get_impl (vec), (RelBddPair*) pairs->data,
+				pairs->len, TRUE);
+		g_array_free (pairs, TRUE);
 	}
 
 	rel_changed(vec);
@@ -250,7 +255,7 @@ void menuitemCreateRelationFromEdgeSelection_activate(GtkMenuItem * menuitem,
 		SelectionManager * selManager = graph_window_get_selection_manager(gw);
 		const GList * l = selManager->getSelection(selManager, NULL);
 		const GList * iter = l;
-		KureRel * impl = rel_get_impl(localRel);
+		GArray/*<RelBddPair>*/ * pairs = g_array_new (FALSE, FALSE, sizeof(RelBddPair));
 
 		for (; iter; iter = iter->next)
 		{
@@ -259,11 +264,15 @@ void menuitemCreateRelationFromEdgeSelection_activate(GtkMenuItem * menuitem,
 			XGraphNode *from = xgraph_get_node_by_id(gr,
 					xgraph_edge_get_from_id(edge)), *to =
 					xgraph_get_node_by_id(gr, xgraph_edge_get_to_id(edge));
-			int row = atoi(xgraph_node_get_name(from)) - 1, col = atoi(
-					xgraph_node_get_name(to)) - 1;
+			RelBddPair p = { atoi(xgraph_node_get_name(from)) - 1,
+					atoi(xgraph_node_get_name(to)) - 1 };
 
-			kure_set_bit_si(impl, TRUE, row, col);
+			g_array_append_val (pairs, p);
 		}
+
+		rel_bdd_set_pairs (rel_get_impl(localRel), (RelBddPair*) pairs->data,
+				pairs->len, TRUE);
+		g_array_free (pairs, TRUE);
 	}
 
 	rel_changed (localRel);
@@ -44,6 +44,7 @@
 #include "LabelWindow.h"
 #include "PluginWindow.h"
 #include "IterWindow.h"
+#include "EvalJobsWindow.h"
 #include "version.h"
 #include "Graph.h" // xgraph_create_default
 
@@ -68,7 +69,7 @@ static gchar * _start_up_files [] = { "start_up.xdd", "start_up.prog", NULL };
  */
 typedef struct _Options
 {
-	int dummy;
+	gboolean no_prog_cache; /*!< See prog_file_set_cache_enabled. */
 } Options;
 
 
@@ -164,6 +165,7 @@ static gboolean _parse_options (Options * opts, int argc, char ** argv)
 			{ "quiet", 0, 0, G_OPTION_ARG_NONE, &be_quiet, "Suppress any non-relevant output. Same as --verbose=0.", NULL },
 			{ "version", 0, 0, G_OPTION_ARG_NONE, &show_version, "Show version information and exit.", NULL },
 			{ "config", 'c', 0, G_OPTION_ARG_STRING, &config_key, "Show the given config value. [default=help]", NULL },
+			{ "no-prog-cache", 0, 0, G_OPTION_ARG_NONE, &opts->no_prog_cache, "Always translate program files, even if they are unchanged.", NULL },
 			{ NULL }
 	};
 
@@ -266,6 +268,7 @@ static void _create_windows (Relview * rv)
 	test_window_init ();
 	label_window_get_instance();
 	iter_window_get_instance ();
+	eval_jobs_window_get_instance ();
 	rvops_init ();
 	file_window_get_instance ();
 }
@@ -455,20 +458,35 @@ int main (int argc, char ** argv)
    * occurrence remains. */
   file_loader_set_replace_policy (loader, RV_REPLACE_POLICY_REPLACE_ALL);
 
-  for ( ; *start_up_file_ptr ; ++start_up_file_ptr) {
-	  gchar * path = rv_find_startup_file (*start_up_file_ptr);
-	  if (path) {
-		  GError * err = NULL;
+  prog_file_set_cache_enabled ( !opts.no_prog_cache);
 
-		  VERBOSE(VERBOSE_INFO, printf ("Loading start-up file \"%s\" ...\n", path););
+  {
+	  GTimer * total = g_timer_new ();
 
-		  if ( !file_loader_load_file (loader, path, &err)) {
-			  g_warning ("Error loading \"%s\". Reason: %s\n", path, err->message);
-			  g_error_free (err);
-		  }
+	  for ( ; *start_up_file_ptr ; ++start_up_file_ptr) {
+		  gchar * path = rv_find_startup_file (*start_up_file_ptr);
+		  if (path) {
+			  GError * err = NULL;
+			  GTimer * timer = g_timer_new ();
+
+			  VERBOSE(VERBOSE_INFO, printf ("Loading start-up file \"%s\" ...\n", path););
+
+			  if ( !file_loader_load_file (loader, path, &err)) {
+				  g_warning ("Error loading \"%s\". Reason: %s\n", path, err->message);
+				  g_error_free (err);
+			  }
 
-		  g_free (path);
+			  VERBOSE(VERBOSE_INFO, printf ("Loaded start-up file \"%s\" in %.3fs.\n",
+					  path, g_timer_elapsed (timer, NULL)););
+			  g_timer_destroy (timer);
+			  g_free (path);
+		  }
 	  }
+
+	  VERBOSE(VERBOSE_PROGRESS, printf ("Start-up files loaded in %.3fs (program "
+			  "cache %s).\n", g_timer_elapsed (total, NULL),
+			  opts.no_prog_cache ? "disabled" : "enabled"););
+	  g_timer_destroy (total);
   }
 
   FOREACH_REL(rv_get_rel_manager(rv), cur, iter, { rel_set_hidden(cur, TRUE); });